@@ -5,20 +5,62 @@
 
 #include "gmenu2x.h"
 
+using namespace std;
+
 
 Background::Background(GMenu2X& gmenu2x)
 	: gmenu2x(gmenu2x)
 	, battery(gmenu2x.sc)
+	, batteryIcon(nullptr)
+	, batteryRect({ 0, 0, 0, 0 })
 {
 }
 
+SDL_Rect Background::clockRect(string const& time) {
+	Font& font = *gmenu2x.font;
+	const int w = font.getTextWidth(time);
+	const int h = font.getLineSpacing();
+	// Include the outline around the text.
+	return SDL_Rect {
+		static_cast<Sint16>(gmenu2x.resX / 2 - w / 2 - 1),
+		static_cast<Sint16>(gmenu2x.bottomBarTextY - h / 2 - 1),
+		static_cast<Uint16>(w + 2), static_cast<Uint16>(h + 2)
+	};
+}
+
+bool Background::runAnimations() {
+	// Nothing animates, but the clock and the battery status can change
+	// while the rest of the screen stays the same.
+	string time = clock.getTime();
+	if (time != clockTime) {
+		invalidate(clockRect(clockTime));
+		invalidate(clockRect(time));
+		clockTime = time;
+	}
+
+	auto icon = battery.getIcon();
+	if (icon != batteryIcon) {
+		invalidate(batteryRect);
+		batteryIcon = icon;
+		batteryRect = SDL_Rect {
+			static_cast<Sint16>(gmenu2x.resX - 19),
+			static_cast<Sint16>(gmenu2x.bottomBarIconY),
+			static_cast<Uint16>(icon ? icon->width() : 0),
+			static_cast<Uint16>(icon ? icon->height() : 0)
+		};
+		invalidate(batteryRect);
+	}
+
+	return false;
+}
+
 void Background::paint(Surface& s) {
 	Font& font = *gmenu2x.font;
 	OffscreenSurface& bgmain = *gmenu2x.bgmain;
 
 	bgmain.blit(s, 0, 0);
 
-	font.write(s, clock.getTime(),
+	font.write(s, clockTime,
 			s.width() / 2, gmenu2x.bottomBarTextY,
 			Font::HAlignCenter, Font::VAlignMiddle);
 
@@ -35,6 +77,8 @@ bool Background::handleButtonPress(InputManager::Button button) {
 			return true;
 		case InputManager::SETTINGS:
 			gmenu2x.showSettings();
+			// The settings dialog painted over the whole screen.
+			invalidate();
 			return true;
 		default:
 			return false;
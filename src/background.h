@@ -8,7 +8,11 @@
 #include "clock.h"
 #include "layer.h"
 
+#include <memory>
+#include <string>
+
 class GMenu2X;
+class OffscreenSurface;
 
 
 /**
@@ -19,13 +23,23 @@ public:
 	Background(GMenu2X& gmenu2x);
 
 	// Layer implementation:
+	virtual bool runAnimations();
 	virtual void paint(Surface& s);
+	virtual bool isOpaque() { return true; }
+	virtual Profiler::Phase getPaintPhase() { return Profiler::PAINT_BACKGROUND; }
 	virtual bool handleButtonPress(InputManager::Button button);
 
 private:
+	SDL_Rect clockRect(std::string const& time);
+
 	GMenu2X& gmenu2x;
 	Battery battery;
 	Clock clock;
+
+	/** The clock text and battery icon that are currently on screen. */
+	std::string clockTime;
+	std::shared_ptr<OffscreenSurface> batteryIcon;
+	SDL_Rect batteryRect;
 };
 
 #endif // BACKGROUND_H
@@ -53,7 +53,7 @@ Battery::Battery(SurfaceCollection& sc_)
 	update();
 }
 
-const OffscreenSurface *Battery::getIcon()
+std::shared_ptr<OffscreenSurface> Battery::getIcon()
 {
 	// Check battery status every 60 seconds.
 	unsigned int now = SDL_GetTicks();
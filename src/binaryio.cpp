@@ -0,0 +1,78 @@
+// Various authors.
+// License: GPL version 2 or later.
+
+#include "binaryio.h"
+
+#include <cstring>
+
+using namespace std;
+
+void BinaryWriter::writeU8(uint8_t value)
+{
+	writeBytes(&value, sizeof(value));
+}
+
+void BinaryWriter::writeU32(uint32_t value)
+{
+	writeBytes(&value, sizeof(value));
+}
+
+void BinaryWriter::writeU64(uint64_t value)
+{
+	writeBytes(&value, sizeof(value));
+}
+
+void BinaryWriter::writeString(string const& value)
+{
+	writeU32(value.size());
+	buffer.append(value);
+}
+
+void BinaryWriter::writeBytes(const void *bytes, size_t length)
+{
+	buffer.append(static_cast<const char *>(bytes), length);
+}
+
+BinaryReader::BinaryReader(string const& data)
+	: data(data)
+	, pos(0)
+{
+}
+
+bool BinaryReader::readU8(uint8_t& value)
+{
+	return readBytes(&value, sizeof(value));
+}
+
+bool BinaryReader::readU32(uint32_t& value)
+{
+	return readBytes(&value, sizeof(value));
+}
+
+bool BinaryReader::readU64(uint64_t& value)
+{
+	return readBytes(&value, sizeof(value));
+}
+
+bool BinaryReader::readString(string& value)
+{
+	uint32_t length;
+	if (!readU32(length) || length > data.size() - pos) {
+		pos = data.size() + 1;
+		return false;
+	}
+	value.assign(data, pos, length);
+	pos += length;
+	return true;
+}
+
+bool BinaryReader::readBytes(void *bytes, size_t length)
+{
+	if (pos > data.size() || length > data.size() - pos) {
+		pos = data.size() + 1;
+		return false;
+	}
+	memcpy(bytes, data.data() + pos, length);
+	pos += length;
+	return true;
+}
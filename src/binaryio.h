@@ -0,0 +1,54 @@
+// Various authors.
+// License: GPL version 2 or later.
+
+#ifndef BINARYIO_H
+#define BINARYIO_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+/**
+ * Builds the contents of a binary file, such as a cache, in memory.
+ * Values are stored in native byte order: the files are not meant to be
+ * portable between machines.
+ */
+class BinaryWriter {
+public:
+	void writeU8(uint8_t value);
+	void writeU32(uint32_t value);
+	void writeU64(uint64_t value);
+	/** Writes the length of the string followed by its bytes. */
+	void writeString(std::string const& value);
+	void writeBytes(const void *bytes, size_t length);
+
+	std::string const& data() const { return buffer; }
+
+private:
+	std::string buffer;
+};
+
+/**
+ * Reads values written by BinaryWriter.
+ * Every read method returns false if the data ends before the value does;
+ * after that, all further reads fail as well.
+ */
+class BinaryReader {
+public:
+	BinaryReader(std::string const& data);
+
+	bool readU8(uint8_t& value);
+	bool readU32(uint32_t& value);
+	bool readU64(uint64_t& value);
+	bool readString(std::string& value);
+	bool readBytes(void *bytes, size_t length);
+
+	/** Returns true iff all data has been read. */
+	bool atEnd() const { return pos == data.size(); }
+
+private:
+	std::string const& data;
+	size_t pos;
+};
+
+#endif // BINARYIO_H
@@ -0,0 +1,204 @@
+// Various authors.
+// License: GPL version 2 or later.
+
+#include "blend.h"
+
+#include "debug.h"
+
+#if defined(__GNUC__) && (defined(__i386__) || defined(__x86_64__))
+#define BLEND_SSE2
+#include <emmintrin.h>
+#endif
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define BLEND_NEON
+#include <arm_neon.h>
+#if defined(__arm__) && defined(__linux__)
+#include <sys/auxv.h>
+#include <asm/hwcap.h>
+#endif
+#endif
+
+
+static inline uint16_t mult565(uint16_t c, uint8_t a) {
+	return (((c & 0xF800) * a >> 8) & 0xF800)
+	     | (((c & 0x07E0) * a >> 8) & 0x07E0)
+	     | (((c & 0x001F) * a >> 8) & 0x001F);
+}
+
+void blendFill565Scalar(
+		uint16_t *pixels, int count, uint16_t fill, uint8_t alpha)
+{
+	for (int x = 0; x < count; x++) {
+		pixels[x] = mult565(pixels[x], alpha) + fill;
+	}
+}
+
+void blendFill8888Scalar(
+		uint32_t *pixels, int count, uint32_t fill, uint8_t alpha)
+{
+	for (int x = 0; x < count; x++) {
+		pixels[x] = mult8x4(pixels[x], alpha) + fill;
+	}
+}
+
+/*
+ * The vector kernels multiply every component by the alpha in a 16-bit lane
+ * and keep the upper 8 bits, which is what the scalar kernels do as well.
+ * The sum with the fill color never carries into the next component, so it
+ * doesn't matter whether it is done per component or per pixel.
+ */
+
+#ifdef BLEND_SSE2
+
+__attribute__((target("sse2")))
+static void blendFill565SSE2(
+		uint16_t *pixels, int count, uint16_t fill, uint8_t alpha)
+{
+	const __m128i a = _mm_set1_epi16(alpha);
+	const __m128i f = _mm_set1_epi16(fill);
+	const __m128i mask5 = _mm_set1_epi16(0x1F);
+	const __m128i mask6 = _mm_set1_epi16(0x3F);
+
+	int x = 0;
+	for (; x + 8 <= count; x += 8) {
+		__m128i *p = reinterpret_cast<__m128i *>(pixels + x);
+		const __m128i c = _mm_loadu_si128(p);
+		__m128i r = _mm_srli_epi16(c, 11);
+		__m128i g = _mm_and_si128(_mm_srli_epi16(c, 5), mask6);
+		__m128i b = _mm_and_si128(c, mask5);
+		r = _mm_srli_epi16(_mm_mullo_epi16(r, a), 8);
+		g = _mm_srli_epi16(_mm_mullo_epi16(g, a), 8);
+		b = _mm_srli_epi16(_mm_mullo_epi16(b, a), 8);
+		const __m128i out = _mm_or_si128(
+				_mm_or_si128(_mm_slli_epi16(r, 11), _mm_slli_epi16(g, 5)), b);
+		_mm_storeu_si128(p, _mm_add_epi16(out, f));
+	}
+	blendFill565Scalar(pixels + x, count - x, fill, alpha);
+}
+
+__attribute__((target("sse2")))
+static void blendFill8888SSE2(
+		uint32_t *pixels, int count, uint32_t fill, uint8_t alpha)
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i a = _mm_set1_epi16(alpha);
+	const __m128i f = _mm_set1_epi32(fill);
+
+	int x = 0;
+	for (; x + 4 <= count; x += 4) {
+		__m128i *p = reinterpret_cast<__m128i *>(pixels + x);
+		const __m128i c = _mm_loadu_si128(p);
+		__m128i lo = _mm_unpacklo_epi8(c, zero);
+		__m128i hi = _mm_unpackhi_epi8(c, zero);
+		lo = _mm_srli_epi16(_mm_mullo_epi16(lo, a), 8);
+		hi = _mm_srli_epi16(_mm_mullo_epi16(hi, a), 8);
+		_mm_storeu_si128(p, _mm_add_epi32(_mm_packus_epi16(lo, hi), f));
+	}
+	blendFill8888Scalar(pixels + x, count - x, fill, alpha);
+}
+
+static bool haveSSE2()
+{
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("sse2");
+}
+
+#endif /* BLEND_SSE2 */
+
+#ifdef BLEND_NEON
+
+static void blendFill565NEON(
+		uint16_t *pixels, int count, uint16_t fill, uint8_t alpha)
+{
+	const uint16x8_t a = vdupq_n_u16(alpha);
+	const uint16x8_t f = vdupq_n_u16(fill);
+	const uint16x8_t mask5 = vdupq_n_u16(0x1F);
+	const uint16x8_t mask6 = vdupq_n_u16(0x3F);
+
+	int x = 0;
+	for (; x + 8 <= count; x += 8) {
+		const uint16x8_t c = vld1q_u16(pixels + x);
+		uint16x8_t r = vshrq_n_u16(c, 11);
+		uint16x8_t g = vandq_u16(vshrq_n_u16(c, 5), mask6);
+		uint16x8_t b = vandq_u16(c, mask5);
+		r = vshrq_n_u16(vmulq_u16(r, a), 8);
+		g = vshrq_n_u16(vmulq_u16(g, a), 8);
+		b = vshrq_n_u16(vmulq_u16(b, a), 8);
+		const uint16x8_t out = vorrq_u16(
+				vorrq_u16(vshlq_n_u16(r, 11), vshlq_n_u16(g, 5)), b);
+		vst1q_u16(pixels + x, vaddq_u16(out, f));
+	}
+	blendFill565Scalar(pixels + x, count - x, fill, alpha);
+}
+
+static void blendFill8888NEON(
+		uint32_t *pixels, int count, uint32_t fill, uint8_t alpha)
+{
+	const uint8x8_t a = vdup_n_u8(alpha);
+	const uint32x4_t f = vdupq_n_u32(fill);
+
+	int x = 0;
+	for (; x + 4 <= count; x += 4) {
+		const uint8x16_t c = vreinterpretq_u8_u32(vld1q_u32(pixels + x));
+		const uint16x8_t lo = vmull_u8(vget_low_u8(c), a);
+		const uint16x8_t hi = vmull_u8(vget_high_u8(c), a);
+		const uint8x16_t out = vcombine_u8(
+				vshrn_n_u16(lo, 8), vshrn_n_u16(hi, 8));
+		vst1q_u32(pixels + x, vaddq_u32(vreinterpretq_u32_u8(out), f));
+	}
+	blendFill8888Scalar(pixels + x, count - x, fill, alpha);
+}
+
+static bool haveNEON()
+{
+#if defined(__arm__) && defined(__linux__)
+	// NEON is optional on 32-bit ARM, even if the compiler was told to
+	// use it.
+	return (getauxval(AT_HWCAP) & HWCAP_NEON) != 0;
+#else
+	return true;
+#endif
+}
+
+#endif /* BLEND_NEON */
+
+BlendFill16 blendFill565()
+{
+	static BlendFill16 kernel = nullptr;
+	if (!kernel) {
+		kernel = blendFill565Scalar;
+#ifdef BLEND_SSE2
+		if (haveSSE2()) {
+			DEBUG("Using SSE2 blend kernels\n");
+			kernel = blendFill565SSE2;
+		}
+#endif
+#ifdef BLEND_NEON
+		if (haveNEON()) {
+			DEBUG("Using NEON blend kernels\n");
+			kernel = blendFill565NEON;
+		}
+#endif
+	}
+	return kernel;
+}
+
+BlendFill32 blendFill8888()
+{
+	static BlendFill32 kernel = nullptr;
+	if (!kernel) {
+		kernel = blendFill8888Scalar;
+#ifdef BLEND_SSE2
+		if (haveSSE2()) {
+			kernel = blendFill8888SSE2;
+		}
+#endif
+#ifdef BLEND_NEON
+		if (haveNEON()) {
+			kernel = blendFill8888NEON;
+		}
+#endif
+	}
+	return kernel;
+}
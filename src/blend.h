@@ -0,0 +1,49 @@
+// Various authors.
+// License: GPL version 2 or later.
+
+#ifndef BLEND_H
+#define BLEND_H
+
+#include <cstdint>
+
+/*
+ * Kernels that blend a fill color over a row of pixels:
+ *   pixel' = pixel * alpha / 256 + fill
+ * where "fill" is the fill color pre-multiplied with its alpha and "alpha"
+ * is 255 minus the alpha of the fill color.
+ * All kernels produce exactly the same result as the scalar ones, which are
+ * kept as the reference implementation.
+ */
+
+/**
+ * Multiplies each of the four 8-bit components of "c" by a / 256.
+ */
+static inline uint32_t mult8x4(uint32_t c, uint8_t a) {
+	return ((((c >> 8) & 0x00FF00FF) * a) & 0xFF00FF00)
+	     | ((((c & 0x00FF00FF) * a) & 0xFF00FF00) >> 8);
+}
+
+/** Blends a row of pixels in the RGB565 format. */
+typedef void (*BlendFill16)(
+		uint16_t *pixels, int count, uint16_t fill, uint8_t alpha);
+
+/** Blends a row of pixels with four 8-bit components, in any order. */
+typedef void (*BlendFill32)(
+		uint32_t *pixels, int count, uint32_t fill, uint8_t alpha);
+
+void blendFill565Scalar(
+		uint16_t *pixels, int count, uint16_t fill, uint8_t alpha);
+void blendFill8888Scalar(
+		uint32_t *pixels, int count, uint32_t fill, uint8_t alpha);
+
+/**
+ * Returns the fastest RGB565 kernel that the CPU we run on supports.
+ */
+BlendFill16 blendFill565();
+
+/**
+ * Returns the fastest 32bpp kernel that the CPU we run on supports.
+ */
+BlendFill32 blendFill8888();
+
+#endif // BLEND_H
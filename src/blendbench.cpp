@@ -0,0 +1,119 @@
+// Various authors.
+// License: GPL version 2 or later.
+
+/*
+ * Checks that the blend kernels picked for this CPU produce the same pixels
+ * as the scalar reference kernels, then times both on fills of various
+ * sizes. Not installed; build it with "make bench".
+ */
+
+#include "blend.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+using namespace std;
+
+/* Every size is filled this many times per measurement. */
+static const int FILLS_PER_PIXEL_MILLION = 200;
+
+struct Rect {
+	int w, h;
+};
+
+static const Rect sizes[] = {
+	{ 8, 8 }, { 16, 16 }, { 32, 32 }, { 100, 20 }, { 311, 20 }, { 320, 240 },
+};
+
+static uint16_t premultiply565(uint16_t c, uint8_t a)
+{
+	return (((c & 0xF800) * a >> 8) & 0xF800)
+	     | (((c & 0x07E0) * a >> 8) & 0x07E0)
+	     | (((c & 0x001F) * a >> 8) & 0x001F);
+}
+
+template <typename Pixel>
+static void randomize(vector<Pixel>& pixels)
+{
+	for (Pixel& pixel : pixels) {
+		pixel = Pixel(rand()) ^ Pixel(uint32_t(rand()) << 16);
+	}
+}
+
+/* Returns the number of lengths for which the kernels disagree. */
+template <typename Pixel, typename Kernel, typename Premultiply>
+static int check(const char *name, Kernel reference, Kernel kernel,
+		Premultiply premultiply)
+{
+	int mismatches = 0;
+	for (int alpha = 0; alpha < 256; alpha += 3) {
+		// Lengths around the vector widths, to cover the scalar tails.
+		for (int count = 0; count <= 67; count++) {
+			vector<Pixel> expected(count);
+			randomize(expected);
+			vector<Pixel> actual(expected);
+			const Pixel fill = premultiply(Pixel(rand()), alpha);
+
+			reference(expected.data(), count, fill, 255 - alpha);
+			kernel(actual.data(), count, fill, 255 - alpha);
+			if (expected != actual) {
+				printf("%s: mismatch for %d pixels at alpha %d\n",
+						name, count, alpha);
+				mismatches++;
+			}
+		}
+	}
+	return mismatches;
+}
+
+/* Returns the time per fill in nanoseconds. */
+template <typename Pixel, typename Kernel>
+static double timeFill(Kernel kernel, Rect const& rect)
+{
+	vector<Pixel> pixels(rect.w * rect.h);
+	randomize(pixels);
+	const int fills = max(1,
+			FILLS_PER_PIXEL_MILLION * 1000000 / (rect.w * rect.h));
+
+	typedef chrono::steady_clock Clock;
+	const Clock::time_point start = Clock::now();
+	for (int i = 0; i < fills; i++) {
+		for (int y = 0; y < rect.h; y++) {
+			kernel(&pixels[y * rect.w], rect.w, Pixel(0x1234), 0x80);
+		}
+	}
+	const chrono::duration<double, nano> elapsed = Clock::now() - start;
+	return elapsed.count() / fills;
+}
+
+template <typename Pixel, typename Kernel>
+static void bench(const char *name, Kernel reference, Kernel kernel)
+{
+	printf("\n%s%s\n%10s %12s %12s %8s\n", name,
+			kernel == reference ? " (no vector kernel for this CPU)" : "",
+			"size", "scalar ns", "kernel ns", "speedup");
+	for (Rect const& rect : sizes) {
+		const double scalar = timeFill<Pixel>(reference, rect);
+		const double fast = timeFill<Pixel>(kernel, rect);
+		printf("%5dx%-4d %12.0f %12.0f %7.2fx\n",
+				rect.w, rect.h, scalar, fast, scalar / fast);
+	}
+}
+
+int main()
+{
+	int mismatches = 0;
+	mismatches += check<uint16_t>("RGB565",
+			blendFill565Scalar, blendFill565(), premultiply565);
+	mismatches += check<uint32_t>("32bpp",
+			blendFill8888Scalar, blendFill8888(), mult8x4);
+	printf("%s\n", mismatches ? "Kernels do NOT match the reference"
+			: "Kernels match the reference");
+
+	bench<uint16_t>("RGB565", blendFill565Scalar, blendFill565());
+	bench<uint32_t>("32bpp", blendFill8888Scalar, blendFill8888());
+
+	return mismatches ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -42,6 +42,8 @@ BrowseDialog::BrowseDialog(
 	iconGoUp = gmenu2x.sc.skinRes("imgs/go-up.png");
 	iconFolder = gmenu2x.sc.skinRes("imgs/folder.png");
 	iconFile = gmenu2x.sc.skinRes("imgs/file.png");
+
+	fl.setCache(&gmenu2x.listings);
 }
 
 BrowseDialog::~BrowseDialog()
@@ -55,7 +57,7 @@ bool BrowseDialog::exec()
 		|| path.compare(0, strlen(CARD_ROOT), CARD_ROOT) != 0)
 		setPath(CARD_ROOT);
 
-	const int topBarHeight = gmenu2x.skinConfInt["topBarHeight"];
+	const int topBarHeight = gmenu2x.getSkinLayout().topBarHeight;
 	rowHeight = gmenu2x.font->getLineSpacing() + 1; // gp2x=15+1 / pandora=19+1
 	rowHeight = constrain(rowHeight, 20, 40);
 	numRows = (gmenu2x.resY - topBarHeight - 20) / rowHeight;
@@ -107,6 +109,21 @@ void BrowseDialog::handleInput()
 	InputManager::Button button = gmenu2x.input.waitForPressedButton();
 	BrowseDialog::Action action = getAction(button);
 
+	// Nothing to move to or pick while the directory is still being listed.
+	if (fl.size() == 0) {
+		switch (action) {
+		case BrowseDialog::ACT_SELECT:
+		case BrowseDialog::ACT_UP:
+		case BrowseDialog::ACT_DOWN:
+		case BrowseDialog::ACT_SCROLLUP:
+		case BrowseDialog::ACT_SCROLLDOWN:
+			action = BrowseDialog::ACT_NONE;
+			break;
+		default:
+			break;
+		}
+	}
+
 	if (action == BrowseDialog::ACT_SELECT && fl[selected] == "..") {
 		action = BrowseDialog::ACT_GOUP;
 	}
@@ -204,6 +221,10 @@ void BrowseDialog::paint()
 	unsigned int firstElement, lastElement;
 	unsigned int offsetY;
 
+	// Show what has been listed so far; the scan sends a repaint event when
+	// it finds more.
+	fl.update(selected);
+
 	OffscreenSurface bg(*gmenu2x.bg);
 	drawTitleIcon(bg, "icons/explorer.png", true);
 	writeTitle(bg, title);
@@ -213,6 +234,8 @@ void BrowseDialog::paint()
 	bg.convertToDisplayFormat();
 	bg.blit(s, 0, 0);
 
+	beforeFileList();
+
 	// TODO(MtH): I have no idea what the right value of firstElement would be,
 	//            but originally it was undefined and that is never a good idea.
 	firstElement = 0;
@@ -223,7 +246,7 @@ void BrowseDialog::paint()
 	}
 
 	//Selection
-	const int topBarHeight = gmenu2x.skinConfInt["topBarHeight"];
+	const int topBarHeight = gmenu2x.getSkinLayout().topBarHeight;
 	iY = topBarHeight + 1 + (selected - firstElement) * rowHeight;
 	s.box(2, iY, gmenu2x.resX - 12, rowHeight - 1,
 			gmenu2x.skinConfColors[COLOR_SELECTION_BG]);
@@ -237,15 +260,15 @@ void BrowseDialog::paint()
 	//Files & Directories
 	s.setClipRect(clipRect);
 	for (i = firstElement; i < lastElement; i++) {
-		Surface *icon;
+		OffscreenSurface *icon;
 		if (fl.isDirectory(i)) {
 			if (fl[i] == "..") {
-				icon = iconGoUp;
+				icon = iconGoUp.get();
 			} else {
-				icon = iconFolder;
+				icon = iconFolder.get();
 			}
 		} else {
-			icon = iconFile;
+			icon = iconFile.get();
 		}
 		icon->blit(s, 5, offsetY);
 		gmenu2x.font->write(s, fl[i], 24, offsetY + rowHeight / 2,
@@ -255,6 +278,6 @@ void BrowseDialog::paint()
 	}
 	s.clearClipRect();
 
-	gmenu2x.drawScrollBar(numRows,fl.size(), firstElement);
+	gmenu2x.drawScrollBar(s, numRows,fl.size(), firstElement);
 	s.flip();
 }
@@ -27,6 +27,7 @@
 #include "inputmanager.h"
 
 #include <SDL.h>
+#include <memory>
 #include <string>
 
 class OffscreenSurface;
@@ -37,11 +38,15 @@ protected:
 			const std::string &title, const std::string &subtitle);
 	virtual ~BrowseDialog();
 
+	/** Changes the directory; its entries are listed in the background. */
 	void setPath(const std::string &path) {
 		this->path = path;
-		fl.browse(path);
+		fl.browseAsync(path);
 	}
 
+	/** Called on every repaint, after the background has been drawn. */
+	virtual void beforeFileList() {}
+
 	FileLister fl;
 	unsigned int selected;
 
@@ -69,9 +74,9 @@ private:
 	unsigned int numRows;
 	unsigned int rowHeight;
 
-	OffscreenSurface *iconGoUp;
-	OffscreenSurface *iconFolder;
-	OffscreenSurface *iconFile;
+	std::shared_ptr<OffscreenSurface> iconGoUp;
+	std::shared_ptr<OffscreenSurface> iconFolder;
+	std::shared_ptr<OffscreenSurface> iconFile;
 
 	ButtonBox buttonBox;
 
@@ -101,16 +101,20 @@ bool ContextMenu::runAnimations()
 	if (fadeAlpha < 200) {
 		const long tickNow = SDL_GetTicks();
 		fadeAlpha = intTransition(0, 200, tickStart, 500, tickNow);
+		invalidateBackdrop();
 	}
 	return fadeAlpha < 200;
 }
 
-void ContextMenu::paint(Surface &s)
+void ContextMenu::paintBackdrop(Surface &s)
 {
-	Font& font = *gmenu2x.font;
-
 	// Darken background.
 	s.box(0, 0, gmenu2x.resX, gmenu2x.resY, 0, 0, 0, fadeAlpha);
+}
+
+void ContextMenu::paint(Surface &s)
+{
+	Font& font = *gmenu2x.font;
 
 	// Draw popup box.
 	s.box(box, gmenu2x.skinConfColors[COLOR_MESSAGE_BOX_BG]);
@@ -142,10 +146,12 @@ bool ContextMenu::handleButtonPress(InputManager::Button button) {
 		case InputManager::UP:
 			selected--;
 			if (selected < 0) selected = options.size() - 1;
+			invalidate(box);
 			break;
 		case InputManager::DOWN:
 			selected++;
 			if (selected >= static_cast<int>(options.size())) selected = 0;
+			invalidate(box);
 			break;
 		case InputManager::ACCEPT:
 			options[selected]->action();
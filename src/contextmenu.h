@@ -24,6 +24,9 @@ public:
 	virtual bool runAnimations();
 	virtual void paint(Surface &s);
 	virtual bool handleButtonPress(InputManager::Button button);
+	virtual bool isModal() { return true; }
+	virtual void paintBackdrop(Surface &s);
+	virtual Profiler::Phase getPaintPhase() { return Profiler::PAINT_POPUP; }
 
 private:
 	struct MenuOption;
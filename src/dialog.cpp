@@ -10,7 +10,7 @@ Dialog::Dialog(GMenu2X& gmenu2x) : gmenu2x(gmenu2x)
 
 void Dialog::drawTitleIcon(Surface& s, const std::string &icon, bool skinRes)
 {
-	Surface *i = NULL;
+	std::shared_ptr<OffscreenSurface> i;
 	if (!icon.empty()) {
 		if (skinRes)
 			i = gmenu2x.sc.skinRes(icon);
@@ -18,10 +18,10 @@ void Dialog::drawTitleIcon(Surface& s, const std::string &icon, bool skinRes)
 			i = gmenu2x.sc[icon];
 	}
 
-	if (i==NULL)
+	if (!i)
 		i = gmenu2x.sc.skinRes("icons/generic.png");
 
-	i->blit(s, 4, (gmenu2x.skinConfInt["topBarHeight"] - 32) / 2);
+	i->blit(s, 4, (gmenu2x.getSkinLayout().topBarHeight - 32) / 2);
 }
 
 void Dialog::writeTitle(Surface& s, const std::string &title)
@@ -33,7 +33,7 @@ void Dialog::writeSubTitle(Surface& s, const std::string &subtitle)
 {
 	std::string wrapped = gmenu2x.font->wordWrap(subtitle, gmenu2x.resX - 48);
 	gmenu2x.font->write(s, wrapped, 40,
-			gmenu2x.skinConfInt["topBarHeight"]
+			gmenu2x.getSkinLayout().topBarHeight
 				- gmenu2x.font->getTextHeight(wrapped),
 			Font::HAlignLeft, Font::VAlignTop);
 }
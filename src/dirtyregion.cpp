@@ -0,0 +1,102 @@
+// Various authors.
+// License: GPL version 2 or later.
+
+#include "dirtyregion.h"
+
+#include <algorithm>
+
+using namespace std;
+
+/*
+ * If more rectangles than this are dirty, they are replaced by their bounding
+ * box: painting every layer once per rectangle gets more expensive than
+ * painting a few extra pixels.
+ */
+static const size_t MAX_RECTS = 8;
+
+static inline int area(SDL_Rect const& r)
+{
+	return r.w * r.h;
+}
+
+static SDL_Rect unite(SDL_Rect const& a, SDL_Rect const& b)
+{
+	const int x1 = min(a.x, b.x);
+	const int y1 = min(a.y, b.y);
+	const int x2 = max(a.x + a.w, b.x + b.w);
+	const int y2 = max(a.y + a.h, b.y + b.h);
+	return SDL_Rect {
+		static_cast<Sint16>(x1), static_cast<Sint16>(y1),
+		static_cast<Uint16>(x2 - x1), static_cast<Uint16>(y2 - y1)
+	};
+}
+
+static bool touches(SDL_Rect const& a, SDL_Rect const& b)
+{
+	return a.x <= b.x + b.w && b.x <= a.x + a.w
+		&& a.y <= b.y + b.h && b.y <= a.y + a.h;
+}
+
+void DirtyRegion::add(SDL_Rect rect)
+{
+	if (full || rect.w == 0 || rect.h == 0) {
+		return;
+	}
+
+	// Merge with every rectangle that overlaps or that is close enough that
+	// the bounding box costs no more than painting both separately.
+	for (auto it = rects.begin(); it != rects.end(); ) {
+		SDL_Rect merged = unite(*it, rect);
+		if (touches(*it, rect) || area(merged) <= area(*it) + area(rect)) {
+			rect = merged;
+			rects.erase(it);
+			it = rects.begin();
+		} else {
+			++it;
+		}
+	}
+
+	if (rects.size() == MAX_RECTS) {
+		for (auto& r : rects) {
+			rect = unite(r, rect);
+		}
+		rects.clear();
+	}
+	rects.push_back(rect);
+}
+
+void DirtyRegion::add(DirtyRegion const& other)
+{
+	if (other.full) {
+		addAll();
+	} else {
+		for (auto& rect : other.rects) {
+			add(rect);
+		}
+	}
+}
+
+vector<SDL_Rect> DirtyRegion::getRects(int width, int height) const
+{
+	vector<SDL_Rect> clipped;
+	if (full) {
+		clipped.push_back(SDL_Rect {
+			0, 0, static_cast<Uint16>(width), static_cast<Uint16>(height)
+		});
+		return clipped;
+	}
+
+	for (auto& r : rects) {
+		const int x1 = max<int>(r.x, 0);
+		const int y1 = max<int>(r.y, 0);
+		const int x2 = min(r.x + r.w, width);
+		const int y2 = min(r.y + r.h, height);
+		if (x1 < x2 && y1 < y2) {
+			clipped.push_back(SDL_Rect {
+				static_cast<Sint16>(x1), static_cast<Sint16>(y1),
+				static_cast<Uint16>(x2 - x1), static_cast<Uint16>(y2 - y1)
+			});
+		}
+	}
+	return clipped;
+}
@@ -0,0 +1,58 @@
+// Various authors.
+// License: GPL version 2 or later.
+
+#ifndef DIRTYREGION_H
+#define DIRTYREGION_H
+
+#include <SDL.h>
+
+#include <vector>
+
+/**
+ * The part of the screen that has to be repainted, as a small set of
+ * rectangles.
+ * Overlapping and adjacent rectangles are merged as they are added, so
+ * painting the region does not touch the same pixel twice.
+ */
+class DirtyRegion {
+public:
+	DirtyRegion() : full(false) {}
+
+	/**
+	 * Adds the given rectangle to the region.
+	 */
+	void add(SDL_Rect rect);
+
+	/**
+	 * Adds all the rectangles of another region to this region.
+	 */
+	void add(DirtyRegion const& other);
+
+	/**
+	 * Marks the entire screen as dirty.
+	 */
+	void addAll() {
+		full = true;
+		rects.clear();
+	}
+
+	void clear() {
+		full = false;
+		rects.clear();
+	}
+
+	bool isEmpty() const { return !full && rects.empty(); }
+	bool isFull() const { return full; }
+
+	/**
+	 * Returns the rectangles of this region, clipped to a screen of the
+	 * given size.
+	 */
+	std::vector<SDL_Rect> getRects(int width, int height) const;
+
+private:
+	bool full;
+	std::vector<SDL_Rect> rects;
+};
+
+#endif // DIRTYREGION_H
@@ -42,7 +42,7 @@ FileDialog::FileDialog(
 
 bool FileDialog::exec() {
 	bool ret = BrowseDialog::exec();
-	if (ret && fl.isDirectory(selected)) {
+	if (ret && (selected >= fl.size() || fl.isDirectory(selected))) {
 		// FileDialog must only pick regular files.
 		ret = false;
 	}
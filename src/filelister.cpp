@@ -21,92 +21,287 @@
 #include "filelister.h"
 
 #include "debug.h"
+#include "listingcache.h"
 #include "utilities.h"
 
 //for browsing the filesystem
 #include <sys/stat.h>
+#include <sys/syscall.h>
 #include <sys/types.h>
 #include <dirent.h>
 #include <errno.h>
-#include <iostream>
+#include <fcntl.h>
+#include <unistd.h>
 #include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
 #include <cstring>
-#include <set>
+#include <ctime>
+#include <functional>
+#include <mutex>
+#include <thread>
 
 using namespace std;
 
+/* Size of the buffer that directory entries are read into, in bytes.
+ * A single read then fetches hundreds of entries. */
+#define DIRENT_BUFFER_SIZE (64 * 1024)
+
+/* Minimum time between two chunks of a background scan, in milliseconds.
+ * The first chunk is handed out as soon as it has been read. */
+#define SCAN_CHUNK_INTERVAL 100
+
+/**
+ * A directory entry as returned by the getdents64 system call.
+ */
+struct KernelDirent {
+	uint64_t d_ino;
+	int64_t d_off;
+	unsigned short d_reclen;
+	unsigned char d_type;
+	char d_name[1];
+};
+
+static inline char foldCase(char c)
+{
+	// Note: Like strcasecmp, this only folds ASCII letters; multi-byte UTF-8
+	//       characters are compared byte by byte.
+	return c >= 'A' && c <= 'Z' ? c - 'A' + 'a' : c;
+}
+
+/** Orders names like NameList does. */
+static bool foldedLess(string const& a, string const& b)
+{
+	const size_t length = min(a.size(), b.size());
+	for (size_t i = 0; i < length; i++) {
+		const unsigned char ca = foldCase(a[i]), cb = foldCase(b[i]);
+		if (ca != cb) {
+			return ca < cb;
+		}
+	}
+	return a.size() < b.size();
+}
+
+/**
+ * Returns the position of the name in the sorted vector. Names that only
+ * differ in case are next to each other, so those are searched for an
+ * exact match; the position of the first one is returned if there is none.
+ */
+static vector<string>::const_iterator findName(
+		vector<string> const& names, string const& name)
+{
+	auto first = lower_bound(names.begin(), names.end(), name, foldedLess);
+	for (auto it = first;
+			it != names.end() && !foldedLess(name, *it); ++it) {
+		if (*it == name) {
+			return it;
+		}
+	}
+	return first;
+}
+
+/**
+ * Merges sorted names into a sorted vector. Of names that only differ in
+ * case, the one that was already in the vector is kept.
+ */
+static void mergeNames(vector<string>& into, vector<string>&& names)
+{
+	vector<string> merged;
+	merged.reserve(into.size() + names.size());
+	auto a = into.begin(), b = names.begin();
+	while (a != into.end() && b != names.end()) {
+		if (foldedLess(*b, *a)) {
+			merged.push_back(move(*b++));
+		} else {
+			if (!foldedLess(*a, *b)) {
+				++b;
+			}
+			merged.push_back(move(*a++));
+		}
+	}
+	move(a, into.end(), back_inserter(merged));
+	move(b, names.end(), back_inserter(merged));
+	into.swap(merged);
+}
+
+/**
+ * Collects names and sorts them case insensitively. Each name is case
+ * folded once when it is added, so sorting only compares bytes.
+ */
+class FileLister::NameList {
+public:
+	void add(string&& name)
+	{
+		const uint32_t offset = keys.size();
+		for (char c : name) {
+			keys.push_back(foldCase(c));
+		}
+		order.push_back({ offset, uint32_t(name.size()), uint32_t(names.size()) });
+		names.push_back(move(name));
+	}
+
+	bool empty() const { return names.empty(); }
+
+	/**
+	 * Replaces the contents of the given vector by the sorted names and
+	 * empties this list.
+	 * Of names that only differ in case, the one added first is kept.
+	 */
+	void moveSortedTo(vector<string>& to)
+	{
+		char const *folded = keys.data();
+		auto less = [folded](SortKey const& a, SortKey const& b) {
+			const int cmp = memcmp(folded + a.offset, folded + b.offset,
+					min(a.length, b.length));
+			return cmp ? cmp < 0 : a.length < b.length;
+		};
+		auto equal = [folded](SortKey const& a, SortKey const& b) {
+			return a.length == b.length && memcmp(folded + a.offset,
+					folded + b.offset, a.length) == 0;
+		};
+		stable_sort(order.begin(), order.end(), less);
+		order.erase(unique(order.begin(), order.end(), equal), order.end());
+
+		to.clear();
+		to.reserve(order.size());
+		for (SortKey const& key : order) {
+			to.push_back(move(names[key.index]));
+		}
+
+		names.clear();
+		keys.clear();
+		order.clear();
+	}
+
+private:
+	struct SortKey {
+		uint32_t offset, length, index;
+	};
+
+	vector<string> names;
+	/** The case folded names, back to back. */
+	string keys;
+	vector<SortKey> order;
+};
+
+/**
+ * The state shared between a background scan and the UI thread.
+ */
+struct FileLister::Scan {
+	Scan(int fd, string const& slashedPath)
+		: fd(fd), slashedPath(slashedPath), done(false), failed(false)
+		, cancel(false) {}
+
+	const int fd;
+	const string slashedPath;
+	/** For the listing cache: when and in which state the scan started. */
+	time_t started;
+	struct stat st;
+	unique_ptr<ListingCache::Watch> watch;
+
+	mutex chunkMutex;
+	/** Sorted chunks of names that update() has not picked up yet. */
+	vector<vector<string>> directoryChunks, fileChunks;
+	/** Set when the last chunk has been queued. */
+	bool done;
+	/** Set along with done if the scan ended on a read error. */
+	bool failed;
+
+	atomic<bool> cancel;
+	thread worker;
+};
+
 FileLister::FileLister()
 	: showDirectories(true)
 	, showUpdir(true)
 	, showFiles(true)
+	, cache(nullptr)
+{
+}
+
+FileLister::~FileLister()
 {
+	stopScan();
 }
 
 void FileLister::setFilter(const string &filter)
 {
+	this->filter.clear();
 	if (filter.empty() || filter == "*") {
-		this->filter.clear();
-	} else {
-		split(this->filter, filter, ",");
+		return;
 	}
-}
 
-static void moveNames(set<string, case_less>&& from, vector<string>& to)
-{
-	to.reserve(from.size());
-	for (string const& name : from) {
-		// Casting away the const is necessary to make the move work.
-		// It will leave the set in an invalid state where it contains multiple
-		// empty strings, but since the set is an rvalue we don't care.
-		to.emplace_back(move(const_cast<string&>(name)));
+	vector<string> extensions;
+	split(extensions, filter, ",");
+	for (string& ext : extensions) {
+		// Accept both "txt" and ".txt".
+		if (!ext.empty() && ext[0] == '.') {
+			ext.erase(0, 1);
+		}
+		transform(ext.begin(), ext.end(), ext.begin(), foldCase);
+		this->filter.insert(move(ext));
 	}
-	to.shrink_to_fit();
 }
 
-bool FileLister::browse(const string& path, bool clean)
+static int openDirectory(string const& slashedPath)
 {
-	if (clean) {
-		directories.clear();
-		files.clear();
+	int fd = open(slashedPath.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if (fd < 0 && errno != ENOENT) {
+		ERROR("Unable to open directory: %s\n", slashedPath.c_str());
 	}
+	return fd;
+}
 
+static string withSlash(string const& path)
+{
 	string slashedPath = path;
 	if (!path.empty() && path[path.length() - 1] != '/') {
 		slashedPath.push_back('/');
 	}
+	return slashedPath;
+}
 
-	DIR *dirp;
-	if ((dirp = opendir(slashedPath.c_str())) == NULL) {
-		if (errno != ENOENT) {
-			ERROR("Unable to open directory: %s\n", slashedPath.c_str());
-		}
-		return false;
+int FileLister::readEntries(int fd, const string& slashedPath,
+		vector<char>& buffer, NameList& directoryList, NameList& fileList)
+{
+	long length;
+	do {
+		length = syscall(SYS_getdents64, fd, &buffer[0], buffer.size());
+	} while (length < 0 && errno == EINTR);
+	if (length < 0) {
+		ERROR("Unable to read directory '%s': %s\n",
+				slashedPath.c_str(), strerror(errno));
+		return -1;
+	}
+	if (length == 0) {
+		return 0;
 	}
 
-	set<string, case_less> directorySet;
-	set<string, case_less> fileSet;
+	const bool keepUpdir = showUpdir && slashedPath != "/";
+	string ext;
+	for (long pos = 0; pos < length; ) {
+		KernelDirent const *dent =
+				reinterpret_cast<KernelDirent const *>(&buffer[pos]);
+		pos += dent->d_reclen;
+		const char *name = dent->d_name;
 
-	while (struct dirent *dptr = readdir(dirp)) {
 		// Ignore hidden files and optionally "..".
-		if (dptr->d_name[0] == '.') {
-			if (!(dptr->d_name[1] == '.' && showUpdir && slashedPath != "/")) {
+		if (name[0] == '.') {
+			if (!(keepUpdir && strcmp(name, "..") == 0)) {
 				continue;
 			}
 		}
 
 		bool isDir, isFile;
-#ifdef _DIRENT_HAVE_D_TYPE
-		if (dptr->d_type != DT_UNKNOWN && dptr->d_type != DT_LNK) {
-			isDir = dptr->d_type == DT_DIR;
-			isFile = dptr->d_type == DT_REG;
-		} else
-#endif
-		{
-			string filepath = slashedPath + dptr->d_name;
+		if (dent->d_type != DT_UNKNOWN && dent->d_type != DT_LNK) {
+			isDir = dent->d_type == DT_DIR;
+			isFile = dent->d_type == DT_REG;
+		} else {
 			struct stat st;
-			int statRet = stat(filepath.c_str(), &st);
-			if (statRet == -1) {
-				ERROR("Stat failed on '%s' with error '%s'\n", filepath.c_str(), strerror(errno));
+			if (fstatat(fd, name, &st, 0) == -1) {
+				ERROR("Stat failed on '%s%s' with error '%s'\n",
+						slashedPath.c_str(), name, strerror(errno));
 				continue;
 			}
 			isDir = S_ISDIR(st.st_mode);
@@ -114,56 +309,238 @@ bool FileLister::browse(const string& path, bool clean)
 		}
 
 		if (isDir) {
-			if (!showDirectories)
-				continue;
-
-			directorySet.insert(string(dptr->d_name));
-		} else if (isFile) {
-			if (!showFiles)
-				continue;
-
-			if (filter.empty()) {
-				fileSet.insert(string(dptr->d_name));
-				continue;
+			if (showDirectories) {
+				directoryList.add(name);
 			}
-
-			// Determine file extension.
-			const char *ext = strrchr(dptr->d_name, '.');
-			if (ext) ext++; else ext = "";
-
-			for (auto& filterExt : filter) {
-				// Note: strcasecmp can't compare multi-byte UTF-8 characters,
-				//       but the filtered file extensions don't contain any of
-				//       those.
-				if (strcasecmp(ext, filterExt.c_str()) == 0) {
-					fileSet.insert(string(dptr->d_name));
-					break;
+		} else if (isFile && showFiles) {
+			if (!filter.empty()) {
+				const char *dot = strrchr(name, '.');
+				ext.assign(dot ? dot + 1 : "");
+				transform(ext.begin(), ext.end(), ext.begin(), foldCase);
+				if (filter.find(ext) == filter.end()) {
+					continue;
 				}
 			}
+			fileList.add(name);
 		}
 	}
+	return 1;
+}
+
+bool FileLister::browse(const string& path, bool clean)
+{
+	stopScan();
+	if (clean) {
+		directories.clear();
+		files.clear();
+	}
 
-	closedir(dirp);
+	const string slashedPath = withSlash(path);
+	int fd = openDirectory(slashedPath);
+	if (fd < 0) {
+		return false;
+	}
+
+	NameList directoryList, fileList;
+	vector<char> buffer(DIRENT_BUFFER_SIZE);
+	int result;
+	do {
+		result = readEntries(fd, slashedPath, buffer, directoryList, fileList);
+	} while (result > 0);
 
-	if (!directorySet.empty()) {
+	close(fd);
+
+	// Merge with the results of earlier scans; on a tie, the names of this
+	// scan win.
+	if (!directoryList.empty()) {
 		for (string& dir : directories) {
-			directorySet.emplace(move(dir));
+			directoryList.add(move(dir));
 		}
-		directories.clear();
-		moveNames(move(directorySet), directories);
+		directoryList.moveSortedTo(directories);
 	}
 
-	if (!fileSet.empty()) {
+	if (!fileList.empty()) {
 		for (string& file : files) {
-			fileSet.emplace(move(file));
+			fileList.add(move(file));
 		}
-		files.clear();
-		moveNames(move(fileSet), files);
+		fileList.moveSortedTo(files);
+	}
+
+	return result == 0;
+}
+
+bool FileLister::browseAsync(const string& path)
+{
+	stopScan();
+	directories.clear();
+	files.clear();
+
+	const string slashedPath = withSlash(path);
+	int fd = openDirectory(slashedPath);
+	if (fd < 0) {
+		return false;
 	}
 
+	if (cache && cache->lookup(slashedPath, cacheKey(), directories, files)) {
+		close(fd);
+		return true;
+	}
+
+	scan.reset(new Scan(fd, slashedPath));
+	if (cache) {
+		// Started before the time stamp is read, so that no change between
+		// the two goes unnoticed.
+		scan->watch.reset(new ListingCache::Watch(slashedPath));
+	}
+	scan->started = time(nullptr);
+	if (fstat(fd, &scan->st) < 0) {
+		scan->st.st_mtim.tv_sec = scan->st.st_mtim.tv_nsec = 0;
+	}
+	scan->worker = thread(&FileLister::runScan, this, ref(*scan));
 	return true;
 }
 
+void FileLister::runScan(Scan& scan)
+{
+	typedef chrono::steady_clock Clock;
+
+	NameList directoryList, fileList;
+	vector<char> buffer(DIRENT_BUFFER_SIZE);
+	Clock::time_point lastChunk;
+	bool handedOut = false, more = true;
+	while (more && !scan.cancel) {
+		const int result = readEntries(scan.fd, scan.slashedPath, buffer,
+				directoryList, fileList);
+		more = result > 0;
+
+		// Hand out what has been read as soon as the UI can show something
+		// and at the end; in between only every now and then, since every
+		// chunk costs the UI a merge.
+		const Clock::time_point now = Clock::now();
+		if (more) {
+			if (directoryList.empty() && fileList.empty()) {
+				continue;
+			}
+			if (handedOut && now - lastChunk
+					< chrono::milliseconds(SCAN_CHUNK_INTERVAL)) {
+				continue;
+			}
+		}
+		handedOut = true;
+		lastChunk = now;
+
+		vector<string> directories, files;
+		directoryList.moveSortedTo(directories);
+		fileList.moveSortedTo(files);
+		{
+			lock_guard<mutex> lock(scan.chunkMutex);
+			if (!directories.empty()) {
+				scan.directoryChunks.push_back(move(directories));
+			}
+			if (!files.empty()) {
+				scan.fileChunks.push_back(move(files));
+			}
+			scan.done = !more;
+			scan.failed = result < 0;
+		}
+		inject_user_event();
+	}
+}
+
+void FileLister::stopScan()
+{
+	if (scan) {
+		scan->cancel = true;
+		scan->worker.join();
+		close(scan->fd);
+		scan.reset();
+	}
+}
+
+bool FileLister::update(unsigned int& selected)
+{
+	if (!scan) {
+		return false;
+	}
+
+	vector<vector<string>> directoryChunks, fileChunks;
+	bool done;
+	{
+		lock_guard<mutex> lock(scan->chunkMutex);
+		directoryChunks.swap(scan->directoryChunks);
+		fileChunks.swap(scan->fileChunks);
+		done = scan->done;
+	}
+	if (directoryChunks.empty() && fileChunks.empty()) {
+		if (done) {
+			finishScan();
+		}
+		return false;
+	}
+
+	const bool wasSelected = selected < size();
+	const bool wasDirectory = wasSelected && isDirectory(selected);
+	const string name = wasSelected ? (*this)[selected] : string();
+
+	for (auto& chunk : directoryChunks) {
+		mergeNames(directories, move(chunk));
+	}
+	for (auto& chunk : fileChunks) {
+		mergeNames(files, move(chunk));
+	}
+
+	if (wasSelected) {
+		auto& names = wasDirectory ? directories : files;
+		auto it = findName(names, name);
+		selected = (it - names.begin())
+				+ (wasDirectory ? 0 : directories.size());
+	}
+	if (done) {
+		finishScan();
+	}
+	return true;
+}
+
+void FileLister::finishScan()
+{
+	// A listing that ended on a read error is incomplete; don't let it be
+	// served as if it were the whole directory.
+	if (cache && scan->st.st_mtim.tv_sec && !scan->failed) {
+		cache->store(scan->slashedPath, cacheKey(), scan->st.st_mtim,
+				scan->started, move(scan->watch), directories, files);
+	}
+	stopScan();
+}
+
+string FileLister::cacheKey() const
+{
+	vector<string> extensions(filter.begin(), filter.end());
+	sort(extensions.begin(), extensions.end());
+	string key;
+	key += showDirectories ? 'd' : '-';
+	key += showUpdir ? 'u' : '-';
+	key += showFiles ? 'f' : '-';
+	for (string const& ext : extensions) {
+		key += ',';
+		key += ext;
+	}
+	return key;
+}
+
+int FileLister::findDirectory(const string& name)
+{
+	auto it = findName(directories, name);
+	return it != directories.end() && *it == name
+			? it - directories.begin() : -1;
+}
+
+int FileLister::findFile(const string& name)
+{
+	auto it = findName(files, name);
+	return it != files.end() && *it == name
+			? directories.size() + (it - files.begin()) : -1;
+}
+
 string FileLister::operator[](uint x)
 {
 	const auto dirCount = directories.size();
@@ -21,27 +21,92 @@
 #ifndef FILELISTER_H
 #define FILELISTER_H
 
+#include <memory>
 #include <string>
+#include <unordered_set>
 #include <vector>
 
+class ListingCache;
+
 class FileLister {
 private:
-	std::vector<std::string> filter;
+	/** Accepted file extensions in lower case; empty to accept all. */
+	std::unordered_set<std::string> filter;
 	bool showDirectories, showUpdir, showFiles;
 
 	std::vector<std::string> directories, files;
 
+	class NameList;
+	struct Scan;
+	/** The background scan started by browseAsync(), if any. */
+	std::unique_ptr<Scan> scan;
+	ListingCache *cache;
+
+	/**
+	 * Reads one batch of entries from the given directory into the lists.
+	 * Returns 1 if entries were read, 0 at the end of the directory and -1
+	 * if the directory could not be read.
+	 */
+	int readEntries(int fd, const std::string& slashedPath,
+			std::vector<char>& buffer,
+			NameList& directoryList, NameList& fileList);
+	void runScan(Scan& scan);
+	void stopScan();
+	/**
+	 * Stores the results of a completed scan, unless reading the directory
+	 * failed, and cleans up after it.
+	 */
+	void finishScan();
+	/** Describes which entries are listed, for the listing cache. */
+	std::string cacheKey() const;
+
 public:
 	FileLister();
+	~FileLister();
 
 	/**
 	 * Scans the given directory.
 	 * @param clean If true, start a new result set, if false add to the
 	 *   results from the previous scan.
-	 * @return True iff the given directory could be opened.
+	 * @return True iff the given directory could be opened and read; if it
+	 *   could be opened, the entries read before an error are kept.
 	 */
 	bool browse(const std::string& path, bool clean = true);
 
+	/**
+	 * Starts scanning the given directory on a background thread, dropping
+	 * the previous results. The entries become visible in sorted order,
+	 * a chunk at a time, through update(); a repaint event is sent whenever
+	 * new entries are available.
+	 * @return True iff the given directory could be opened.
+	 */
+	bool browseAsync(const std::string& path);
+
+	/**
+	 * Makes browseAsync() take listings from the given cache when they are
+	 * still valid, and store the ones it makes in there.
+	 */
+	void setCache(ListingCache *cache) { this->cache = cache; }
+
+	/**
+	 * Adds the entries that the background scan found since the last call.
+	 * @param selected Index of an entry, which is adjusted so it still
+	 *   refers to the same entry afterwards.
+	 * @return True iff entries were added.
+	 */
+	bool update(unsigned int& selected);
+
+	/**
+	 * Returns true while a background scan is running or has results that
+	 * update() has not picked up yet.
+	 */
+	bool isScanning() { return scan != nullptr; }
+
+	/** Returns the index of the given directory, or -1 if it is not listed. */
+	int findDirectory(const std::string& name);
+	/** Returns the index of the given file, or -1 if it is not listed. */
+	int findFile(const std::string& name);
+
 	unsigned int size() { return files.size() + directories.size(); }
 	unsigned int dirCount() { return directories.size(); }
 	unsigned int fileCount() { return files.size(); }
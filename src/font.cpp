@@ -1,18 +1,22 @@
 #include "font.h"
 
 #include "debug.h"
+#include "profiler.h"
 #include "surface.h"
 #include "utilities.h"
 
 #include <SDL.h>
 #include <SDL_ttf.h>
 #include <algorithm>
-#include <vector>
+#include <cstring>
 
 /* TODO: Let the theme choose the font and font size */
 #define TTF_FONT "/usr/share/fonts/truetype/dejavu/DejaVuSansCondensed.ttf"
 #define TTF_FONT_SIZE 12
 
+/* Width and height of the atlas pages the glyphs are stored in. */
+#define ATLAS_PAGE_SIZE 256
+
 using namespace std;
 
 unique_ptr<Font> Font::defaultFont()
@@ -24,6 +28,8 @@ Font::Font(const std::string &path, unsigned int size)
 {
 	font = nullptr;
 	lineSpacing = 1;
+	ascent = 0;
+	shelfX = shelfY = shelfHeight = 0;
 
 	/* Note: TTF_Init and TTF_Quit perform reference counting, so call them
 	 * both unconditionally for each font. */
@@ -40,150 +46,218 @@ Font::Font(const std::string &path, unsigned int size)
 	}
 
 	lineSpacing = TTF_FontLineSkip(font);
+	ascent = TTF_FontAscent(font);
 }
 
 Font::~Font()
 {
+	DEBUG("Glyph atlas: %zu pages, %zu kerning pairs\n",
+			pages.size(), kerning.size());
+	for (SDL_Surface *page : pages) {
+		SDL_FreeSurface(page);
+	}
+
 	if (font) {
 		TTF_CloseFont(font);
 		TTF_Quit();
 	}
 }
 
+/**
+ * Decodes the UTF-8 sequence at p and moves p past it.
+ * SDL_ttf only handles the Basic Multilingual Plane; other code points and
+ * malformed sequences are replaced by a question mark.
+ */
+static Uint16 nextChar(const char *&p, const char *end)
+{
+	const unsigned char c = *p++;
+	if (c < 0x80) {
+		return c;
+	}
+	int len;
+	Uint32 ch;
+	if ((c & 0xE0) == 0xC0) {
+		len = 1;
+		ch = c & 0x1F;
+	} else if ((c & 0xF0) == 0xE0) {
+		len = 2;
+		ch = c & 0x0F;
+	} else if ((c & 0xF8) == 0xF0) {
+		len = 3;
+		ch = c & 0x07;
+	} else {
+		return '?';
+	}
+	for (; len; len--) {
+		if (p == end || (*p & 0xC0) != 0x80) {
+			return '?';
+		}
+		ch = (ch << 6) | (*p++ & 0x3F);
+	}
+	return ch <= 0xFFFF ? ch : '?';
+}
+
+static char *encodeChar(Uint16 ch, char *buf)
+{
+	if (ch < 0x80) {
+		*buf++ = ch;
+	} else if (ch < 0x800) {
+		*buf++ = 0xC0 | (ch >> 6);
+		*buf++ = 0x80 | (ch & 0x3F);
+	} else {
+		*buf++ = 0xE0 | (ch >> 12);
+		*buf++ = 0x80 | ((ch >> 6) & 0x3F);
+		*buf++ = 0x80 | (ch & 0x3F);
+	}
+	return buf;
+}
+
+static inline const char *findLineEnd(const char *p, const char *end)
+{
+	const void *eol = memchr(p, '\n', end - p);
+	return eol ? static_cast<const char *>(eol) : end;
+}
+
 int Font::getTextWidth(const string &text)
 {
 	if (!font) {
 		return 1;
 	}
 
-	int w;
-	size_t pos = text.find('\n', 0);
-	if (pos == string::npos) {
-		TTF_SizeUTF8(font, text.c_str(), &w, nullptr);
-		return w;
-	} else {
-		int maxWidth = 1;
-		size_t prev = 0;
-		do {
-			TTF_SizeUTF8(font, text.substr(prev, pos - prev).c_str(), &w, nullptr);
-			maxWidth = max(w, maxWidth);
-			prev = pos + 1;
-			pos = text.find('\n', prev);
-		} while (pos != string::npos);
-		TTF_SizeUTF8(font, text.substr(prev).c_str(), &w, nullptr);
-		return max(w, maxWidth);
+	const char *p = text.data(), *end = p + text.size();
+	const char *eol = findLineEnd(p, end);
+	if (eol == end) {
+		return getLineWidth(p, end);
+	}
+	int maxWidth = 1;
+	while (true) {
+		maxWidth = max(maxWidth, getLineWidth(p, eol));
+		if (eol == end) {
+			return maxWidth;
+		}
+		p = eol + 1;
+		eol = findLineEnd(p, end);
 	}
 }
 
-string Font::wordWrap(const string &text, int width)
+int Font::getLineWidth(const char *begin, const char *end)
 {
-	const size_t len = text.length();
-	string result;
-	result.reserve(len);
+	// Mirror how SDL_ttf computes the size of a text.
+	int x = 0, minx = 0, maxx = 0;
+	Uint16 prev = 0;
+	for (const char *p = begin; p != end; ) {
+		const Uint16 ch = nextChar(p, end);
+		Glyph const& glyph = getGlyph(ch);
+		if (prev) {
+			x += getKerning(prev, ch);
+		}
+		minx = min(minx, x + glyph.minx);
+		maxx = max(maxx, x + max(glyph.advance, glyph.maxx));
+		x += glyph.advance;
+		prev = ch;
+	}
+	return maxx - minx;
+}
 
-	size_t start = 0;
+static inline bool isWrapSpace(char c)
+{
+	return c == ' ' || c == '\t' || c == '\r';
+}
+
+vector<Font::LineSpan> Font::wordWrapSpans(const string &text, int width)
+{
+	vector<LineSpan> lines;
+	const char *data = text.data(), *end = data + text.size();
+
+	const char *para = data;
 	while (true) {
-		size_t end = min(text.find('\n', start), len);
-		result.append(wordWrapSingleLine(text, start, end, width));
-		start = end + 1;
-		if (start >= len) {
+		const char *paraEnd = findLineEnd(para, end);
+		wordWrapParagraph(data, para, paraEnd, width, lines);
+		if (paraEnd == end || paraEnd + 1 == end) {
 			break;
 		}
-		result.push_back('\n');
+		para = paraEnd + 1;
 	}
 
-	return result;
+	return lines;
 }
 
-string Font::wordWrapSingleLine(const string &text, size_t start, size_t end, int width)
+void Font::wordWrapParagraph(const char *data, const char *start,
+		const char *end, int width, vector<LineSpan>& lines)
 {
-	string result;
-	result.reserve(end - start);
-
-	while (start != end) {
-		/* Clean the end of the string, allowing lines that are indented at
-		 * the start to stay as such. */
-		string run = rtrim(text.substr(start, end - start));
-		int runWidth = getTextWidth(run);
-
-		if (runWidth > width) {
-			size_t fits = 0, doesntFit = run.length();
-			/* First guess: width / runWidth approximates the proportion of
-			 * the run that should fit. */
-			size_t guess = min(run.length(), (size_t) (doesntFit * ((float) width / runWidth)));
-			/* Adjust that to fully include any partial UTF-8 character. */
-			while (guess < run.length() && !isUTF8Starter(run[guess])) {
-				guess++;
+	/* Lines are measured incrementally, the same way getLineWidth() does.
+	 * When a character doesn't fit anymore, the line is broken at the last
+	 * whitespace before it, so only the characters of the last word are
+	 * measured twice. */
+	while (true) {
+		int x = 0, minx = 0, maxx = 0;
+		Uint16 prev = 0;
+		const char *lastSpace = nullptr, *overflow = nullptr;
+		for (const char *p = start; p != end; ) {
+			const char *q = p;
+			const Uint16 ch = nextChar(p, end);
+			if (isWrapSpace(*q)) {
+				lastSpace = q;
 			}
-
-			if (getTextWidth(run.substr(0, guess)) <= width) {
-				fits = guess;
-				doesntFit = fits;
-				/* Prime doesntFit, which should be closer to 2 * fits than
-				 * to run.length() / 2 if the run is long. */
-				do {
-					fits = doesntFit; // determined to fit by a previous iteration
-					doesntFit = min(2 * fits, run.length());
-					while (doesntFit < run.length() && !isUTF8Starter(run[doesntFit])) {
-						doesntFit++;
-					}
-				} while (doesntFit < run.length() && getTextWidth(run.substr(0, doesntFit)) <= width);
-			} else {
-				doesntFit = guess;
+			Glyph const& glyph = getGlyph(ch);
+			if (prev) {
+				x += getKerning(prev, ch);
 			}
-
-			/* End this loop when N full characters fit but N + 1 don't. */
-			while (fits + 1 < doesntFit) {
-				size_t guess = fits + (doesntFit - fits) / 2;
-				if (!isUTF8Starter(run[guess])) {
-					size_t oldGuess = guess;
-					/* Adjust the guess to fully include a UTF-8 character. */
-					for (size_t offset = 1; offset < (doesntFit - fits) / 2 - 1; offset++) {
-						if (isUTF8Starter(run[guess - offset])) {
-							guess -= offset;
-							break;
-						} else if (isUTF8Starter(run[guess + offset])) {
-							guess += offset;
-							break;
-						}
-					}
-					/* If there's no such character, exit early. */
-					if (guess == oldGuess) {
-						break;
-					}
-				}
-				if (getTextWidth(run.substr(0, guess)) <= width) {
-					fits = guess;
-				} else {
-					doesntFit = guess;
-				}
+			minx = min(minx, x + glyph.minx);
+			maxx = max(maxx, x + max(glyph.advance, glyph.maxx));
+			x += glyph.advance;
+			prev = ch;
+			if (maxx - minx > width && !isWrapSpace(*q)) {
+				overflow = q;
+				break;
 			}
+		}
 
-			/* The run shall be split at the last space-separated word that
-			 * fully fits, or otherwise at the last character that fits. */
-			size_t lastSpace = run.find_last_of(" \t\r", fits);
-			if (lastSpace != string::npos) {
-				fits = lastSpace;
+		if (!overflow) {
+			// The rest fits; whitespace at the end doesn't count.
+			const char *lineEnd = end;
+			while (lineEnd != start && isWrapSpace(lineEnd[-1])) {
+				lineEnd--;
 			}
+			lines.push_back({ size_t(start - data), size_t(lineEnd - data) });
+			return;
+		}
 
-			/* If 0 characters fit, we'll have to make 1 fit anyway, otherwise
-			 * we're in for an infinite loop. This can happen if the font size
-			 * is large. */
-			if (fits == 0) {
-				fits = 1;
-				while (fits < run.length() && !isUTF8Starter(run[fits])) {
-					fits++;
-				}
-			}
+		// Break at the last whitespace that fits, otherwise in the word.
+		const char *lineEnd = lastSpace ? lastSpace : overflow;
+		if (lineEnd == start) {
+			// Always put at least one character on a line, otherwise we're
+			// in for an infinite loop. This can happen if the font is large.
+			nextChar(lineEnd, end);
+		}
+		const char *next = lineEnd;
+		while (lineEnd != start && isWrapSpace(lineEnd[-1])) {
+			lineEnd--;
+		}
+		lines.push_back({ size_t(start - data), size_t(lineEnd - data) });
 
-			result.append(rtrim(run.substr(0, fits))).append("\n");
-			start = min(end, text.find_first_not_of(" \t\r", start + fits));
-		} else {
-			result.append(rtrim(run));
-			start = end;
+		while (next != end && isWrapSpace(*next)) {
+			next++;
+		}
+		if (next == end) {
+			return;
 		}
+		start = next;
 	}
+}
 
+string Font::wordWrap(const string &text, int width)
+{
+	string result;
+	result.reserve(text.size());
+	bool first = true;
+	for (auto const& span : wordWrapSpans(text, width)) {
+		if (!first) {
+			result.push_back('\n');
+		}
+		result.append(text, span.start, span.end - span.start);
+		first = false;
+	}
 	return result;
 }
 
@@ -205,30 +279,178 @@ int Font::write(Surface& surface, const string &text,
 		return 0;
 	}
 
-	size_t pos = text.find('\n', 0);
-	if (pos == string::npos) {
-		return writeLine(surface, text, x, y, halign, valign);
-	} else {
-		int maxWidth = 0;
-		size_t prev = 0;
-		do {
-			maxWidth = max(maxWidth,
-					writeLine(surface, text.substr(prev, pos - prev),
-						x, y, halign, valign));
-			y += lineSpacing;
-			prev = pos + 1;
-			pos = text.find('\n', prev);
-		} while (pos != string::npos);
-		return max(maxWidth,
-				writeLine(surface, text.substr(prev), x, y, halign, valign));
+	const char *p = text.data(), *end = p + text.size();
+	int maxWidth = 0;
+	while (true) {
+		const char *eol = findLineEnd(p, end);
+		maxWidth = max(maxWidth,
+				writeLine(surface, p, eol, x, y, halign, valign));
+		if (eol == end) {
+			return maxWidth;
+		}
+		p = eol + 1;
+		y += lineSpacing;
+	}
+}
+
+int Font::compose(Surface& surface, const string &text,
+			int x, int y, HAlign halign, VAlign valign)
+{
+	if (!font) {
+		return 0;
 	}
+	const char *p = text.data();
+	return writeLine(surface, p, findLineEnd(p, p + text.size()),
+			x, y, halign, valign, true);
 }
 
-int Font::writeLine(Surface& surface, std::string const& text,
-				int x, int y, HAlign halign, VAlign valign)
+Font::Glyph& Font::getGlyph(Uint16 ch)
 {
-	if (text.empty()) {
-		// SDL_ttf will return a nullptr when rendering the empty string.
+	auto& block = glyphs[ch / GLYPH_BLOCK];
+	if (!block) {
+		block.reset(new Glyph[GLYPH_BLOCK]);
+	}
+	Glyph& glyph = block[ch % GLYPH_BLOCK];
+	if (!glyph.loaded) {
+		loadGlyph(ch, glyph);
+	}
+	return glyph;
+}
+
+static inline Uint8 getAlpha(SDL_Surface *s, int w, int x, int y)
+{
+	if (x < 0 || y < 0 || x >= w || y >= s->h) {
+		return 0;
+	}
+	Uint32 pixel = *((Uint32 *) ((Uint8 *) s->pixels + y * s->pitch) + x);
+	return (pixel & s->format->Amask) >> s->format->Ashift;
+}
+
+void Font::loadGlyph(Uint16 ch, Glyph& glyph)
+{
+	Profiler::Timer timer(Profiler::TEXT_RENDER);
+
+	glyph.loaded = true;
+	glyph.page = nullptr;
+	int minx, maxx, miny, maxy, advance;
+	if (TTF_GlyphMetrics(font, ch, &minx, &maxx, &miny, &maxy, &advance) < 0) {
+		minx = maxx = maxy = advance = 0;
+	}
+	glyph.minx = minx;
+	glyph.maxx = maxx;
+	glyph.advance = advance;
+	glyph.x = minx - 1;
+	glyph.y = ascent - maxy - 1;
+
+	SDL_Color white = { 0xff, 0xff, 0xff, 0 };
+	SDL_Surface *fill = TTF_RenderGlyph_Blended(font, ch, white);
+	if (!fill) {
+		// Blank glyphs, such as spaces, have nothing to draw.
+		return;
+	}
+	// FreeType can report a pixmap wider than the glyph; SDL_ttf crops
+	// those when rendering text, so do the same.
+	const int w = min(fill->w, maxx - minx), h = fill->h;
+	SDL_Rect cell;
+	SDL_Surface *page = w > 0 && h > 0
+			? allocateCell(2 * (w + 2), h + 2, cell) : nullptr;
+	if (!page) {
+		SDL_FreeSurface(fill);
+		return;
+	}
+	glyph.page = page;
+	glyph.fill = { cell.x, cell.y, static_cast<Uint16>(w + 2), cell.h };
+	glyph.outline = glyph.fill;
+	glyph.outline.x += w + 2;
+
+	/* The text is drawn in white on top of four copies of itself in black,
+	 * shifted one pixel up, down, left and right. Those copies are combined
+	 * into a single outline cell, which is drawn below the whole text
+	 * before the fill cells, so outlines never cover neighbouring glyphs. */
+	SDL_LockSurface(fill);
+	for (int y = 0; y < h + 2; y++) {
+		Uint32 *dst = (Uint32 *) ((Uint8 *) page->pixels
+				+ (cell.y + y) * page->pitch) + cell.x;
+		const int fy = y - 1;
+		for (int x = 0; x < w + 2; x++) {
+			const int fx = x - 1;
+			// Transparency left after the four black copies.
+			unsigned int t = 255;
+			t = t * (255 - getAlpha(fill, w, fx, fy + 1)) / 255;
+			t = t * (255 - getAlpha(fill, w, fx, fy - 1)) / 255;
+			t = t * (255 - getAlpha(fill, w, fx + 1, fy)) / 255;
+			t = t * (255 - getAlpha(fill, w, fx - 1, fy)) / 255;
+			dst[x] = (getAlpha(fill, w, fx, fy) << 24) | 0xFFFFFF;
+			dst[w + 2 + x] = (255 - t) << 24;
+		}
+	}
+	SDL_UnlockSurface(fill);
+	SDL_FreeSurface(fill);
+}
+
+SDL_Surface *Font::allocateCell(int w, int h, SDL_Rect& cell)
+{
+	SDL_Surface *page = pages.empty() ? nullptr : pages.back();
+	if (page && shelfX + w > page->w) {
+		// Start a new shelf.
+		shelfX = 0;
+		shelfY += shelfHeight;
+		shelfHeight = 0;
+	}
+	if (!page || w > page->w || shelfY + h > page->h) {
+		page = SDL_CreateRGBSurface(SDL_SWSURFACE,
+				max(w, ATLAS_PAGE_SIZE), max(h, ATLAS_PAGE_SIZE), 32,
+				0x00FF0000, 0x0000FF00, 0x000000FF, 0xFF000000);
+		if (!page) {
+			ERROR("Out of memory for glyph atlas\n");
+			return nullptr;
+		}
+		SDL_FillRect(page, nullptr, 0);
+		SDL_SetAlpha(page, SDL_SRCALPHA, SDL_ALPHA_OPAQUE);
+		pages.push_back(page);
+		shelfX = shelfY = shelfHeight = 0;
+	}
+
+	cell = {
+		static_cast<Sint16>(shelfX), static_cast<Sint16>(shelfY),
+		static_cast<Uint16>(w), static_cast<Uint16>(h)
+	};
+	shelfX += w;
+	shelfHeight = max(shelfHeight, h);
+	return page;
+}
+
+int Font::getKerning(Uint16 prev, Uint16 ch)
+{
+	const Uint32 key = (Uint32) prev << 16 | ch;
+	auto it = kerning.find(key);
+	if (it != kerning.end()) {
+		return it->second;
+	}
+
+	// For glyphs that stay within their advance, the width of the pair is
+	// the sum of the advances plus the kerning.
+	int kern = 0;
+	Glyph const& a = getGlyph(prev);
+	Glyph const& b = getGlyph(ch);
+	if (TTF_GetFontKerning(font)
+			&& a.minx >= 0 && a.maxx <= a.advance
+			&& b.minx >= 0 && b.maxx <= b.advance) {
+		char pair[7];
+		*encodeChar(ch, encodeChar(prev, pair)) = '\0';
+		int w;
+		if (TTF_SizeUTF8(font, pair, &w, nullptr) == 0) {
+			kern = w - a.advance - b.advance;
+		}
+	}
+	kerning.emplace(key, kern);
+	return kern;
+}
+
+int Font::writeLine(Surface& surface, const char *begin, const char *end,
+				int x, int y, HAlign halign, VAlign valign, bool compose)
+{
+	if (begin == end) {
 		return 0;
 	}
 
@@ -243,13 +465,7 @@ int Font::writeLine(Surface& surface, std::string const& text,
 		break;
 	}
 
-	SDL_Color color = { 0, 0, 0, 0 };
-	SDL_Surface *s = TTF_RenderUTF8_Blended(font, text.c_str(), color);
-	if (!s) {
-		ERROR("Font rendering failed for text \"%s\"\n", text.c_str());
-		return 0;
-	}
-	const int width = s->w;
+	const int width = getLineWidth(begin, end);
 
 	switch (halign) {
 	case HAlignLeft:
@@ -262,37 +478,36 @@ int Font::writeLine(Surface& surface, std::string const& text,
 		break;
 	}
 
-	SDL_Rect rect = { (Sint16) x, (Sint16) (y - 1), 0, 0 };
-	SDL_BlitSurface(s, NULL, surface.raw, &rect);
-
-	/* Note: rect.x / rect.y are reset everytime because SDL_BlitSurface
-	 * will modify them if negative */
-	rect.x = x;
-	rect.y = y + 1;
-	SDL_BlitSurface(s, NULL, surface.raw, &rect);
-
-	rect.x = x - 1;
-	rect.y = y;
-	SDL_BlitSurface(s, NULL, surface.raw, &rect);
-
-	rect.x = x + 1;
-	rect.y = y;
-	SDL_BlitSurface(s, NULL, surface.raw, &rect);
-	SDL_FreeSurface(s);
-
-	rect.x = x;
-	rect.y = y;
-	color.r = 0xff;
-	color.g = 0xff;
-	color.b = 0xff;
-
-	s = TTF_RenderUTF8_Blended(font, text.c_str(), color);
-	if (!s) {
-		ERROR("Font rendering failed for text \"%s\"\n", text.c_str());
-		return width;
+	// Like SDL_ttf, don't let the first glyph stick out on the left.
+	const char *p = begin;
+	const int start = max(0, -getGlyph(nextChar(p, end)).minx);
+
+	// Draw all outlines first, then all fills on top of them.
+	for (int pass = 0; pass < 2; pass++) {
+		int pen = start;
+		Uint16 prev = 0;
+		for (p = begin; p != end; ) {
+			const Uint16 ch = nextChar(p, end);
+			Glyph const& glyph = getGlyph(ch);
+			if (prev) {
+				pen += getKerning(prev, ch);
+			}
+			prev = ch;
+			if (glyph.page) {
+				SDL_Rect cell = pass ? glyph.fill : glyph.outline;
+				const int dx = x + pen + glyph.x, dy = y + glyph.y;
+				if (compose) {
+					Surface::compose(glyph.page, cell, surface.raw, dx, dy);
+				} else {
+					SDL_Rect dst = {
+						static_cast<Sint16>(dx), static_cast<Sint16>(dy), 0, 0
+					};
+					SDL_BlitSurface(glyph.page, &cell, surface.raw, &dst);
+				}
+			}
+			pen += glyph.advance;
+		}
 	}
-	SDL_BlitSurface(s, NULL, surface.raw, &rect);
-	SDL_FreeSurface(s);
 
 	return width;
 }
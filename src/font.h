@@ -5,8 +5,11 @@
 #define FONT_H
 
 #include <SDL_ttf.h>
+#include <cstddef>
 #include <memory>
 #include <string>
+#include <unordered_map>
+#include <vector>
 
 class Surface;
 
@@ -14,6 +17,8 @@ class Surface;
  * Wrapper around a TrueType or other FreeType-supported font.
  * The wrapper is valid even if the font couldn't be loaded, but in that case
  * nothing will be drawn.
+ * Glyphs are rasterised once into an atlas together with their outline, so
+ * measuring and drawing text doesn't have to go through SDL_ttf again.
  */
 class Font {
 public:
@@ -28,8 +33,32 @@ public:
 	Font(const std::string &path, unsigned int size);
 	~Font();
 
+	/** A line of text, as byte offsets into the text it was taken from. */
+	struct LineSpan {
+		size_t start, end;
+	};
+
+	/**
+	 * Splits the text into lines that are no wider than the given width,
+	 * breaking at newlines and, if needed, at whitespace or inside words.
+	 * Whitespace at the end of a line is left out of its span.
+	 */
+	std::vector<LineSpan> wordWrapSpans(const std::string &text, int width);
+
+	/**
+	 * Returns the text with newlines inserted where wordWrapSpans()
+	 * would break it.
+	 */
 	std::string wordWrap(const std::string &text, int width);
 
+	/**
+	 * Splits a single paragraph, which must not contain newlines, into
+	 * lines like wordWrapSpans() does. The spans are appended to the given
+	 * vector, as offsets relative to data.
+	 */
+	void wordWrapParagraph(const char *data, const char *start,
+				const char *end, int width, std::vector<LineSpan>& lines);
+
 	int getTextWidth(const std::string& text);
 	int getTextHeight(const std::string& text);
 
@@ -46,21 +75,79 @@ public:
 				const std::string &text, int x, int y,
 				HAlign halign = HAlignLeft, VAlign valign = VAlignTop);
 
+	/**
+	 * Draws a single line of text on a transparent surface in this font,
+	 * updating the alpha channel of the surface as well.
+	 * @see Surface::compose
+	 * @return The width of the text in pixels.
+	 */
+	int compose(Surface& surface,
+				const std::string &text, int x, int y,
+				HAlign halign = HAlignLeft, VAlign valign = VAlignTop);
+
 private:
+	/**
+	 * A rasterised glyph. Its pixels are stored twice in the atlas: once
+	 * as the white fill and once as the black outline around it.
+	 * Both cells have a one pixel border and are drawn at the same position.
+	 */
+	struct Glyph {
+		bool loaded = false;
+		Sint16 minx, maxx, advance;
+		/** Position of the cells relative to the pen and the top of the line. */
+		Sint16 x, y;
+		/** Atlas page the cells are on, or nullptr if the glyph is blank. */
+		SDL_Surface *page;
+		SDL_Rect fill, outline;
+	};
+
+	/** Glyphs are looked up in blocks of this many code points. */
+	static const unsigned int GLYPH_BLOCK = 256;
+
 	Font(TTF_Font *font);
 
-	std::string wordWrapSingleLine(const std::string &text,
-				size_t start, size_t end, int width);
+	/**
+	 * Returns the glyph for the given code point, rasterising it into the
+	 * atlas the first time it is used.
+	 */
+	Glyph& getGlyph(Uint16 ch);
+	void loadGlyph(Uint16 ch, Glyph& glyph);
+	/**
+	 * Reserves an area of the given size in the atlas.
+	 * @return The page the area is on, or nullptr if out of memory.
+	 */
+	SDL_Surface *allocateCell(int w, int h, SDL_Rect& cell);
+
+	/**
+	 * Returns the horizontal adjustment between two adjacent glyphs.
+	 * SDL_ttf doesn't expose the kerning table, so it is derived from
+	 * measurements the first time a pair occurs.
+	 */
+	int getKerning(Uint16 prev, Uint16 ch);
+
+	/**
+	 * Returns the width of the text between begin and end, which must not
+	 * contain newlines.
+	 */
+	int getLineWidth(const char *begin, const char *end);
 
 	/**
 	 * Draws a single line of text on a surface in this font.
 	 * @return The width of the text in pixels.
 	 */
-	int writeLine(Surface& surface, std::string const& text,
-				int x, int y, HAlign halign, VAlign valign);
+	int writeLine(Surface& surface, const char *begin, const char *end,
+				int x, int y, HAlign halign, VAlign valign,
+				bool compose = false);
 
 	TTF_Font *font;
-	int lineSpacing;
+	int lineSpacing, ascent;
+
+	std::unique_ptr<Glyph[]> glyphs[0x10000 / GLYPH_BLOCK];
+	std::unordered_map<Uint32, Sint8> kerning;
+
+	std::vector<SDL_Surface *> pages;
+	/** Position and height of the shelf being filled on the last page. */
+	int shelfX, shelfY, shelfHeight;
 };
 
 #endif /* FONT_H */
@@ -0,0 +1,240 @@
+// Various authors.
+// License: GPL version 2 or later.
+
+/*
+ * Times Font::wordWrap() on large texts against the algorithm it replaced,
+ * which is kept below as the reference. Not installed; build it with
+ * "make bench".
+ *
+ * Usage: fontbench [font.ttf [size [text files...]]]
+ * Without text files, a README-like and a log-like text are generated.
+ */
+
+#include "font.h"
+#include "utilities.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <string>
+
+using namespace std;
+
+/* Width to wrap at, in pixels: the text area of a 320x240 screen. */
+static const int WRAP_WIDTH = 300;
+
+/* Size of the generated texts, in bytes. */
+static const size_t TEXT_SIZE = 512 * 1024;
+
+/*
+ * The word wrapping that Font used before it measured lines incrementally:
+ * a binary search over prefixes of each run, measuring every prefix anew.
+ */
+static string wordWrapSingleLine(Font& font,
+		const string &text, size_t start, size_t end, int width)
+{
+	string result;
+	result.reserve(end - start);
+
+	while (start != end) {
+		/* Clean the end of the string, allowing lines that are indented at
+		 * the start to stay as such. */
+		string run = rtrim(text.substr(start, end - start));
+		int runWidth = font.getTextWidth(run);
+
+		if (runWidth > width) {
+			size_t fits = 0, doesntFit = run.length();
+			/* First guess: width / runWidth approximates the proportion of
+			 * the run that should fit. */
+			size_t guess = min(run.length(), (size_t) (doesntFit * ((float) width / runWidth)));
+			/* Adjust that to fully include any partial UTF-8 character. */
+			while (guess < run.length() && !isUTF8Starter(run[guess])) {
+				guess++;
+			}
+
+			if (font.getTextWidth(run.substr(0, guess)) <= width) {
+				fits = guess;
+				doesntFit = fits;
+				/* Prime doesntFit, which should be closer to 2 * fits than
+				 * to run.length() / 2 if the run is long. */
+				do {
+					fits = doesntFit; // determined to fit by a previous iteration
+					doesntFit = min(2 * fits, run.length());
+					while (doesntFit < run.length() && !isUTF8Starter(run[doesntFit])) {
+						doesntFit++;
+					}
+				} while (doesntFit < run.length() && font.getTextWidth(run.substr(0, doesntFit)) <= width);
+			} else {
+				doesntFit = guess;
+			}
+
+			/* End this loop when N full characters fit but N + 1 don't. */
+			while (fits + 1 < doesntFit) {
+				size_t guess = fits + (doesntFit - fits) / 2;
+				if (!isUTF8Starter(run[guess])) {
+					size_t oldGuess = guess;
+					/* Adjust the guess to fully include a UTF-8 character. */
+					for (size_t offset = 1; offset < (doesntFit - fits) / 2 - 1; offset++) {
+						if (isUTF8Starter(run[guess - offset])) {
+							guess -= offset;
+							break;
+						} else if (isUTF8Starter(run[guess + offset])) {
+							guess += offset;
+							break;
+						}
+					}
+					/* If there's no such character, exit early. */
+					if (guess == oldGuess) {
+						break;
+					}
+				}
+				if (font.getTextWidth(run.substr(0, guess)) <= width) {
+					fits = guess;
+				} else {
+					doesntFit = guess;
+				}
+			}
+
+			/* The run shall be split at the last space-separated word that
+			 * fully fits, or otherwise at the last character that fits. */
+			size_t lastSpace = run.find_last_of(" \t\r", fits);
+			if (lastSpace != string::npos) {
+				fits = lastSpace;
+			}
+
+			/* If 0 characters fit, we'll have to make 1 fit anyway, otherwise
+			 * we're in for an infinite loop. This can happen if the font size
+			 * is large. */
+			if (fits == 0) {
+				fits = 1;
+				while (fits < run.length() && !isUTF8Starter(run[fits])) {
+					fits++;
+				}
+			}
+
+			result.append(rtrim(run.substr(0, fits))).append("\n");
+			start = min(end, text.find_first_not_of(" \t\r", start + fits));
+		} else {
+			result.append(rtrim(run));
+			start = end;
+		}
+	}
+
+	return result;
+}
+
+static string referenceWordWrap(Font& font, const string &text, int width)
+{
+	const size_t len = text.length();
+	string result;
+	result.reserve(len);
+
+	size_t start = 0;
+	while (true) {
+		size_t end = min(text.find('\n', start), len);
+		result.append(wordWrapSingleLine(font, text, start, end, width));
+		start = end + 1;
+		if (start >= len) {
+			break;
+		}
+		result.push_back('\n');
+	}
+
+	return result;
+}
+
+/* Paragraphs of prose with the odd accented word, like a README. */
+static string makeReadme()
+{
+	static const char *words[] = {
+		"the", "emulator", "loads", "a", "ROM", "from", "SD", "card", "and",
+		"saves", "its", "state", "on", "exit", "configuration", "of",
+		"controls", "is", "done", "in", "menu", "détails", "über", "café",
+	};
+	string text;
+	while (text.size() < TEXT_SIZE) {
+		const int paragraph = 20 + rand() % 200;
+		for (int i = 0; i < paragraph; i++) {
+			text += words[rand() % (sizeof(words) / sizeof(words[0]))];
+			text += ' ';
+		}
+		text += "\n\n";
+	}
+	return text;
+}
+
+/* Long lines with few spaces, like a log file. */
+static string makeLog()
+{
+	string text;
+	char line[256];
+	for (unsigned int i = 0; text.size() < TEXT_SIZE; i++) {
+		snprintf(line, sizeof(line),
+				"[%08u] /media/sdcard/roms/snes/Some_Long_Game_Name_%u_(Europe)"
+				".zip: loaded %u bytes, crc=%08x\n",
+				i, i % 997, rand() % 4194304, rand());
+		text += line;
+	}
+	return text;
+}
+
+static size_t countLines(const string &text)
+{
+	size_t lines = 1;
+	for (char c : text) {
+		lines += c == '\n';
+	}
+	return lines;
+}
+
+template <typename Wrap>
+static double timeWrap(Wrap wrap, string& result)
+{
+	typedef chrono::steady_clock Clock;
+	const Clock::time_point start = Clock::now();
+	result = wrap();
+	const chrono::duration<double, milli> elapsed = Clock::now() - start;
+	return elapsed.count();
+}
+
+static void bench(Font& font, const char *name, const string &text)
+{
+	string wrapped, reference;
+	// Measure once up front, so both start with all glyphs in the atlas.
+	font.getTextWidth(text);
+	const double ms = timeWrap([&] {
+		return font.wordWrap(text, WRAP_WIDTH);
+	}, wrapped);
+	const double referenceMs = timeWrap([&] {
+		return referenceWordWrap(font, text, WRAP_WIDTH);
+	}, reference);
+
+	printf("%-24s %8zu KiB %10.1f %10.1f %7.2fx %8zu %8zu\n",
+			name, text.size() / 1024, referenceMs, ms, referenceMs / ms,
+			countLines(reference), countLines(wrapped));
+}
+
+int main(int argc, char *argv[])
+{
+	unique_ptr<Font> font = argc > 1
+			? unique_ptr<Font>(new Font(argv[1], argc > 2 ? atoi(argv[2]) : 12))
+			: Font::defaultFont();
+	if (font->getLineSpacing() <= 1) {
+		fprintf(stderr, "Unable to load the font\n");
+		return EXIT_FAILURE;
+	}
+
+	printf("%-24s %12s %10s %10s %8s %8s %8s\n", "text", "size",
+			"old ms", "new ms", "speedup", "old ln", "new ln");
+	if (argc > 3) {
+		for (int i = 3; i < argc; i++) {
+			bench(*font, argv[i], readFileAsString(argv[i]));
+		}
+	} else {
+		bench(*font, "README (generated)", makeReadme());
+		bench(*font, "log (generated)", makeLog());
+	}
+
+	return EXIT_SUCCESS;
+}
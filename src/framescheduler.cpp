@@ -0,0 +1,65 @@
+// Various authors.
+// License: GPL version 2 or later.
+
+#include "framescheduler.h"
+
+#include <algorithm>
+
+using namespace std;
+
+/* Longest sleep without checking for input, in milliseconds. */
+#define POLL_INTERVAL 5
+
+
+FrameScheduler::FrameScheduler(unsigned int framesPerSecond)
+	: nextFrame(0)
+	, running(false)
+	, lateFrames(0)
+	, droppedFrames(0)
+{
+	setFrameRate(framesPerSecond);
+}
+
+void FrameScheduler::setFrameRate(unsigned int framesPerSecond)
+{
+	interval = 1000 / max(framesPerSecond, 1u);
+}
+
+void FrameScheduler::startFrame()
+{
+	const Uint32 now = SDL_GetTicks();
+	if (!running) {
+		running = true;
+		nextFrame = now;
+	}
+
+	// Note: Compare the difference, so wrapping of the tick counter is
+	//       harmless.
+	const Sint32 behind = now - nextFrame;
+	if (behind < 0) {
+		// Started early, for instance to handle input: the deadline of the
+		// next animation frame stays where it is.
+		return;
+	}
+	if (behind > 0) {
+		const Uint32 missed = behind / interval;
+		droppedFrames += missed;
+		nextFrame += missed * interval;
+		// Sleeping tends to overshoot a little; don't count that.
+		if (behind - missed * interval > interval / 4) {
+			lateFrames++;
+		}
+	}
+	nextFrame += interval;
+}
+
+bool FrameScheduler::waitForFrame()
+{
+	const Sint32 left = nextFrame - SDL_GetTicks();
+	if (left <= 0) {
+		return false;
+	}
+	const Uint32 sleep = min<Uint32>(left, POLL_INTERVAL);
+	SDL_Delay(sleep);
+	return static_cast<Uint32>(left) > sleep;
+}
@@ -0,0 +1,52 @@
+// Various authors.
+// License: GPL version 2 or later.
+
+#ifndef FRAMESCHEDULER_H
+#define FRAMESCHEDULER_H
+
+#include <SDL.h>
+
+
+/**
+ * Paces the frames of running animations at a fixed rate, so the main loop
+ * can sleep in between frames instead of painting as fast as it can.
+ * Also keeps track of frames that were started late or skipped entirely.
+ */
+class FrameScheduler {
+public:
+	FrameScheduler(unsigned int framesPerSecond = 30);
+
+	void setFrameRate(unsigned int framesPerSecond);
+
+	/**
+	 * Marks the start of a frame. Once the deadline of the next animation
+	 * frame has been reached, the one after that is scheduled; frames that
+	 * are started earlier leave the deadline as it is.
+	 */
+	void startFrame();
+
+	/**
+	 * Marks the end of an animation; the next frame that is started is not
+	 * considered late, no matter how long the pause was.
+	 */
+	void stop() { running = false; }
+
+	/**
+	 * Sleeps for a short while, but not past the deadline of the next frame.
+	 * Returns true if there is time left before the deadline afterwards,
+	 * so input can be polled again before sleeping some more.
+	 */
+	bool waitForFrame();
+
+	/** Number of frames that were started well after their deadline. */
+	unsigned int getLateFrames() const { return lateFrames; }
+	/** Number of frames that were skipped because the deadline passed. */
+	unsigned int getDroppedFrames() const { return droppedFrames; }
+
+private:
+	Uint32 interval, nextFrame;
+	bool running;
+	unsigned int lateFrames, droppedFrames;
+};
+
+#endif // FRAMESCHEDULER_H
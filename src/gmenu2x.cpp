@@ -41,8 +41,11 @@
 #include "menusettingrgba.h"
 #include "menusettingstring.h"
 #include "messagebox.h"
+#include "perfoverlay.h"
 #include "powersaver.h"
+#include "profiler.h"
 #include "settingsdialog.h"
+#include "textbuffer.h"
 #include "textdialog.h"
 #include "wallpaperdialog.h"
 #include "utilities.h"
@@ -131,6 +134,11 @@ const string GMenu2X::getHome()
 	return gmenu2x_home;
 }
 
+const string GMenu2X::getCacheDir()
+{
+	return gmenu2x_home + "/cache";
+}
+
 static void set_handler(int signal, void (*handler)(int))
 {
 	struct sigaction sig;
@@ -158,6 +166,9 @@ int main(int /*argc*/, char * /*argv*/[]) {
 		ERROR("Unable to create gmenu2x home directory.\n");
 		return 1;
 	}
+	if (mkdir(GMenu2X::getCacheDir().c_str(), 0770) < 0 && errno != EEXIST) {
+		WARNING("Unable to create gmenu2x cache directory.\n");
+	}
 
 	DEBUG("Home path: %s.\n", gmenu2x_home.c_str());
 
@@ -213,9 +224,10 @@ void GMenu2X::initCPULimits() {
 
 GMenu2X::GMenu2X()
 	: input(*this, powerSaver)
+	, thumbnails(getCacheDir() + "/thumbnails")
+	, listings(getCacheDir() + "/listings.idx")
 {
 	usbnet = samba = inet = web = false;
-	useSelectionPng = false;
 
 #ifdef ENABLE_CPUFREQ
 	initCPULimits();
@@ -244,6 +256,7 @@ GMenu2X::GMenu2X()
 
 	bg = NULL;
 	font = NULL;
+	sc.setBudget(confInt["imageCacheSize"] * 1024);
 	setSkin(confStr["skin"], !fileExists(confStr["wallpaper"]));
 	layers.insert(layers.begin(), make_shared<Background>(*this));
 
@@ -274,9 +287,11 @@ GMenu2X::GMenu2X()
 	s->flip();
 
 	initMenu();
+	updatePerfOverlay();
 
 #ifdef ENABLE_INOTIFY
 	monitor = new MediaMonitor(CARD_ROOT);
+	monitor->start();
 #endif
 
 	if (!input.init(menu.get())) {
@@ -284,6 +299,7 @@ GMenu2X::GMenu2X()
 	}
 
 	powerSaver.setScreenTimeout(confInt["backlightTimeout"]);
+	frames.setFrameRate(confInt["frameRate"]);
 
 #ifdef ENABLE_CPUFREQ
 	setClock(confInt["menuClock"]);
@@ -291,8 +307,19 @@ GMenu2X::GMenu2X()
 }
 
 GMenu2X::~GMenu2X() {
+	Profiler::dump();
+	INFO("Animation frames: %u late, %u dropped\n",
+			frames.getLateFrames(), frames.getDroppedFrames());
+	if (s) {
+		INFO("Pixels pushed: %llu\n",
+				(unsigned long long) s->getTotalPixelsPushed());
+	}
+	SurfaceCollection::Stats const& images = sc.getStats();
+	INFO("Image cache: %zu bytes, %u hits, %u misses, %u evictions\n",
+			images.bytes, images.hits, images.misses, images.evictions);
 	fflush(NULL);
 	sc.clear();
+	listings.save();
 
 #ifdef ENABLE_INOTIFY
 	delete monitor;
@@ -304,7 +331,7 @@ void GMenu2X::initBG() {
 	bgmain.reset();
 
 	// Load wallpaper.
-	bg = OffscreenSurface::loadImage(confStr["wallpaper"]);
+	bg = OffscreenSurface::loadImageForDisplay(confStr["wallpaper"]);
 	if (!bg) {
 		bg = OffscreenSurface::emptySurface(resX, resY);
 	}
@@ -364,7 +391,7 @@ void GMenu2X::initBG() {
 void GMenu2X::initFont() {
 	string path = skinConfStr["font"];
 	if (!path.empty()) {
-		unsigned int size = skinConfInt["fontsize"];
+		unsigned int size = layout.fontSize;
 		if (!size)
 			size = 12;
 		if (path.substr(0,5)=="skin:")
@@ -421,18 +448,16 @@ void GMenu2X::initMenu() {
 }
 
 void GMenu2X::about() {
-	string text(readFileAsString(GMENU2X_SYSTEM_DIR "/about.txt"));
 	string build_date("Build date: " __DATE__);
-	TextDialog td(*this, "GMenu2X", build_date, "icons/about.png", text);
+	TextDialog td(*this, "GMenu2X", build_date, "icons/about.png",
+			TextBuffer::fromFile(GMENU2X_SYSTEM_DIR "/about.txt"));
 	td.exec();
 }
 
 void GMenu2X::viewLog() {
-	string text(readFileAsString(LOG_FILE));
-
 	TextDialog td(*this, tr["Log Viewer"],
 			tr["Displays last launched program's output"],
-			"icons/ebook.png", text);
+			"icons/ebook.png", TextBuffer::fromFile(LOG_FILE));
 	td.exec();
 
 	MessageBox mb(*this, tr["Do you want to delete the log file?"],
@@ -489,6 +514,10 @@ void GMenu2X::readConfig(string conffile) {
 	evalIntConf( confInt, "backlightTimeout", 15, 0,120 );
 	evalIntConf( confInt, "buttonRepeatRate", 10, 0, 20 );
 	evalIntConf( confInt, "videoBpp", 32, 16, 32 );
+	evalIntConf( confInt, "perfOverlay", 0, 0, 1 );
+	evalIntConf( confInt, "frameRate", 30, 10, 60 );
+	// Size of the image cache, in KiB.
+	evalIntConf( confInt, "imageCacheSize", 4096, 256, 65536 );
 
 	if (confStr["tvoutEncoding"] != "PAL") confStr["tvoutEncoding"] = "NTSC";
 	resX = constrain( confInt["resolutionX"], 320,1920 );
@@ -554,7 +583,7 @@ void GMenu2X::writeSkinConfig() {
 }
 
 void GMenu2X::readTmp() {
-	lastSelectorElement = -1;
+	lastSelectorFile = "";
 	ifstream inf("/tmp/gmenu2x.tmp", ios_base::in);
 	if (inf.is_open()) {
 		string line;
@@ -568,8 +597,8 @@ void GMenu2X::readTmp() {
 				menu->setSectionIndex(atoi(value.c_str()));
 			else if (name=="link")
 				menu->setLinkIndex(atoi(value.c_str()));
-			else if (name=="selectorelem")
-				lastSelectorElement = atoi(value.c_str());
+			else if (name=="selectorfile")
+				lastSelectorFile = value;
 			else if (name=="selectordir")
 				lastSelectorDir = value;
 		}
@@ -577,14 +606,14 @@ void GMenu2X::readTmp() {
 	}
 }
 
-void GMenu2X::writeTmp(int selelem, const string &selectordir) {
+void GMenu2X::writeTmp(const string &selectorfile, const string &selectordir) {
 	string conffile = "/tmp/gmenu2x.tmp";
 	ofstream inf(conffile.c_str());
 	if (inf.is_open()) {
 		inf << "section=" << menu->selSectionIndex() << endl;
 		inf << "link=" << menu->selLinkIndex() << endl;
-		if (selelem>-1)
-			inf << "selectorelem=" << selelem << endl;
+		if (!selectorfile.empty())
+			inf << "selectorfile=" << selectorfile << endl;
 		if (!selectordir.empty())
 			inf << "selectordir=" << selectordir << endl;
 		inf.close();
@@ -597,16 +626,20 @@ void GMenu2X::mainLoop() {
 
 	// Recover last session
 	readTmp();
-	if (lastSelectorElement > -1 && menu->selLinkApp() &&
+	if (!lastSelectorFile.empty() && menu->selLinkApp() &&
 				(!menu->selLinkApp()->getSelectorDir().empty()
 				 || !lastSelectorDir.empty()))
-		menu->selLinkApp()->selector(lastSelectorElement, lastSelectorDir);
+		menu->selLinkApp()->selector(lastSelectorFile, lastSelectorDir);
 
 	while (true) {
+		DirtyRegion damage;
+
 		// Remove dismissed layers from the stack.
 		for (auto it = layers.begin(); it != layers.end(); ) {
 			if ((*it)->getStatus() == Layer::Status::DISMISSED) {
 				it = layers.erase(it);
+				// Whatever was below the layer is uncovered.
+				damage.addAll();
 			} else {
 				++it;
 			}
@@ -614,28 +647,36 @@ void GMenu2X::mainLoop() {
 
 		// Run animations.
 		bool animating = false;
-		for (auto layer : layers) {
-			animating |= layer->runAnimations();
+		{
+			Profiler::Timer timer(Profiler::ANIMATIONS);
+			for (auto layer : layers) {
+				animating |= layer->runAnimations();
+			}
 		}
-
-		// Paint layers.
-		for (auto layer : layers) {
-			layer->paint(*s);
+		if (animating) {
+			frames.startFrame();
+		} else {
+			frames.stop();
 		}
-		s->flip();
+
+		paintLayers(damage);
 
 		// Exit main loop once we have something to launch.
 		if (toLaunch) {
 			break;
 		}
 
-		// Handle other input events.
+		// Handle other input events. While animating, poll for input until
+		// the next frame is due.
 		InputManager::Button button;
 		bool gotEvent;
 		const bool wait = !animating;
-		do {
-			gotEvent = input.getButton(&button, wait);
-		} while (wait && !gotEvent);
+		{
+			Profiler::Timer timer(Profiler::INPUT_WAIT);
+			do {
+				gotEvent = input.getButton(&button, wait);
+			} while (!gotEvent && (wait || frames.waitForFrame()));
+		}
 		if (gotEvent) {
 			if (button == InputManager::QUIT) {
 				break;
@@ -649,6 +690,113 @@ void GMenu2X::mainLoop() {
 	}
 }
 
+static void paintLayer(Layer& layer, Surface& s) {
+	Profiler::Timer timer(layer.getPaintPhase());
+	if (layer.isModal()) {
+		layer.paintBackdrop(s);
+	}
+	layer.paint(s);
+}
+
+void GMenu2X::paintLayers(DirtyRegion& damage) {
+	// Nothing below the topmost opaque layer is visible.
+	size_t bottom = 0;
+	for (size_t i = layers.size(); i-- > 0; ) {
+		if (layers[i]->isOpaque()) {
+			bottom = i;
+			break;
+		}
+	}
+	// Everything below the topmost modal layer comes from the backdrop.
+	shared_ptr<Layer> modal;
+	size_t top = bottom;
+	for (size_t i = layers.size(); i-- > bottom; ) {
+		if (layers[i]->isModal()) {
+			modal = layers[i];
+			top = i;
+			break;
+		}
+	}
+
+	DirtyRegion below;
+	for (size_t i = 0; i < layers.size(); i++) {
+		layers[i]->takeDamage(modal && i < top ? below : damage);
+	}
+
+	if (modal) {
+		if (backdropOwner.lock() != modal || !snapshot || !backdrop) {
+			snapshot = OffscreenSurface::emptySurface(resX, resY);
+			backdrop = OffscreenSurface::emptySurface(resX, resY);
+			if (snapshot && backdrop) {
+				snapshot->convertToDisplayFormat();
+				backdrop->convertToDisplayFormat();
+			}
+			backdropOwner = modal;
+			below.addAll();
+		}
+		if (snapshot && backdrop) {
+			// Update the snapshot of the layers below the modal layer,
+			// then put the backdrop of the modal layer on top.
+			DirtyRegion changed;
+			if (modal->takeBackdropDamage()) {
+				changed.addAll();
+			}
+			changed.add(below);
+			for (auto& rect : below.getRects(resX, resY)) {
+				snapshot->setClipRect(rect);
+				for (size_t i = bottom; i < top; i++) {
+					paintLayer(*layers[i], *snapshot);
+				}
+			}
+			snapshot->clearClipRect();
+			for (auto& rect : changed.getRects(resX, resY)) {
+				backdrop->setClipRect(rect);
+				snapshot->blit(*backdrop, 0, 0);
+				modal->paintBackdrop(*backdrop);
+			}
+			backdrop->clearClipRect();
+			damage.add(changed);
+		} else {
+			// Out of memory; paint the whole stack every time.
+			modal.reset();
+			damage.add(below);
+		}
+	} else {
+		snapshot.reset();
+		backdrop.reset();
+		backdropOwner.reset();
+	}
+
+	// Paint layers, but only in the areas that changed.
+	s->addOutdated(damage);
+	if (damage.isEmpty()) {
+		return;
+	}
+	auto rects = damage.getRects(s->width(), s->height());
+	for (auto& rect : rects) {
+		s->setClipRect(rect);
+		if (modal) {
+			backdrop->blit(*s, 0, 0);
+			{
+				Profiler::Timer timer(modal->getPaintPhase());
+				modal->paint(*s);
+			}
+			for (size_t i = top + 1; i < layers.size(); i++) {
+				paintLayer(*layers[i], *s);
+			}
+		} else {
+			for (size_t i = bottom; i < layers.size(); i++) {
+				paintLayer(*layers[i], *s);
+			}
+		}
+	}
+	s->clearClipRect();
+	{
+		Profiler::Timer timer(Profiler::FLIP);
+		s->flip(rects);
+	}
+}
+
 void GMenu2X::explorer() {
 	FileDialog fd(*this, tr["Select an application"], "sh,bin,py,elf,");
 	if (fd.exec()) {
@@ -673,6 +821,16 @@ void GMenu2X::queueLaunch(
 	layers.push_back(launchLayer);
 }
 
+void GMenu2X::updatePerfOverlay() {
+	if (confInt["perfOverlay"] && !perfOverlay) {
+		perfOverlay = make_shared<PerfOverlay>(*this);
+		layers.push_back(perfOverlay);
+	} else if (!confInt["perfOverlay"] && perfOverlay) {
+		perfOverlay->close();
+		perfOverlay.reset();
+	}
+}
+
 void GMenu2X::showHelpPopup() {
 	layers.push_back(make_shared<HelpPopup>(*this));
 }
@@ -726,6 +884,14 @@ void GMenu2X::showSettings() {
 			*this, tr["Button repeat rate"],
 			tr["Set button repetitions per second"],
 			&confInt["buttonRepeatRate"], 0, 20)));
+	sd.addSetting(unique_ptr<MenuSetting>(new MenuSettingInt(
+			*this, tr["Animation frame rate"],
+			tr["Set how many frames per second animations are drawn at"],
+			&confInt["frameRate"], 10, 60)));
+	sd.addSetting(unique_ptr<MenuSetting>(new MenuSettingBool(
+			*this, tr["Performance overlay"],
+			tr["Show how long drawing the menu takes"],
+			&confInt["perfOverlay"])));
 
 	if (sd.exec()) {
 #ifdef ENABLE_CPUFREQ
@@ -735,6 +901,8 @@ void GMenu2X::showSettings() {
 		powerSaver.setScreenTimeout(confInt["backlightTimeout"]);
 
 		input.repeatRateChanged();
+		frames.setFrameRate(confInt["frameRate"]);
+		updatePerfOverlay();
 
 		if (lang == "English") lang = "";
 		if (lang != tr.lang()) {
@@ -834,16 +1002,28 @@ void GMenu2X::setSkin(const string &skin, bool setWallpaper) {
 	evalIntConf(skinConfInt, "bottomBarHeight", 20, 20, 120);
 	evalIntConf(skinConfInt, "linkHeight", 50, 32, 120);
 	evalIntConf(skinConfInt, "linkWidth", 80, 32, 120);
+	updateSkinLayout();
 
 	if (menu != NULL) menu->skinUpdated();
 
 	//Selection png
-	useSelectionPng = sc.addSkinRes("imgs/selection.png", false) != NULL;
+	selectionPng = sc.addSkinRes("imgs/selection.png", false);
 
 	//font
 	initFont();
 }
 
+void GMenu2X::updateSkinLayout() {
+	layout.topBarHeight = skinConfInt["topBarHeight"];
+	layout.bottomBarHeight = skinConfInt["bottomBarHeight"];
+	layout.linkWidth = skinConfInt["linkWidth"];
+	layout.linkHeight = skinConfInt["linkHeight"];
+	layout.linkColumns = (resX - 10) / layout.linkWidth;
+	layout.linkRows = (resY - 35 - layout.topBarHeight) / layout.linkHeight;
+	auto it = skinConfInt.find("fontsize");
+	layout.fontSize = it == skinConfInt.end() ? 0 : max(it->second, 0);
+}
+
 bool GMenu2X::readSkinConfig(const string& conffile)
 {
 	ifstream skinconf(conffile.c_str(), ios_base::in);
@@ -1075,7 +1255,7 @@ int GMenu2X::drawButtonRight(Surface& s, const string &btn, const string &text,
 	return x - w;
 }
 
-void GMenu2X::drawScrollBar(uint pageSize, uint totalSize, uint pagePos) {
+void GMenu2X::drawScrollBar(Surface& s, uint pageSize, uint totalSize, uint pagePos) {
 	if (totalSize <= pageSize) {
 		// Everything fits on one screen, no scroll bar needed.
 		return;
@@ -1086,33 +1266,33 @@ void GMenu2X::drawScrollBar(uint pageSize, uint totalSize, uint pagePos) {
 	top += 1;
 	height -= 2;
 
-	s->rectangle(resX - 8, top, 7, height, skinConfColors[COLOR_SELECTION_BG]);
+	s.rectangle(resX - 8, top, 7, height, skinConfColors[COLOR_SELECTION_BG]);
 	top += 2;
 	height -= 4;
 
 	const uint barSize = max(height * pageSize / totalSize, 4u);
 	const uint barPos = (height - barSize) * pagePos / (totalSize - pageSize);
 
-	s->box(resX - 6, top + barPos, 3, barSize,
+	s.box(resX - 6, top + barPos, 3, barSize,
 			skinConfColors[COLOR_SELECTION_BG]);
 }
 
 void GMenu2X::drawTopBar(Surface& s) {
-	Surface *bar = sc.skinRes("imgs/topbar.png", false);
+	auto bar = sc.skinRes("imgs/topbar.png", false);
 	if (bar) {
 		bar->blit(s, 0, 0);
 	} else {
-		const int h = skinConfInt["topBarHeight"];
+		const int h = layout.topBarHeight;
 		s.box(0, 0, resX, h, skinConfColors[COLOR_TOP_BAR_BG]);
 	}
 }
 
 void GMenu2X::drawBottomBar(Surface& s) {
-	Surface *bar = sc.skinRes("imgs/bottombar.png", false);
+	auto bar = sc.skinRes("imgs/bottombar.png", false);
 	if (bar) {
 		bar->blit(s, 0, resY-bar->height());
 	} else {
-		const int h = skinConfInt["bottomBarHeight"];
+		const int h = layout.bottomBarHeight;
 		s.box(0, resY - h, resX, h, skinConfColors[COLOR_BOTTOM_BAR_BG]);
 	}
 }
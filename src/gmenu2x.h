@@ -22,9 +22,12 @@
 #define GMENU2X_H
 
 #include "contextmenu.h"
+#include "framescheduler.h"
 #include "surfacecollection.h"
+#include "thumbnailcache.h"
 #include "translator.h"
 #include "inputmanager.h"
+#include "listingcache.h"
 #include "powersaver.h"
 #include "surface.h"
 #include "utilities.h"
@@ -35,6 +38,7 @@
 #include <vector>
 
 class Button;
+class DirtyRegion;
 class Font;
 class HelpPopup;
 class IconButton;
@@ -42,6 +46,7 @@ class Launcher;
 class Layer;
 class MediaMonitor;
 class Menu;
+class PerfOverlay;
 
 #ifndef GMENU2X_SYSTEM_DIR
 #define GMENU2X_SYSTEM_DIR "/usr/share/gmenu2x"
@@ -67,6 +72,19 @@ enum color {
 	NUM_COLORS,
 };
 
+/**
+ * The numeric skin settings, resolved once when the skin is loaded so the
+ * painting code doesn't have to look them up by name.
+ */
+struct SkinLayout {
+	int topBarHeight = 0, bottomBarHeight = 0;
+	int linkWidth = 0, linkHeight = 0;
+	/** Number of links that fit on the screen next to and below each other. */
+	int linkColumns = 0, linkRows = 0;
+	/** Size of the skin font, or 0 if the skin doesn't set it. */
+	unsigned int fontSize = 0;
+};
+
 class GMenu2X {
 private:
 	std::shared_ptr<Menu> menu;
@@ -77,6 +95,25 @@ private:
 	std::unique_ptr<Launcher> toLaunch;
 
 	std::vector<std::shared_ptr<Layer>> layers;
+	std::shared_ptr<PerfOverlay> perfOverlay;
+
+	SkinLayout layout;
+	void updateSkinLayout();
+
+	FrameScheduler frames;
+
+	/** The layers below the topmost modal layer, as painted last. */
+	std::unique_ptr<OffscreenSurface> snapshot;
+	/** The snapshot with the backdrop of the topmost modal layer on top. */
+	std::unique_ptr<OffscreenSurface> backdrop;
+	/** The modal layer the backdrop was painted for. */
+	std::weak_ptr<Layer> backdropOwner;
+
+	/**
+	 * Collects the damage of all layers and repaints the damaged parts of
+	 * the screen.
+	 */
+	void paintLayers(DirtyRegion& damage);
 
 	/*!
 	Retrieves the free disk space on the sd
@@ -104,8 +141,7 @@ private:
 		samba,
 		web;
 
-	std::string ip, defaultgw, lastSelectorDir;
-	int lastSelectorElement;
+	std::string ip, defaultgw, lastSelectorFile, lastSelectorDir;
 	void readConfig();
 	void readConfig(std::string path);
 	void readTmp();
@@ -114,6 +150,8 @@ private:
 	void initFont();
 	void initMenu();
 	void initBG();
+	/** Shows or hides the performance overlay, as configured. */
+	void updatePerfOverlay();
 
 public:
 	static void run();
@@ -125,6 +163,10 @@ public:
 	 * ~/.gmenu2x */
 	static const std::string getHome();
 
+	/* Returns the directory where gmenu2x keeps data that can be
+	 * regenerated at any time, usually ~/.gmenu2x/cache */
+	static const std::string getCacheDir();
+
 	/*
 	 * Variables needed for elements disposition
 	 */
@@ -137,11 +179,24 @@ public:
 	 * Gets the position and height of the area between the top and bottom bars.
 	 */
 	std::pair<unsigned int, unsigned int> getContentArea() {
-		const unsigned int top = skinConfInt["topBarHeight"];
-		const unsigned int bottom = skinConfInt["bottomBarHeight"];
+		const unsigned int top = layout.topBarHeight;
+		const unsigned int bottom = layout.bottomBarHeight;
 		return std::make_pair(top, resY - top - bottom);
 	}
 
+	/**
+	 * Gets the layout of the current skin. It changes only when another skin
+	 * is selected; edits of skinConfInt are not reflected.
+	 */
+	SkinLayout const& getSkinLayout() const {
+		return layout;
+	}
+
+	/** Gets the scheduler that paces the frames of animations. */
+	FrameScheduler const& getFrameScheduler() const {
+		return frames;
+	}
+
 	PowerSaver powerSaver;
 	InputManager input;
 
@@ -151,11 +206,19 @@ public:
 	RGBAColor skinConfColors[NUM_COLORS];
 
 	//Configuration settings
-	bool useSelectionPng;
+	/**
+	 * The selection image of the skin, or nullptr if it has none. Held here
+	 * so the image collection cannot drop it.
+	 */
+	std::shared_ptr<OffscreenSurface> selectionPng;
 	void setSkin(const std::string &skin, bool setWallpaper = true);
 	bool readSkinConfig(const std::string& conffile);
 
 	SurfaceCollection sc;
+	/** Shrunk images for the browsers of wallpapers, screenshots and icons. */
+	ThumbnailCache thumbnails;
+	/** Listings of the directories opened in the file browsers. */
+	ListingCache listings;
 	Translator tr;
 	std::unique_ptr<OutputSurface> s;
 	/** Background with empty top and bottom bar. */
@@ -193,7 +256,8 @@ public:
 	void saveSelection();
 	void writeConfig();
 	void writeSkinConfig();
-	void writeTmp(int selelem=-1, const std::string &selectordir="");
+	void writeTmp(const std::string &selectorfile="",
+			const std::string &selectordir="");
 
 	void addLink();
 	void editLink();
@@ -203,7 +267,7 @@ public:
 
 	int drawButton(Surface& s, const std::string &btn, const std::string &text, int x=5, int y=-10);
 	int drawButtonRight(Surface& s, const std::string &btn, const std::string &text, int x=5, int y=-10);
-	void drawScrollBar(uint pageSize, uint totalSize, uint pagePos);
+	void drawScrollBar(Surface& s, uint pageSize, uint totalSize, uint pagePos);
 
 	void drawTopBar(Surface& s);
 	void drawBottomBar(Surface& s);
@@ -19,6 +19,8 @@ public:
 	// Layer implementation:
 	virtual void paint(Surface& s);
 	virtual bool handleButtonPress(InputManager::Button button);
+	virtual bool isModal() { return true; }
+	virtual Profiler::Phase getPaintPhase() { return Profiler::PAINT_POPUP; }
 
 private:
 	GMenu2X& gmenu2x;
@@ -26,6 +26,9 @@
 
 #include <SDL.h>
 
+#include <algorithm>
+#include <vector>
+
 //for browsing the filesystem
 #include <sys/stat.h>
 #include <sys/types.h>
@@ -33,10 +36,21 @@
 
 using namespace std;
 
+/** Number of files on either side of the selection whose previews are loaded
+  * ahead of time. */
+static const unsigned int PREVIEW_PREFETCH = 1;
+
 ImageDialog::ImageDialog(
 		GMenu2X& gmenu2x, const string &text,
 		const string &filter, const string &file)
 	: FileDialog(gmenu2x, text, filter, file, "Image Browser")
+	// Previews are shrunk to fit next to the file list, keeping their
+	// transparency.
+	, previews(2 * PREVIEW_PREFETCH + 2, [this](string const& path) {
+		return this->gmenu2x.thumbnails.load(path,
+				this->gmenu2x.resX / 2, this->gmenu2x.getContentArea().second,
+				true);
+	})
 {
 
 	string path;
@@ -50,14 +64,30 @@ ImageDialog::ImageDialog(
 }
 
 ImageDialog::~ImageDialog() {
-	previews.clear();
 }
 
-void ImageDialog::beforeFileList() {
-	if (fl.isFile(selected) && fileExists(getPath()+"/"+fl[selected]))
-		previews[getPath()+"/"+fl[selected]]->blitRight(*gmenu2x.s, 310, 43);
+string ImageDialog::previewPath(unsigned int i) {
+	return fl.isFile(i) ? getPath() + "/" + fl[i] : string();
 }
 
-void ImageDialog::onChangeDir() {
-	previews.clear();
+void ImageDialog::beforeFileList() {
+	vector<string> wanted;
+	for (unsigned int offset = 0; offset <= PREVIEW_PREFETCH; offset++) {
+		if (selected + offset < fl.size()) {
+			wanted.push_back(previewPath(selected + offset));
+		}
+		if (offset && selected >= offset) {
+			wanted.push_back(previewPath(selected - offset));
+		}
+	}
+	wanted.erase(remove(wanted.begin(), wanted.end(), string()), wanted.end());
+	previews.request(wanted);
+
+	// The loader sends a repaint event when the preview is ready.
+	if (fl.isFile(selected)) {
+		auto preview = previews.get(previewPath(selected));
+		if (preview) {
+			preview->blitRight(*gmenu2x.s, 310, 43);
+		}
+	}
 }
@@ -22,13 +22,13 @@
 #define IMAGEDIALOG_H
 
 #include "filedialog.h"
-#include "surfacecollection.h"
+#include "imageloader.h"
 
 #include <string>
 
 class ImageDialog : public FileDialog {
 protected:
-	SurfaceCollection previews;
+	ImageLoader previews;
 public:
 	ImageDialog(
 			GMenu2X& gmenu2x, const std::string &text,
@@ -36,7 +36,9 @@ public:
 	virtual ~ImageDialog();
 
 	virtual void beforeFileList();
-	virtual void onChangeDir();
+
+private:
+	std::string previewPath(unsigned int i);
 };
 
 #endif // IMAGEDIALOG_H
@@ -10,7 +10,9 @@
 
 #include <SDL.h>
 #include <png.h>
+#include <algorithm>
 #include <cassert>
+#include <vector>
 
 #ifdef HAVE_LIBOPK
 #include <opk.h>
@@ -24,74 +26,94 @@ static void __readFromOpk(png_structp png_ptr, png_bytep ptr, png_size_t length)
 }
 #endif
 
-SDL_Surface *loadPNG(const std::string &path, bool loadAlpha) {
-	// Declare these with function scope and initialize them to NULL,
-	// so we can use a single cleanup block at the end of the function.
-	SDL_Surface *surface = NULL;
+/**
+ * The resources of a PNG file that is being read.
+ * Everything is released when this goes out of scope.
+ */
+struct PNGFile {
 	FILE *fp = NULL;
 	png_structp png = NULL;
 	png_infop info = NULL;
 #ifdef HAVE_LIBOPK
-	std::string::size_type pos;
 	struct OPK *opk = NULL;
-	void *buffer = NULL, *param;
+	void *buffer = NULL, *param = NULL;
+#endif
+
+	~PNGFile() {
+		png_destroy_read_struct(&png, &info, NULL);
+		if (fp) fclose(fp);
+#ifdef HAVE_LIBOPK
+		if (buffer)
+			free(buffer);
+		if (opk)
+			opk_close(opk);
 #endif
+	}
+};
 
+/**
+ * Creates the libpng structs. Must be followed by a setjmp() on
+ * png_jmpbuf(file.png) in the caller before calling startPNG().
+ */
+static bool createPNG(PNGFile& file)
+{
 	// Create and initialize the top-level libpng struct.
-	png = png_create_read_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
-	if (!png) goto cleanup;
+	file.png = png_create_read_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+	if (!file.png) return false;
 	// Create and initialize the image information struct.
-	info = png_create_info_struct(png);
-	if (!info) goto cleanup;
-	// Setup error handling for errors detected by libpng.
-	if (setjmp(png_jmpbuf(png))) {
-		// Note: This gets executed when an error occurs.
-		if (surface) {
-			SDL_FreeSurface(surface);
-			surface = NULL;
-		}
-		goto cleanup;
-	}
+	file.info = png_create_info_struct(file.png);
+	return file.info != NULL;
+}
+
+/**
+ * Opens the given image and sets up libpng to produce rows of 8-bit ARGB
+ * pixels, in native byte order.
+ * Returns false if the image could not be opened or is too large.
+ */
+static bool startPNG(PNGFile& file, const std::string &path,
+		png_uint_32& width, png_uint_32& height)
+{
+	png_structp png = file.png;
+	png_infop info = file.info;
 
 #ifdef HAVE_LIBOPK
-	pos = path.find('#');
+	std::string::size_type pos = path.find('#');
 	if (pos != path.npos) {
 		int ret;
 		size_t length;
 
 		DEBUG("Registering specific callback for icon %s\n", path.c_str());
 
-		opk = opk_open(path.substr(0, pos).c_str());
-		if (!opk) {
+		file.opk = opk_open(path.substr(0, pos).c_str());
+		if (!file.opk) {
 			ERROR("Unable to open OPK\n");
-			goto cleanup;
+			return false;
 		}
 
-		ret = opk_extract_file(opk, path.substr(pos + 1).c_str(),
-					&buffer, &length);
+		ret = opk_extract_file(file.opk, path.substr(pos + 1).c_str(),
+					&file.buffer, &length);
 		if (ret < 0) {
 			ERROR("Unable to extract icon from OPK\n");
-			goto cleanup;
+			return false;
 		}
 
-		param = buffer;
+		file.param = file.buffer;
 
-		png_set_read_fn(png, &param, __readFromOpk);
+		png_set_read_fn(png, &file.param, __readFromOpk);
 	} else {
 #else
 	if (1) {
 #endif /* HAVE_LIBOPK */
-		fp = fopen(path.c_str(), "rb");
-		if (!fp) goto cleanup;
+		file.fp = fopen(path.c_str(), "rb");
+		if (!file.fp) return false;
 
 		// Set up the input control if you are using standard C streams.
-		png_init_io(png, fp);
+		png_init_io(png, file.fp);
 	}
 
 	// The call to png_read_info() gives us all of the information from the
 	// PNG file before the first IDAT (image data chunk).
 	png_read_info(png, info);
-	png_uint_32 width, height;
 	int bitDepth, colorType;
 	png_get_IHDR(
 		png, info, &width, &height, &bitDepth, &colorType, NULL, NULL, NULL);
@@ -116,6 +138,8 @@ SDL_Surface *loadPNG(const std::string &path, bool loadAlpha) {
 	} else {
 		png_set_bgr(png); // BGRA in memory becomes ARGB in register
 	}
+	// - let libpng merge the passes of interlaced images
+	png_set_interlace_handling(png);
 
 	// Update the image info to the post-conversion state.
 	png_read_update_info(png, info);
@@ -127,13 +151,34 @@ SDL_Surface *loadPNG(const std::string &path, bool loadAlpha) {
 	// Refuse to load outrageously large images.
 	if (width > 65536) {
 		WARNING("Refusing to load image because it is too wide\n");
-		goto cleanup;
+		return false;
 	}
 	if (height > 2048) {
 		WARNING("Refusing to load image because it is too high\n");
-		goto cleanup;
+		return false;
+	}
+	return true;
+}
+
+SDL_Surface *loadPNG(const std::string &path, bool loadAlpha) {
+	// Declare these before the setjmp, so the error handler can free them.
+	SDL_Surface *surface = NULL;
+	PNGFile file;
+	std::vector<png_bytep> rowPointers;
+
+	if (!createPNG(file)) return NULL;
+	// Setup error handling for errors detected by libpng.
+	if (setjmp(png_jmpbuf(file.png))) {
+		// Note: This gets executed when an error occurs.
+		if (surface) {
+			SDL_FreeSurface(surface);
+		}
+		return NULL;
 	}
 
+	png_uint_32 width, height;
+	if (!startPNG(file, path, width, height)) return NULL;
+
 	// Allocate [A]RGB surface to hold the image.
 	surface = SDL_CreateRGBSurface(
 		SDL_SWSURFACE | SDL_SRCALPHA, width, height, 32,
@@ -141,37 +186,279 @@ SDL_Surface *loadPNG(const std::string &path, bool loadAlpha) {
 		);
 	if (!surface) {
 		// Failed to create surface, probably out of memory.
-		goto cleanup;
+		return NULL;
 	}
 
-	// Note: GCC 4.9 doesn't want to jump over 'rowPointers' with goto
-	//       if it is in the outer scope.
-	{
-		// Compute row pointers.
-		png_bytep rowPointers[height];
-		for (png_uint_32 y = 0; y < height; y++) {
-			rowPointers[y] =
-				static_cast<png_bytep>(surface->pixels) + y * surface->pitch;
-		}
-
-		// Read the entire image in one go.
-		png_read_image(png, rowPointers);
+	// Compute row pointers.
+	rowPointers.resize(height);
+	for (png_uint_32 y = 0; y < height; y++) {
+		rowPointers[y] =
+			static_cast<png_bytep>(surface->pixels) + y * surface->pitch;
 	}
 
+	// Read the entire image in one go.
+	png_read_image(file.png, &rowPointers[0]);
+
 	// Read rest of file, and get additional chunks in the info struct.
 	// Note: We got all we need, so skip this step.
 	//png_read_end(png, info);
 
-cleanup:
-	// Clean up.
-	png_destroy_read_struct(&png, &info, NULL);
-	if (fp) fclose(fp);
-#ifdef HAVE_LIBOPK
-	if (buffer)
-		free(buffer);
-	if (opk)
-		opk_close(opk);
-#endif
+	return surface;
+}
+
+/* 4x4 ordered dithering matrix. */
+static const Uint8 bayer[4][4] = {
+	{  0,  8,  2, 10 },
+	{ 12,  4, 14,  6 },
+	{  3, 11,  1,  9 },
+	{ 15,  7, 13,  5 },
+};
+
+static inline Uint32 reduce(Uint32 component, Uint8 loss, Uint8 threshold)
+{
+	// Adding a threshold that is uniformly distributed over [0, 2^loss)
+	// makes the truncation below correct on average.
+	const Uint32 max = 0xFF >> loss;
+	return std::min<Uint32>((component + (threshold << loss >> 4)) >> loss, max);
+}
+
+/**
+ * Converts a row of ARGB pixels to the given pixel format. Alpha is kept
+ * only if the format has an alpha channel; it is never dithered.
+ */
+static void convertRow(Uint32 const *argb, int width, Uint8 *dst,
+		SDL_PixelFormat const *format, int y, bool dither)
+{
+	Uint8 const *thresholds = bayer[y & 3];
+	for (int x = 0; x < width; x++) {
+		const Uint8 t = dither ? thresholds[x & 3] : 0;
+		const Uint32 c = argb[x];
+		const Uint32 pixel =
+			  (reduce((c >> 16) & 0xFF, format->Rloss, t) << format->Rshift)
+			| (reduce((c >>  8) & 0xFF, format->Gloss, t) << format->Gshift)
+			| (reduce( c        & 0xFF, format->Bloss, t) << format->Bshift)
+			| (format->Amask
+				? reduce(c >> 24, format->Aloss, 0) << format->Ashift : 0);
+		if (format->BytesPerPixel == 2) {
+			reinterpret_cast<Uint16 *>(dst)[x] = pixel;
+		} else {
+			reinterpret_cast<Uint32 *>(dst)[x] = pixel;
+		}
+	}
+}
+
+static SDL_PixelFormat makeARGBFormat()
+{
+	SDL_PixelFormat format = {};
+	format.BitsPerPixel = 32;
+	format.BytesPerPixel = 4;
+	format.Rshift = 16;
+	format.Gshift = 8;
+	format.Bshift = 0;
+	format.Ashift = 24;
+	format.Rmask = 0x00FF0000;
+	format.Gmask = 0x0000FF00;
+	format.Bmask = 0x000000FF;
+	format.Amask = 0xFF000000;
+	format.alpha = SDL_ALPHA_OPAQUE;
+	return format;
+}
+
+SDL_PixelFormat const *argbPixelFormat() {
+	static const SDL_PixelFormat format = makeARGBFormat();
+	return &format;
+}
+
+bool readPNGSize(const std::string &path,
+		unsigned int& width, unsigned int& height) {
+	PNGFile file;
+	if (!createPNG(file)) return false;
+	// Setup error handling for errors detected by libpng.
+	if (setjmp(png_jmpbuf(file.png))) {
+		return false;
+	}
+
+	png_uint_32 w, h;
+	if (!startPNG(file, path, w, h)) return false;
+	width = w;
+	height = h;
+	return true;
+}
+
+/**
+ * Loads the columns [left, left + cropWidth) of a PNG file, converting and
+ * shrinking them as described for loadPNGConverted().
+ * A cropWidth of 0 selects all columns right of left.
+ */
+static SDL_Surface *loadConverted(const std::string &path,
+		SDL_PixelFormat const *format, unsigned int left,
+		unsigned int cropWidth, unsigned int maxWidth,
+		unsigned int maxHeight, bool dither) {
+	if (format->BytesPerPixel != 2 && format->BytesPerPixel != 4) {
+		// Rare formats go through the generic conversion.
+		SDL_Surface *full = loadPNG(path, format->Amask != 0);
+		if (!full) return NULL;
+		SDL_Surface *converted;
+		if (left || cropWidth) {
+			SDL_Rect area;
+			area.x = std::min<unsigned int>(left, full->w);
+			area.y = 0;
+			area.w = std::min<unsigned int>(
+					cropWidth ? cropWidth : full->w, full->w - area.x);
+			area.h = full->h;
+			converted = SDL_CreateRGBSurface(SDL_SWSURFACE,
+					std::max<int>(area.w, 1), area.h, format->BitsPerPixel,
+					format->Rmask, format->Gmask, format->Bmask,
+					format->Amask);
+			if (converted) {
+				SDL_BlitSurface(full, &area, converted, NULL);
+			}
+		} else {
+			converted = SDL_ConvertSurface(
+					full, const_cast<SDL_PixelFormat *>(format), SDL_SWSURFACE);
+		}
+		SDL_FreeSurface(full);
+		return converted;
+	}
+
+	// Declare these before the setjmp, so the error handler can free them.
+	SDL_Surface *surface = NULL;
+	PNGFile file;
+	std::vector<Uint32> image, row, scaled;
+	std::vector<Uint64> sums;
+	std::vector<png_bytep> rowPointers;
+
+	if (!createPNG(file)) return NULL;
+	// Setup error handling for errors detected by libpng.
+	if (setjmp(png_jmpbuf(file.png))) {
+		// Note: This gets executed when an error occurs.
+		if (surface) {
+			SDL_FreeSurface(surface);
+		}
+		return NULL;
+	}
+
+	png_uint_32 width, height;
+	if (!startPNG(file, path, width, height)) return NULL;
+
+	// Only the selected columns are converted; the rest of each row is
+	// decoded and thrown away.
+	left = std::min<unsigned int>(left, width);
+	if (!cropWidth || cropWidth > width - left) {
+		cropWidth = width - left;
+	}
+	if (!cropWidth) {
+		WARNING("No columns of the image selected\n");
+		return NULL;
+	}
+
+	// Pick the smallest integer factor that makes the image fit.
+	unsigned int scale = 1;
+	if (maxWidth) {
+		scale = std::max<unsigned int>(scale, (cropWidth + maxWidth - 1) / maxWidth);
+	}
+	if (maxHeight) {
+		scale = std::max<unsigned int>(scale, (height + maxHeight - 1) / maxHeight);
+	}
+	const int outWidth = std::max<int>(cropWidth / scale, 1);
+	const int outHeight = std::max<int>(height / scale, 1);
+
+	// Dithering is pointless if no precision is lost.
+	dither = dither && (format->Rloss || format->Gloss || format->Bloss);
+	const bool alpha = format->Amask != 0;
+
+	surface = SDL_CreateRGBSurface(SDL_SWSURFACE, outWidth, outHeight,
+			format->BitsPerPixel,
+			format->Rmask, format->Gmask, format->Bmask, format->Amask);
+	if (!surface) {
+		// Failed to create surface, probably out of memory.
+		return NULL;
+	}
+
+	{
+		const bool interlaced =
+				png_get_interlace_type(file.png, file.info) != PNG_INTERLACE_NONE;
+		// Interlaced images can't be read row by row, since the last pass
+		// completes the first row. Those are rare, so decode them entirely.
+		if (interlaced) {
+			image.resize(width * height);
+			rowPointers.resize(height);
+			for (png_uint_32 y = 0; y < height; y++) {
+				rowPointers[y] = reinterpret_cast<png_bytep>(&image[y * width]);
+			}
+			png_read_image(file.png, &rowPointers[0]);
+		} else {
+			row.resize(width);
+		}
+
+		// When downscaling, average each block of scale x scale pixels.
+		// With alpha, the colours are weighted by it, so fully transparent
+		// pixels don't bleed their colour into the edges of the shape.
+		if (scale > 1) {
+			sums.resize(outWidth * 4);
+			scaled.resize(outWidth);
+		}
+		const Uint64 area = Uint64(scale) * scale;
+
+		const int inHeight = outHeight * scale;
+		for (int y = 0; y < inHeight; y++) {
+			Uint32 const *argb;
+			if (interlaced) {
+				argb = &image[y * width + left];
+			} else {
+				png_read_row(file.png, reinterpret_cast<png_bytep>(&row[0]), NULL);
+				argb = &row[left];
+			}
+
+			if (scale == 1) {
+				convertRow(argb, outWidth,
+						static_cast<Uint8 *>(surface->pixels) + y * surface->pitch,
+						format, y, dither);
+				continue;
+			}
+
+			for (int x = 0; x < outWidth; x++) {
+				Uint64 *sum = &sums[x * 4];
+				for (unsigned int i = 0; i < scale; i++) {
+					const Uint32 c = argb[x * scale + i];
+					const Uint32 weight = alpha ? c >> 24 : 1;
+					sum[0] += ((c >> 16) & 0xFF) * weight;
+					sum[1] += ((c >>  8) & 0xFF) * weight;
+					sum[2] += ( c        & 0xFF) * weight;
+					sum[3] += c >> 24;
+				}
+			}
+			if ((y + 1) % scale == 0) {
+				const int outY = y / scale;
+				for (int x = 0; x < outWidth; x++) {
+					Uint64 const *sum = &sums[x * 4];
+					const Uint64 total = alpha ? sum[3] : area;
+					scaled[x] = !total ? 0
+					          : Uint32(sum[3] / area) << 24
+					          | Uint32(sum[0] / total) << 16
+					          | Uint32(sum[1] / total) << 8
+					          | Uint32(sum[2] / total);
+				}
+				std::fill(sums.begin(), sums.end(), 0);
+				convertRow(&scaled[0], outWidth,
+						static_cast<Uint8 *>(surface->pixels) + outY * surface->pitch,
+						format, outY, dither);
+			}
+		}
+	}
 
+	// The rows below the last full block, if any, are not needed.
 	return surface;
 }
+
+SDL_Surface *loadPNGConverted(const std::string &path,
+		SDL_PixelFormat const *format, unsigned int maxWidth,
+		unsigned int maxHeight, bool dither) {
+	return loadConverted(path, format, 0, 0, maxWidth, maxHeight, dither);
+}
+
+SDL_Surface *loadPNGColumns(const std::string &path,
+		SDL_PixelFormat const *format, unsigned int left,
+		unsigned int width, bool dither) {
+	return loadConverted(path, format, left, width, 0, 0, dither);
+}
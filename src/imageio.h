@@ -3,10 +3,44 @@
 
 #include <string>
 
+struct SDL_PixelFormat;
 struct SDL_Surface;
 
 /** Loads an image from a PNG file into a newly allocated 32bpp RGBA surface.
   */
 SDL_Surface *loadPNG(const std::string &path, bool loadAlpha = true);
 
+/** Loads an image from a PNG file into a newly allocated surface in the given
+  * pixel format. The alpha channel is kept only if the format has one.
+  * Each row is converted as soon as it is decoded, so the full image is never
+  * held in 32bpp.
+  * If a maximum size is given, the image is shrunk by the smallest integer
+  * factor that makes it fit.
+  * If "dither" is true and the format has less than 8 bits per component,
+  * ordered dithering is applied.
+  */
+SDL_Surface *loadPNGConverted(const std::string &path,
+		SDL_PixelFormat const *format, unsigned int maxWidth = 0,
+		unsigned int maxHeight = 0, bool dither = true);
+
+/** Loads the columns [left, left + width) of a PNG file like
+  * loadPNGConverted() does. Every row still has to be decoded, but only the
+  * selected part of it is kept, so a strip of pages can be loaded page by
+  * page.
+  */
+SDL_Surface *loadPNGColumns(const std::string &path,
+		SDL_PixelFormat const *format, unsigned int left, unsigned int width,
+		bool dither = true);
+
+/** Returns the 32bpp ARGB pixel format, for loading images with their
+  * alpha channel through the functions above.
+  */
+SDL_PixelFormat const *argbPixelFormat();
+
+/** Reads the size of the image in a PNG file without decoding it.
+  * Returns false if the file is not a PNG file that could be loaded.
+  */
+bool readPNGSize(const std::string &path,
+		unsigned int& width, unsigned int& height);
+
 #endif
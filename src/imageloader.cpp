@@ -0,0 +1,128 @@
+// Various authors.
+// License: GPL version 2 or later.
+
+#include "imageloader.h"
+
+#include "surface.h"
+#include "utilities.h"
+
+#include <algorithm>
+
+using namespace std;
+
+static unique_ptr<OffscreenSurface> loadOpaqueImage(string const& path)
+{
+	return OffscreenSurface::loadImageForDisplay(path);
+}
+
+ImageLoader::ImageLoader(unsigned int capacity, LoadFunction load)
+	: load(load ? load : loadOpaqueImage)
+	, capacity(max(capacity, 1u))
+	, quit(false)
+	, thread(&ImageLoader::run, this)
+{
+}
+
+ImageLoader::~ImageLoader()
+{
+	{
+		lock_guard<mutex> lock(queueMutex);
+		quit = true;
+	}
+	wakeUp.notify_one();
+	thread.join();
+}
+
+void ImageLoader::request(vector<string> const& keys)
+{
+	{
+		lock_guard<mutex> lock(queueMutex);
+
+		queue.clear();
+		wanted = keys.empty() ? string() : keys.front();
+
+		// Walk backwards so the first key ends up as the most recently used.
+		for (auto key = keys.rbegin(); key != keys.rend(); ++key) {
+			auto it = cache.find(*key);
+			if (it == cache.end()) {
+				queue.push_front(*key);
+			} else {
+				cacheOrder.splice(
+						cacheOrder.begin(), cacheOrder, it->second.lru);
+			}
+		}
+		if (queue.empty()) {
+			return;
+		}
+	}
+	wakeUp.notify_one();
+}
+
+shared_ptr<OffscreenSurface> ImageLoader::get(string const& key)
+{
+	lock_guard<mutex> lock(queueMutex);
+
+	auto it = cache.find(key);
+	if (it == cache.end()) {
+		return nullptr;
+	}
+
+	Entry& entry = it->second;
+	cacheOrder.splice(cacheOrder.begin(), cacheOrder, entry.lru);
+	if (entry.surface && !entry.converted) {
+		// Converting needs the video surface, so do it on this thread.
+		if (entry.surface->hasAlpha()) {
+			entry.surface->convertToDisplayFormatAlpha();
+		} else {
+			entry.surface->convertToDisplayFormat();
+		}
+		entry.converted = true;
+	}
+	return entry.surface;
+}
+
+bool ImageLoader::isLoaded(string const& key)
+{
+	lock_guard<mutex> lock(queueMutex);
+	return cache.find(key) != cache.end();
+}
+
+void ImageLoader::evict()
+{
+	while (cache.size() > capacity) {
+		cache.erase(cacheOrder.back());
+		cacheOrder.pop_back();
+	}
+}
+
+void ImageLoader::run()
+{
+	unique_lock<mutex> lock(queueMutex);
+	for (;;) {
+		wakeUp.wait(lock, [this] { return quit || !queue.empty(); });
+		if (quit) {
+			break;
+		}
+
+		string key = queue.front();
+		queue.pop_front();
+		if (cache.find(key) != cache.end()) {
+			continue;
+		}
+
+		lock.unlock();
+		shared_ptr<OffscreenSurface> surface(load(key));
+		lock.lock();
+
+		// A missing image is cached as well, so it is not looked for again.
+		cacheOrder.push_front(key);
+		cache[key] = Entry { move(surface), false, cacheOrder.begin() };
+		evict();
+
+		if (key == wanted) {
+			lock.unlock();
+			inject_user_event();
+			lock.lock();
+		}
+	}
+}
@@ -0,0 +1,93 @@
+// Various authors.
+// License: GPL version 2 or later.
+
+#ifndef IMAGELOADER_H
+#define IMAGELOADER_H
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+class OffscreenSurface;
+
+/**
+ * Loads images on a background thread and keeps the most recently used ones
+ * in a small cache, so a dialog can show images without ever waiting for
+ * disk I/O or decoding.
+ * When the image that was requested first becomes available, a repaint event
+ * is sent to wake up the dialog.
+ */
+class ImageLoader {
+public:
+	/**
+	 * Produces the image for the given key, or nullptr if there is none.
+	 * Runs on the background thread.
+	 */
+	typedef std::function<
+			std::unique_ptr<OffscreenSurface>(std::string const&)> LoadFunction;
+
+	/**
+	 * Creates a loader that keeps up to 'capacity' images.
+	 * The default load function reads a PNG file without its alpha channel,
+	 * straight into the pixel format of the frame buffer.
+	 */
+	ImageLoader(unsigned int capacity, LoadFunction load = LoadFunction());
+	~ImageLoader();
+
+	/**
+	 * Replaces the list of images that should be loaded. The first key is
+	 * the one that is needed right now, the others are loaded afterwards
+	 * in the given order. Previously requested images that have not been
+	 * loaded yet and that are not in the new list are dropped.
+	 */
+	void request(std::vector<std::string> const& keys);
+
+	/**
+	 * Returns the image for the given key if it has been loaded, or nullptr
+	 * if it is not available (yet). Never blocks on I/O.
+	 * The image is converted for fast blitting, keeping its alpha channel
+	 * if it has one.
+	 */
+	std::shared_ptr<OffscreenSurface> get(std::string const& key);
+
+	/**
+	 * Returns true iff loading of the given key has finished, regardless
+	 * of whether an image was found.
+	 */
+	bool isLoaded(std::string const& key);
+
+private:
+	struct Entry {
+		std::shared_ptr<OffscreenSurface> surface;
+		bool converted;
+		std::list<std::string>::iterator lru;
+	};
+
+	void run();
+	void evict();
+
+	LoadFunction load;
+	unsigned int capacity;
+
+	std::mutex queueMutex;
+	std::condition_variable wakeUp;
+	bool quit;
+	/** Keys waiting to be loaded, most urgent first. */
+	std::deque<std::string> queue;
+	/** The key the UI is waiting for. */
+	std::string wanted;
+	std::unordered_map<std::string, Entry> cache;
+	/** Keys of the cache, most recently used first. */
+	std::list<std::string> cacheOrder;
+
+	std::thread thread;
+};
+
+#endif // IMAGELOADER_H
@@ -0,0 +1,108 @@
+// Various authors.
+// License: GPL version 2 or later.
+
+#include "imagemanualdialog.h"
+
+#include "font.h"
+#include "gmenu2x.h"
+#include "imageio.h"
+#include "imageloader.h"
+#include "surface.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+using namespace std;
+
+static const unsigned int PAGE_WIDTH = 320;
+/** Number of pages on either side of the current one that are kept loaded. */
+static const unsigned int PAGE_PREFETCH = 2;
+
+static string pageKey(unsigned int page)
+{
+	char key[16];
+	snprintf(key, sizeof(key), "%u", page);
+	return key;
+}
+
+ImageManualDialog::ImageManualDialog(GMenu2X& gmenu2x, const string &path)
+	: Dialog(gmenu2x)
+	, path(path)
+{
+}
+
+void ImageManualDialog::exec()
+{
+	unsigned int width, height;
+	if (!readPNGSize(path, width, height)) {
+		return;
+	}
+	const unsigned int pageCount = max(width / PAGE_WIDTH, 1u);
+	const string spagecount = pageKey(pageCount);
+
+	// Pages are cut out of the strip while decoding. They keep their alpha
+	// channel, so transparent areas show the background.
+	ImageLoader pages(2 * PAGE_PREFETCH + 1, [&](string const& key) {
+		return OffscreenSurface::loadImageColumns(
+				path, atoi(key.c_str()) * PAGE_WIDTH, PAGE_WIDTH);
+	});
+
+	bool close = false;
+	unsigned int page = 0;
+	while (!close) {
+		OutputSurface& s = *gmenu2x.s;
+
+		vector<string> wanted { pageKey(page) };
+		for (unsigned int offset = 1; offset <= PAGE_PREFETCH; offset++) {
+			if (page + offset < pageCount) {
+				wanted.push_back(pageKey(page + offset));
+			}
+			if (page >= offset) {
+				wanted.push_back(pageKey(page - offset));
+			}
+		}
+		pages.request(wanted);
+
+		gmenu2x.bg->blit(s, 0, 0);
+		auto image = pages.get(wanted.front());
+		if (image) {
+			image->blit(s, 0, 0);
+		}
+
+		gmenu2x.drawBottomBar(s);
+		int x = 5;
+		x = gmenu2x.drawButton(s, "left", "", x);
+		x = gmenu2x.drawButton(s, "right", gmenu2x.tr["Change page"], x);
+		x = gmenu2x.drawButton(s, "cancel", "", x);
+		x = gmenu2x.drawButton(s, "start", gmenu2x.tr["Exit"], x);
+		(void)x;
+
+		const string pageStatus = gmenu2x.tr["Page"] + ": "
+				+ pageKey(page + 1) + "/" + spagecount;
+		gmenu2x.font->write(s, pageStatus, 310, 230, Font::HAlignRight, Font::VAlignMiddle);
+
+		s.flip();
+
+		// The loader sends a repaint event when the page is ready.
+		switch (gmenu2x.input.waitForPressedButton()) {
+			case InputManager::SETTINGS:
+			case InputManager::CANCEL:
+				close = true;
+				break;
+			case InputManager::LEFT:
+				if (page > 0) {
+					page--;
+				}
+				break;
+			case InputManager::RIGHT:
+				if (page < pageCount - 1) {
+					page++;
+				}
+				break;
+			default:
+				break;
+		}
+	}
+}
@@ -0,0 +1,25 @@
+// Various authors.
+// License: GPL version 2 or later.
+
+#ifndef IMAGEMANUALDIALOG_H
+#define IMAGEMANUALDIALOG_H
+
+#include "dialog.h"
+
+#include <string>
+
+/**
+ * Shows a manual that is a PNG image with its pages next to each other.
+ * Only the page on screen and its neighbours are decoded, so large manuals
+ * open as fast as small ones.
+ */
+class ImageManualDialog : protected Dialog {
+public:
+	ImageManualDialog(GMenu2X& gmenu2x, const std::string &path);
+	void exec();
+
+private:
+	std::string path;
+};
+
+#endif // IMAGEMANUALDIALOG_H
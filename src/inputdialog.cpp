@@ -51,7 +51,7 @@ InputDialog::InputDialog(GMenu2X& gmenu2x, InputManager &inputMgr_,
 		this->text = text;
 	}
 	this->icon = "";
-	if (!icon.empty() && gmenu2x.sc[icon] != NULL) {
+	if (!icon.empty() && gmenu2x.sc[icon]) {
 		this->icon = icon;
 	}
 
@@ -264,6 +264,9 @@ bool InputManager::getButton(Button *button, bool wait) {
 								((string) (const char *) event.user.data1
 								 + "/apps").c_str());
 					break;
+				case PACKAGES_SCANNED:
+					menu->finishPackageScans();
+					break;
 #endif /* HAVE_LIBOPK */
 				case REPAINT_MENU:
 				default:
@@ -36,6 +36,7 @@ enum EventCode {
 	REMOVE_LINKS,
 	OPEN_PACKAGE,
 	OPEN_PACKAGES_FROM_DIR,
+	PACKAGES_SCANNED,
 	REPAINT_MENU,
 };
 
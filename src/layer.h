@@ -4,7 +4,9 @@
 #ifndef LAYER_H
 #define LAYER_H
 
+#include "dirtyregion.h"
 #include "inputmanager.h"
+#include "profiler.h"
 
 class Surface;
 
@@ -36,10 +38,81 @@ public:
 	 */
 	virtual bool handleButtonPress(InputManager::Button button) = 0;
 
+	/**
+	 * Returns true iff paint() covers the entire screen, so the layers below
+	 * this one don't have to be painted at all.
+	 */
+	virtual bool isOpaque() { return false; }
+
+	/**
+	 * Returns true iff the layers below this one are only a backdrop while
+	 * this layer is shown. The layers below the topmost modal layer are
+	 * painted once into a snapshot, which is reused for every frame until
+	 * one of those layers reports damage.
+	 */
+	virtual bool isModal() { return false; }
+
+	/**
+	 * Paints the effect a modal layer has on the layers below it, such as
+	 * darkening them. For the topmost modal layer this is painted into the
+	 * snapshot, so it is only painted again after invalidateBackdrop().
+	 */
+	virtual void paintBackdrop(Surface &) {}
+
+	/**
+	 * Returns the profiler phase under which painting this layer is timed.
+	 */
+	virtual Profiler::Phase getPaintPhase() { return Profiler::PAINT; }
+
 	Status getStatus() { return status; }
 
+	/**
+	 * Adds the areas this layer needs repainted to the given region and
+	 * forgets about them.
+	 * Only the dirty parts of the screen are repainted each frame, so a layer
+	 * must report every change to its appearance through invalidate().
+	 */
+	void takeDamage(DirtyRegion& region) {
+		region.add(damage);
+		damage.clear();
+	}
+
+	/**
+	 * Returns true iff the backdrop changed since the last call.
+	 */
+	bool takeBackdropDamage() {
+		const bool damaged = backdropDamaged;
+		backdropDamaged = false;
+		return damaged;
+	}
+
 protected:
-	Layer() {}
+	Layer() {
+		// A new layer has never been painted.
+		damage.addAll();
+	}
+
+	/**
+	 * Marks the given area as in need of a repaint.
+	 */
+	void invalidate(SDL_Rect rect) {
+		damage.add(rect);
+	}
+
+	/**
+	 * Marks the entire screen as in need of a repaint.
+	 */
+	void invalidate() {
+		damage.addAll();
+	}
+
+	/**
+	 * Marks the backdrop painted by paintBackdrop() as in need of a repaint.
+	 */
+	void invalidateBackdrop() {
+		backdropDamaged = true;
+		damage.addAll();
+	}
 
 	/**
 	 * Request the Layer to be removed from the stack.
@@ -52,6 +125,8 @@ protected:
 
 private:
 	Status status = Status::NORMAL;
+	DirtyRegion damage;
+	bool backdropDamaged = true;
 };
 
 #endif // LAYER_H
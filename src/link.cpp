@@ -37,30 +37,60 @@ Link::Link(GMenu2X& gmenu2x, Action action)
 	, action(action)
 	, lastTick(0)
 {
-	rect.w = gmenu2x.skinConfInt["linkWidth"];
-	rect.h = gmenu2x.skinConfInt["linkHeight"];
+	rect.x = rect.y = 0;
+	rect.w = gmenu2x.getSkinLayout().linkWidth;
+	rect.h = gmenu2x.getSkinLayout().linkHeight;
 	edited = false;
 	iconPath = gmenu2x.sc.getSkinFilePath("icons/generic.png");
-	iconX = 0;
-	padding = 0;
+	tileX = 0;
 
 	updateSurfaces();
 }
 
-void Link::paint() {
-	Surface& s = *gmenu2x.s;
+Link::~Link() {
+}
+
+void Link::paint(Surface& s) {
+	if (!tile) {
+		renderTile();
+	}
+	if (tile) {
+		tile->blit(s, rect.x + tileX, rect.y);
+	}
+}
+
+void Link::renderTile() {
+	Font& font = *gmenu2x.font;
+	const int linkHeight = gmenu2x.getSkinLayout().linkHeight;
+	const int padding = (linkHeight - 32 - font.getLineSpacing()) / 3;
+
+	// The title can be wider than the link; the tile covers both.
+	const int center = (rect.w - 32) / 2 + 16;
+	const int titleWidth = font.getTextWidth(title);
+	const int left = min(0, center - titleWidth / 2 - 1);
+	const int right = max<int>(rect.w, center - titleWidth / 2 + titleWidth + 1);
+
+	tile = OffscreenSurface::transparentSurface(right - left, linkHeight + 1);
+	if (!tile) {
+		return;
+	}
+	tileX = left;
 
 	if (iconSurface) {
-		iconSurface->blit(s, iconX, rect.y+padding, 32,32);
+		iconSurface->compose(*tile, center - 16 - left, padding, 32, 32);
 	}
-	gmenu2x.font->write(s, getTitle(), iconX+16, rect.y + gmenu2x.skinConfInt["linkHeight"]-padding, Font::HAlignCenter, Font::VAlignBottom);
+	font.compose(*tile, title, center - left, linkHeight - padding,
+			Font::HAlignCenter, Font::VAlignBottom);
+	tile->convertToDisplayFormatAlpha();
 }
 
-void Link::paintHover() {
-	Surface& s = *gmenu2x.s;
+void Link::invalidateTile() {
+	tile.reset();
+}
 
-	if (gmenu2x.useSelectionPng)
-		gmenu2x.sc["imgs/selection.png"]->blit(s, rect, Font::HAlignCenter, Font::VAlignMiddle);
+void Link::paintHover(Surface& s) {
+	if (gmenu2x.selectionPng)
+		gmenu2x.selectionPng->blit(s, rect, Font::HAlignCenter, Font::VAlignMiddle);
 	else
 		s.box(rect.x, rect.y, rect.w, rect.h, gmenu2x.skinConfColors[COLOR_SELECTION_BG]);
 }
@@ -68,6 +98,7 @@ void Link::paintHover() {
 void Link::updateSurfaces()
 {
 	iconSurface = gmenu2x.sc[getIconPath()];
+	invalidateTile();
 }
 
 const string &Link::getTitle() {
@@ -77,6 +108,7 @@ const string &Link::getTitle() {
 void Link::setTitle(const string &title) {
 	this->title = title;
 	edited = true;
+	invalidateTile();
 }
 
 const string &Link::getDescription() {
@@ -134,20 +166,16 @@ void Link::setIconPath(const string &icon) {
 }
 
 void Link::setSize(int w, int h) {
+	if (w != rect.w) {
+		invalidateTile();
+	}
 	rect.w = w;
 	rect.h = h;
-	recalcCoordinates();
 }
 
 void Link::setPosition(int x, int y) {
 	rect.x = x;
 	rect.y = y;
-	recalcCoordinates();
-}
-
-void Link::recalcCoordinates() {
-	iconX = rect.x+(rect.w-32)/2;
-	padding = (gmenu2x.skinConfInt["linkHeight"] - 32 - gmenu2x.font->getLineSpacing()) / 3;
 }
 
 void Link::run() {
@@ -24,10 +24,12 @@
 #include <SDL.h>
 
 #include <functional>
+#include <memory>
 #include <string>
 
 class GMenu2X;
 class OffscreenSurface;
+class Surface;
 
 
 /**
@@ -40,15 +42,23 @@ public:
 	typedef std::function<void(void)> Action;
 
 	Link(GMenu2X& gmenu2x, Action action);
-	virtual ~Link() {};
+	virtual ~Link();
 
-	virtual void paint();
-	void paintHover();
+	virtual void paint(Surface& s);
+	void paintHover(Surface& s);
+
+	/**
+	 * Discards the pre-rendered icon and title; they will be rendered again
+	 * when the link is painted next.
+	 */
+	void invalidateTile();
 
 	virtual void loadIcon();
 
 	void setSize(int w, int h);
 	void setPosition(int x, int y);
+	/** Returns the area the link was last painted in. */
+	SDL_Rect const& getRect() { return rect; }
 
 	const std::string &getTitle();
 	void setTitle(const std::string &title);
@@ -66,20 +76,24 @@ protected:
 	bool edited;
 	std::string title, description, launchMsg, icon, iconPath;
 
-	OffscreenSurface *iconSurface;
+	std::shared_ptr<OffscreenSurface> iconSurface;
 
 	virtual const std::string &searchIcon();
 	void setIconPath(const std::string &icon);
 	void updateSurfaces();
 
 private:
-	void recalcCoordinates();
+	void renderTile();
 
 	Action action;
 
 	SDL_Rect rect;
-	uint iconX, padding;
 	int lastTick;
+
+	/** The icon and the outlined title, composed on a transparent surface. */
+	std::unique_ptr<OffscreenSurface> tile;
+	/** Horizontal position of the tile relative to the link. */
+	int tileX;
 };
 
 #endif
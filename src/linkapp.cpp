@@ -22,11 +22,14 @@
 
 #include "debug.h"
 #include "gmenu2x.h"
+#include "imagemanualdialog.h"
 #include "launcher.h"
 #include "layer.h"
 #include "menu.h"
+#include "opkcache.h"
 #include "selector.h"
 #include "surface.h"
+#include "textbuffer.h"
 #include "textmanualdialog.h"
 #include "utilities.h"
 
@@ -48,10 +51,6 @@
 #include <opk.h>
 #endif
 
-#ifdef HAVE_LIBXDGMIME
-#include <xdgmime.h>
-#endif
-
 using namespace std;
 
 static array<const char *, 4> tokens = { "%f", "%F", "%u", "%U", };
@@ -72,19 +71,105 @@ public:
 		return true;
 	}
 
+	bool isModal() override {
+		return true;
+	}
+
+	void paintBackdrop(Surface &s) override {
+		//Darkened background
+		s.box(0, 0, s.width(), s.height(), 0,0,0,150);
+	}
+
 private:
 	LinkApp& app;
 };
 
 
-#ifdef HAVE_LIBOPK
-LinkApp::LinkApp(GMenu2X& gmenu2x, string const& linkfile, bool deletable,
-			struct OPK *opk, const char *metadata_)
-#else
 LinkApp::LinkApp(GMenu2X& gmenu2x, string const& linkfile, bool deletable)
-#endif
 	: Link(gmenu2x, bind(&LinkApp::start, this))
 	, deletable(deletable)
+{
+	LinkFields fields;
+	readFields(linkfile, fields);
+	init(linkfile, fields);
+}
+
+LinkApp::LinkApp(GMenu2X& gmenu2x, string const& linkfile, bool deletable,
+			LinkFields const& fields)
+	: Link(gmenu2x, bind(&LinkApp::start, this))
+	, deletable(deletable)
+{
+	init(linkfile, fields);
+}
+
+void LinkApp::init(string const& linkfile, LinkFields const& fields)
+{
+	setDefaults(linkfile);
+#ifdef HAVE_LIBOPK
+	isOPK = false;
+#endif
+	// Consider non-deletable applications to be immutable.
+	editable = deletable;
+
+	applyFields(fields, true);
+
+	if (iconPath.empty()) searchIcon();
+}
+
+#ifdef HAVE_LIBOPK
+LinkApp::LinkApp(GMenu2X& gmenu2x, string const& opkFile, OpkApp const& app)
+	: Link(gmenu2x, bind(&LinkApp::start, this))
+	// Note: OPK links can only be deleted by removing the OPK itself,
+	//       but that is not something we want to do in the menu,
+	//       so consider this link undeletable.
+	, deletable(false)
+{
+	setDefaults(opkFile);
+
+	isOPK = true;
+	metadata = app.metadata;
+	this->opkFile = opkFile;
+	string::size_type pos = opkFile.rfind('/');
+	opkMount = opkFile.substr(pos+1);
+	pos = opkMount.rfind('.');
+	opkMount = opkMount.substr(0, pos);
+
+	category = app.category;
+	title = app.title;
+	description = app.description;
+	consoleApp = app.consoleApp;
+	manual = app.manual;
+	selectorfilter = app.selectorFilter;
+	if (app.takesFileArg) {
+		selectordir = CARD_ROOT;
+	}
+
+	if (!app.icon.empty()) {
+		/* Use the icon from the OPK only
+		 * if it doesn't exist on the skin */
+		icon = gmenu2x.sc.getSkinFilePath("icons/" + app.icon + ".png");
+		if (icon.empty()) {
+			icon = app.iconFile.empty()
+					? opkFile + '#' + app.icon + ".png"
+					: app.iconFile;
+		}
+		iconPath = icon;
+		updateSurfaces();
+	}
+
+	file = gmenu2x.getHome() + "/sections/" + category + '/' + opkMount;
+	opkMount = (string) "/mnt/" + opkMount + '/';
+	edited = true;
+
+	LinkFields fields;
+	readFields(file, fields);
+	applyFields(fields, app.takesFileArg);
+
+	if (iconPath.empty()) searchIcon();
+}
+#endif
+
+void LinkApp::setDefaults(string const& linkfile)
 {
 	manual = "";
 	file = linkfile;
@@ -99,136 +184,34 @@ LinkApp::LinkApp(GMenu2X& gmenu2x, string const& linkfile, bool deletable)
 	selectorbrowser = true;
 	editable = true;
 	edited = false;
+}
 
-	bool appTakesFileArg = true;
-#ifdef HAVE_LIBOPK
-	isOPK = !!opk;
-
-	if (isOPK) {
-		string::size_type pos;
-		const char *key, *val;
-		size_t lkey, lval;
-		int ret;
-
-		metadata.assign(metadata_);
-		opkFile = file;
-		pos = file.rfind('/');
-		opkMount = file.substr(pos+1);
-		pos = opkMount.rfind('.');
-		opkMount = opkMount.substr(0, pos);
-
-		appTakesFileArg = false;
-		category = "applications";
-
-		while ((ret = opk_read_pair(opk, &key, &lkey, &val, &lval))) {
-			if (ret < 0) {
-				ERROR("Unable to read meta-data\n");
-				break;
-			}
-
-			char buf[lval + 1];
-			sprintf(buf, "%.*s", lval, val);
-
-			if (!strncmp(key, "Categories", lkey)) {
-				category = buf;
-
-				pos = category.find(';');
-				if (pos != category.npos)
-					category = category.substr(0, pos);
-
-			} else if ((!strncmp(key, "Name", lkey) && title.empty())
-						|| !strncmp(key, ("Name[" + gmenu2x.tr["Lng"] +
-								"]").c_str(), lkey)) {
-				title = buf;
-
-			} else if ((!strncmp(key, "Comment", lkey) && description.empty())
-						|| !strncmp(key, ("Comment[" +
-								gmenu2x.tr["Lng"] + "]").c_str(), lkey)) {
-				description = buf;
-
-			} else if (!strncmp(key, "Terminal", lkey)) {
-				consoleApp = !strncmp(val, "true", lval);
-
-			} else if (!strncmp(key, "X-OD-Manual", lkey)) {
-				manual = buf;
-
-			} else if (!strncmp(key, "Icon", lkey)) {
-				/* Read the icon from the OPK only
-				 * if it doesn't exist on the skin */
-				this->icon = gmenu2x.sc.getSkinFilePath("icons/" + (string) buf + ".png");
-				if (this->icon.empty()) {
-					this->icon = linkfile + '#' + buf + ".png";
-				}
-				iconPath = this->icon;
-				updateSurfaces();
-
-			} else if (!strncmp(key, "Exec", lkey)) {
-				string tmp = buf;
-
-				for (auto token : tokens) {
-					if (tmp.find(token) != tmp.npos) {
-						selectordir = CARD_ROOT;
-						appTakesFileArg = true;
-						break;
-					}
-				}
-
-				continue;
-			}
-
-#ifdef HAVE_LIBXDGMIME
-			if (!strncmp(key, "MimeType", lkey)) {
-				string mimetypes = buf;
-				selectorfilter = "";
-
-				while ((pos = mimetypes.find(';')) != mimetypes.npos) {
-					int nb = 16;
-					char *extensions[nb];
-					string mimetype = mimetypes.substr(0, pos);
-					mimetypes = mimetypes.substr(pos + 1);
-
-					nb = xdg_mime_get_extensions_from_mime_type(
-								mimetype.c_str(), extensions, nb);
-
-					while (nb--) {
-						selectorfilter += (string) extensions[nb] + ',';
-						free(extensions[nb]);
-					}
-				}
-
-				/* Remove last comma */
-				if (!selectorfilter.empty()) {
-					selectorfilter.pop_back();
-					DEBUG("Compatible extensions: %s\n", selectorfilter.c_str());
-				}
-
-				continue;
-			}
-#endif /* HAVE_LIBXDGMIME */
-		}
-
-		file = gmenu2x.getHome() + "/sections/" + category + '/' + opkMount;
-		opkMount = (string) "/mnt/" + opkMount + '/';
-		edited = true;
-	} else
-#endif /* HAVE_LIBOPK */
-	{
-		// Non-packaged application.
-
-		// Consider non-deletable applications to be immutable.
-		editable = deletable;
+bool LinkApp::readFields(string const& path, LinkFields& fields)
+{
+	ifstream infile (path.c_str(), ios_base::in);
+	if (!infile.is_open()) {
+		return false;
 	}
 
 	string line;
-	ifstream infile (file.c_str(), ios_base::in);
 	while (getline(infile, line, '\n')) {
 		line = trim(line);
 		if (line.empty()) continue;
 		if (line[0]=='#') continue;
 
 		string::size_type position = line.find("=");
-		string name = trim(line.substr(0,position));
-		string value = trim(line.substr(position+1));
+		fields.emplace_back(trim(line.substr(0,position)),
+				trim(line.substr(position+1)));
+	}
+	infile.close();
+	return true;
+}
+
+void LinkApp::applyFields(LinkFields const& fields, bool appTakesFileArg)
+{
+	for (auto& field : fields) {
+		string const& name = field.first;
+		string const& value = field.second;
 
 		if (name == "clock") {
 			setClock( atoi(value.c_str()) );
@@ -263,9 +246,6 @@ LinkApp::LinkApp(GMenu2X& gmenu2x, string const& linkfile, bool deletable)
 		} else
 			WARNING("Unrecognized option: '%s'\n", name.c_str());
 	}
-	infile.close();
-
-	if (iconPath.empty()) searchIcon();
 }
 
 void LinkApp::loadIcon() {
@@ -373,9 +353,6 @@ bool LinkApp::save() {
 }
 
 void LinkApp::drawLaunch(Surface& s) {
-	//Darkened background
-	s.box(0, 0, gmenu2x.resX, gmenu2x.resY, 0,0,0,150);
-
 	string text = getLaunchMsg().empty()
 		? gmenu2x.tr.translate("Launching $1", getTitle().c_str(), nullptr)
 		: gmenu2x.tr.translate(getLaunchMsg().c_str(), nullptr);
@@ -428,14 +405,14 @@ void LinkApp::showManual() {
 			WARNING("Unable to extract manual from OPK\n");
 			return;
 		}
-		string str((char *) buf, len);
+		unique_ptr<TextBuffer> text(new TextBuffer(string((char *) buf, len)));
 		free(buf);
 
 		if (manual.substr(manual.size()-8,8)==".man.txt") {
-			TextManualDialog tmd(gmenu2x, getTitle(), getIconPath(), str);
+			TextManualDialog tmd(gmenu2x, getTitle(), getIconPath(), move(text));
 			tmd.exec();
 		} else {
-			TextDialog td(gmenu2x, getTitle(), "ReadMe", getIconPath(), str);
+			TextDialog td(gmenu2x, getTitle(), "ReadMe", getIconPath(), move(text));
 			td.exec();
 		}
 		return;
@@ -446,117 +423,34 @@ void LinkApp::showManual() {
 
 	// Png manuals
 	if (manual.substr(manual.size()-8,8)==".man.png") {
-#ifdef ENABLE_CPUFREQ
-		//Raise the clock to speed-up the loading of the manual
-		gmenu2x.setSafeMaxClock();
-#endif
-
-		auto pngman = OffscreenSurface::loadImage(manual);
-		if (!pngman) {
-			return;
-		}
-		auto bg = OffscreenSurface::loadImage(gmenu2x.confStr["wallpaper"]);
-		if (!bg) {
-			bg = OffscreenSurface::emptySurface(gmenu2x.s->width(), gmenu2x.s->height());
-		}
-		bg->convertToDisplayFormat();
-
-		stringstream ss;
-		string pageStatus;
-
-		bool close = false, repaint = true;
-		int page = 0, pagecount = pngman->width() / 320;
-
-		ss << pagecount;
-		string spagecount;
-		ss >> spagecount;
-
-#ifdef ENABLE_CPUFREQ
-		//Lower the clock
-		gmenu2x.setMenuClock();
-#endif
-
-		while (!close) {
-			OutputSurface& s = *gmenu2x.s;
-
-			if (repaint) {
-				bg->blit(s, 0, 0);
-				pngman->blit(s, -page*320, 0);
-
-				gmenu2x.drawBottomBar(s);
-				int x = 5;
-				x = gmenu2x.drawButton(s, "left", "", x);
-				x = gmenu2x.drawButton(s, "right", gmenu2x.tr["Change page"], x);
-				x = gmenu2x.drawButton(s, "cancel", "", x);
-				x = gmenu2x.drawButton(s, "start", gmenu2x.tr["Exit"], x);
-				(void)x;
-
-				ss.clear();
-				ss << page+1;
-				ss >> pageStatus;
-				pageStatus = gmenu2x.tr["Page"]+": "+pageStatus+"/"+spagecount;
-				gmenu2x.font->write(s, pageStatus, 310, 230, Font::HAlignRight, Font::VAlignMiddle);
-
-				s.flip();
-				repaint = false;
-			}
-
-            switch(gmenu2x.input.waitForPressedButton()) {
-				case InputManager::SETTINGS:
-                case InputManager::CANCEL:
-                    close = true;
-                    break;
-                case InputManager::LEFT:
-                    if (page > 0) {
-                        page--;
-                        repaint = true;
-                    }
-                    break;
-                case InputManager::RIGHT:
-                    if (page < pagecount-1) {
-                        page++;
-                        repaint=true;
-                    }
-                    break;
-                default:
-                    break;
-            }
-        }
+		ImageManualDialog imd(gmenu2x, manual);
+		imd.exec();
 		return;
 	}
 
 	// Txt manuals
 	if (manual.substr(manual.size()-8,8)==".man.txt") {
-		string text(readFileAsString(manual));
-		TextManualDialog tmd(gmenu2x, getTitle(), getIconPath(), text);
+		TextManualDialog tmd(gmenu2x, getTitle(), getIconPath(),
+				TextBuffer::fromFile(manual));
 		tmd.exec();
 		return;
 	}
 
 	//Readmes
-	string str, line;
-	ifstream infile(manual.c_str(), ios_base::in);
-	if (infile.is_open()) {
-		while (getline(infile, line, '\n')) {
-			str.append(line).append("\n");
-		}
-		infile.close();
-
-		TextDialog td(gmenu2x, getTitle(), "ReadMe", getIconPath(), str);
-		td.exec();
-	}
+	TextDialog td(gmenu2x, getTitle(), "ReadMe", getIconPath(),
+			TextBuffer::fromFile(manual));
+	td.exec();
 }
 
-void LinkApp::selector(int startSelection, const string &selectorDir) {
+void LinkApp::selector(const string &startFile, const string &selectorDir) {
 	//Run selector interface
 	Selector sel(gmenu2x, *this, selectorDir);
-	int selection = sel.exec(startSelection);
-	if (selection!=-1) {
+	if (sel.exec(startFile)) {
 		const string &selectedDir = sel.getDir();
 		if (!selectedDir.empty()) {
 			selectordir = selectedDir;
 		}
-		gmenu2x.writeTmp(selection, selectedDir);
+		gmenu2x.writeTmp(sel.getFile(), selectedDir);
 		gmenu2x.queueLaunch(
 				prepareLaunch(selectedDir + sel.getFile()),
 				make_shared<LaunchLayer>(*this));
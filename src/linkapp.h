@@ -25,10 +25,18 @@
 
 #include <memory>
 #include <string>
+#include <utility>
+#include <vector>
 
 class GMenu2X;
 class Launcher;
 class Surface;
+struct OpkApp;
+
+/**
+ * The name/value pairs of a link file, in the order they appear in the file.
+ */
+typedef std::vector<std::pair<std::string, std::string>> LinkFields;
 
 /**
 Parses links files.
@@ -51,6 +59,9 @@ private:
 #endif
 
 	void start();
+	void init(std::string const& linkfile, LinkFields const& fields);
+	void setDefaults(std::string const& linkfile);
+	void applyFields(LinkFields const& fields, bool appTakesFileArg);
 
 protected:
 	virtual const std::string &searchIcon();
@@ -61,13 +72,29 @@ public:
 	bool isOpk() { return isOPK; }
 	const std::string &getOpkFile() { return opkFile; }
 
-	LinkApp(GMenu2X& gmenu2x, std::string const& linkfile, bool deletable,
-				struct OPK *opk = NULL, const char *metadata = NULL);
+	/**
+	 * Creates a packaged application from the meta-data of the package.
+	 */
+	LinkApp(GMenu2X& gmenu2x, std::string const& opkFile, OpkApp const& app);
 #else
-	LinkApp(GMenu2X& gmenu2x, std::string const& linkfile, bool deletable);
 	bool isOpk() { return false; }
 #endif
 
+	LinkApp(GMenu2X& gmenu2x, std::string const& linkfile, bool deletable);
+
+	/**
+	 * Creates a non-packaged application from the already parsed contents
+	 * of its link file.
+	 */
+	LinkApp(GMenu2X& gmenu2x, std::string const& linkfile, bool deletable,
+				LinkFields const& fields);
+
+	/**
+	 * Parses the given link file, appending its fields to 'fields'.
+	 * Returns false if the file could not be opened.
+	 */
+	static bool readFields(std::string const& path, LinkFields& fields);
+
 	virtual void loadIcon();
 
 	bool consoleApp = false;
@@ -87,7 +114,8 @@ public:
 
 	bool save();
 	void showManual();
-	void selector(int startSelection=0, const std::string &selectorDir="");
+	void selector(const std::string &startFile="",
+			const std::string &selectorDir="");
 	bool targetExists();
 	bool isDeletable() { return deletable; }
 	bool isEditable() { return editable; }
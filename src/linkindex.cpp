@@ -0,0 +1,229 @@
+// Various authors.
+// License: GPL version 2 or later.
+
+#include "linkindex.h"
+
+#include "binaryio.h"
+#include "debug.h"
+#include "utilities.h"
+
+#include <ctime>
+#include <dirent.h>
+#include <sys/stat.h>
+
+using namespace std;
+
+/* Identifies the file format; change it whenever the format changes. */
+static const uint32_t INDEX_MAGIC = 0x4c33474d; // "MG3L", version 2
+
+/* Modification times that are this recent (in seconds) are not trusted:
+ * the directory may change again without its time stamp changing. */
+static const time_t MTIME_GRANULARITY = 2;
+
+LinkIndex::LinkIndex(string const& path)
+	: path(path)
+	, modified(false)
+{
+	load();
+}
+
+void LinkIndex::load()
+{
+	if (!fileExists(path)) {
+		return;
+	}
+
+	string data = readFileAsString(path);
+	BinaryReader in(data);
+	uint32_t magic, numDirs;
+	if (!in.readU32(magic) || magic != INDEX_MAGIC || !in.readU32(numDirs)) {
+		WARNING("Ignoring link index '%s' of unknown format\n", path.c_str());
+		return;
+	}
+
+	bool ok = true;
+	for (uint32_t i = 0; ok && i < numDirs; i++) {
+		string dirPath;
+		uint8_t kind;
+		uint32_t numEntries;
+		Dir dir;
+		ok = in.readString(dirPath) && in.readU8(kind)
+				&& in.readU64(dir.mtimeSec) && in.readU64(dir.mtimeNsec)
+				&& in.readU32(numEntries);
+		dir.kind = static_cast<Kind>(kind);
+		dir.used = false;
+
+		for (uint32_t j = 0; ok && j < numEntries; j++) {
+			Entry entry;
+			uint32_t numFields;
+			ok = in.readString(entry.name) && in.readU64(entry.size)
+					&& in.readU64(entry.mtimeSec) && in.readU64(entry.mtimeNsec)
+					&& in.readU32(numFields);
+			for (uint32_t k = 0; ok && k < numFields; k++) {
+				string name, value;
+				ok = in.readString(name) && in.readString(value);
+				entry.fields.emplace_back(name, value);
+			}
+			dir.entries.push_back(move(entry));
+		}
+
+		if (ok) {
+			dirs[dirPath] = move(dir);
+		}
+	}
+
+	if (!ok || !in.atEnd()) {
+		WARNING("Link index '%s' is corrupt; rebuilding it\n", path.c_str());
+		dirs.clear();
+		modified = true;
+	}
+}
+
+bool LinkIndex::save()
+{
+	for (auto it = dirs.begin(); it != dirs.end(); ) {
+		if (it->second.used) {
+			++it;
+		} else {
+			it = dirs.erase(it);
+			modified = true;
+		}
+	}
+	if (!modified) {
+		return true;
+	}
+
+	BinaryWriter out;
+	out.writeU32(INDEX_MAGIC);
+	out.writeU32(dirs.size());
+	for (auto& it : dirs) {
+		Dir const& dir = it.second;
+		out.writeString(it.first);
+		out.writeU8(dir.kind);
+		out.writeU64(dir.mtimeSec);
+		out.writeU64(dir.mtimeNsec);
+		out.writeU32(dir.entries.size());
+		for (auto& entry : dir.entries) {
+			out.writeString(entry.name);
+			out.writeU64(entry.size);
+			out.writeU64(entry.mtimeSec);
+			out.writeU64(entry.mtimeNsec);
+			out.writeU32(entry.fields.size());
+			for (auto& field : entry.fields) {
+				out.writeString(field.first);
+				out.writeString(field.second);
+			}
+		}
+	}
+
+	if (!writeStringToFile(path, out.data())) {
+		WARNING("Unable to write link index '%s'\n", path.c_str());
+		return false;
+	}
+	modified = false;
+	return true;
+}
+
+vector<LinkIndex::Entry> const& LinkIndex::getSubdirs(string const& dir)
+{
+	return lookup(dir, SUBDIRS);
+}
+
+vector<LinkIndex::Entry> const& LinkIndex::getLinkFiles(string const& dir)
+{
+	return lookup(dir, LINK_FILES);
+}
+
+vector<LinkIndex::Entry> const& LinkIndex::lookup(string const& dirPath, Kind kind)
+{
+	auto it = dirs.find(dirPath);
+	bool known = it != dirs.end();
+	if (!known) {
+		it = dirs.emplace(dirPath, Dir { kind, false, 0, 0, {} }).first;
+	}
+	Dir& dir = it->second;
+	dir.used = true;
+
+	struct stat st;
+	if (stat(dirPath.c_str(), &st) != 0) {
+		if (!known || !dir.entries.empty() || dir.mtimeSec || dir.mtimeNsec) {
+			dir = Dir { kind, true, 0, 0, {} };
+			modified = true;
+		}
+		return dir.entries;
+	}
+
+	const uint64_t sec = st.st_mtim.tv_sec, nsec = st.st_mtim.tv_nsec;
+	if (known && dir.kind == kind && (sec || nsec)
+			&& dir.mtimeSec == sec && dir.mtimeNsec == nsec) {
+		if (kind == LINK_FILES) {
+			for (Entry& entry : dir.entries) {
+				modified |= refresh(dirPath + '/' + entry.name, entry);
+			}
+		}
+		return dir.entries;
+	}
+
+	DEBUG("Scanning directory '%s' for the link index\n", dirPath.c_str());
+	dir.kind = kind;
+	scan(dirPath, dir);
+	if (time(nullptr) - st.st_mtime >= MTIME_GRANULARITY) {
+		dir.mtimeSec = sec;
+		dir.mtimeNsec = nsec;
+	} else {
+		// Force a rescan next time.
+		dir.mtimeSec = dir.mtimeNsec = 0;
+	}
+	modified = true;
+	return dir.entries;
+}
+
+void LinkIndex::scan(string const& dirPath, Dir& dir)
+{
+	dir.entries.clear();
+
+	DIR *dirp = opendir(dirPath.c_str());
+	if (!dirp) return;
+
+	while (struct dirent *dptr = readdir(dirp)) {
+		if (dir.kind == SUBDIRS) {
+			if (dptr->d_name[0] != '.' && dptr->d_type == DT_DIR) {
+				dir.entries.push_back(Entry { dptr->d_name, {}, 0, 0, 0 });
+			}
+		} else if (dptr->d_type == DT_REG) {
+			Entry entry { dptr->d_name, {}, 0, 0, 0 };
+			refresh(dirPath + '/' + entry.name, entry);
+			dir.entries.push_back(move(entry));
+		}
+	}
+
+	closedir(dirp);
+}
+
+bool LinkIndex::refresh(string const& filePath, Entry& entry)
+{
+	struct stat st;
+	if (stat(filePath.c_str(), &st) != 0) {
+		// The directory scan will notice it is gone.
+		return false;
+	}
+
+	const uint64_t sec = st.st_mtim.tv_sec, nsec = st.st_mtim.tv_nsec;
+	if ((sec || nsec) && entry.size == uint64_t(st.st_size)
+			&& entry.mtimeSec == sec && entry.mtimeNsec == nsec) {
+		return false;
+	}
+
+	DEBUG("Reading link file '%s' for the link index\n", filePath.c_str());
+	entry.fields.clear();
+	LinkApp::readFields(filePath, entry.fields);
+	entry.size = st.st_size;
+	if (time(nullptr) - st.st_mtime >= MTIME_GRANULARITY) {
+		entry.mtimeSec = sec;
+		entry.mtimeNsec = nsec;
+	} else {
+		// Force a reread next time.
+		entry.mtimeSec = entry.mtimeNsec = 0;
+	}
+	return true;
+}
@@ -0,0 +1,77 @@
+// Various authors.
+// License: GPL version 2 or later.
+
+#ifndef LINKINDEX_H
+#define LINKINDEX_H
+
+#include "linkapp.h"
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * Persistent index of section directories and the link files inside them.
+ * It allows the menu to be built without reading directories or parsing link
+ * files that did not change since the previous run: a directory is only
+ * scanned again when its modification time differs from the recorded one.
+ * Link files that are replaced change the modification time of their
+ * directory; link files that are rewritten in place are noticed by their
+ * own size and modification time, and only those are read again.
+ */
+class LinkIndex {
+public:
+	struct Entry {
+		std::string name;
+		LinkFields fields;
+		/** Size and modification time of a link file when it was read. */
+		uint64_t size, mtimeSec, mtimeNsec;
+	};
+
+	/**
+	 * Loads the index from the given file, if it exists.
+	 */
+	LinkIndex(std::string const& path);
+
+	/**
+	 * Returns the names of the subdirectories of the given directory,
+	 * skipping hidden ones.
+	 */
+	std::vector<Entry> const& getSubdirs(std::string const& dir);
+
+	/**
+	 * Returns the regular files in the given directory, together with
+	 * their contents parsed as link files.
+	 */
+	std::vector<Entry> const& getLinkFiles(std::string const& dir);
+
+	/**
+	 * Writes the index back to its file if it was changed.
+	 * Directories that were not looked up since the index was loaded
+	 * are dropped.
+	 */
+	bool save();
+
+private:
+	enum Kind : uint8_t { SUBDIRS, LINK_FILES };
+
+	struct Dir {
+		Kind kind;
+		bool used;
+		uint64_t mtimeSec, mtimeNsec;
+		std::vector<Entry> entries;
+	};
+
+	std::vector<Entry> const& lookup(std::string const& path, Kind kind);
+	void scan(std::string const& path, Dir& dir);
+	/** Reads a link file again if it changed since it was read. */
+	bool refresh(std::string const& path, Entry& entry);
+	void load();
+
+	std::string path;
+	std::unordered_map<std::string, Dir> dirs;
+	bool modified;
+};
+
+#endif // LINKINDEX_H
@@ -0,0 +1,204 @@
+// Various authors.
+// License: GPL version 2 or later.
+
+/*
+ * Times FileLister::browse() on generated directories of 1k, 10k and 50k
+ * entries against the readdir() and std::set based listing it replaced,
+ * which is kept below as the reference. Not installed; build it with
+ * "make bench".
+ *
+ * Usage: listerbench [parent directory]
+ * The directories are created in a temporary directory below the given
+ * one (default: /tmp), so the file system can be chosen, and are removed
+ * afterwards. Since every directory is listed several times, the numbers
+ * are for a warm directory cache.
+ */
+
+#include "filelister.h"
+#include "utilities.h"
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <set>
+#include <string>
+
+using namespace std;
+
+/* Each directory is listed this many times; the fastest run counts. */
+static const int RUNS = 5;
+
+static const unsigned int sizes[] = { 1000, 10000, 50000 };
+
+/*
+ * How FileLister::browse() listed a directory before it read entries in
+ * bulk: readdir() with a stat() for entries of unknown type, and a sorted
+ * set per kind of entry.
+ */
+static size_t referenceBrowse(const string &path, const char *ext)
+{
+	DIR *dirp = opendir(path.c_str());
+	if (!dirp) {
+		return 0;
+	}
+
+	set<string, case_less> directorySet;
+	set<string, case_less> fileSet;
+
+	while (struct dirent *dptr = readdir(dirp)) {
+		if (dptr->d_name[0] == '.') {
+			if (!(dptr->d_name[1] == '.' && path != "/")) {
+				continue;
+			}
+		}
+
+		bool isDir, isFile;
+#ifdef _DIRENT_HAVE_D_TYPE
+		if (dptr->d_type != DT_UNKNOWN && dptr->d_type != DT_LNK) {
+			isDir = dptr->d_type == DT_DIR;
+			isFile = dptr->d_type == DT_REG;
+		} else
+#endif
+		{
+			string filepath = path + dptr->d_name;
+			struct stat st;
+			if (stat(filepath.c_str(), &st) == -1) {
+				continue;
+			}
+			isDir = S_ISDIR(st.st_mode);
+			isFile = S_ISREG(st.st_mode);
+		}
+
+		if (isDir) {
+			directorySet.insert(string(dptr->d_name));
+		} else if (isFile) {
+			const char *fileExt = strrchr(dptr->d_name, '.');
+			if (fileExt && strcasecmp(fileExt + 1, ext) == 0) {
+				fileSet.insert(string(dptr->d_name));
+			}
+		}
+	}
+
+	closedir(dirp);
+	return directorySet.size() + fileSet.size();
+}
+
+/*
+ * Fills the directory with a ROM folder like mix: mostly files with the
+ * extension that is listed, some other files and a few subdirectories.
+ */
+static bool populate(const string &path, unsigned int entries)
+{
+	if (mkdir(path.c_str(), 0700) < 0) {
+		return false;
+	}
+	char name[64];
+	for (unsigned int i = 0; i < entries; i++) {
+		if (i % 20 == 0) {
+			snprintf(name, sizeof(name), "Folder %u", i);
+			if (mkdir((path + name).c_str(), 0700) < 0) {
+				return false;
+			}
+			continue;
+		}
+		snprintf(name, sizeof(name), "%s Game %u (Rev %u).%s",
+				i % 2 ? "Super" : "mega", i * 7919 % entries, i % 3,
+				i % 10 == 1 ? "srm" : "zip");
+		int fd = open((path + name).c_str(), O_WRONLY | O_CREAT, 0600);
+		if (fd < 0) {
+			return false;
+		}
+		close(fd);
+	}
+	return true;
+}
+
+static void removeTree(const string &path)
+{
+	DIR *dirp = opendir(path.c_str());
+	if (!dirp) {
+		return;
+	}
+	while (struct dirent *dptr = readdir(dirp)) {
+		const char *name = dptr->d_name;
+		if (name[0] == '.' && (!name[1] || (name[1] == '.' && !name[2]))) {
+			continue;
+		}
+		const string child = path + name;
+		if (unlink(child.c_str()) < 0) {
+			removeTree(child + "/");
+		}
+	}
+	closedir(dirp);
+	rmdir(path.c_str());
+}
+
+/* Returns the fastest of RUNS runs, in milliseconds. */
+template <typename List>
+static double timeList(List list, size_t& count)
+{
+	typedef chrono::steady_clock Clock;
+	double best = 0;
+	for (int run = 0; run < RUNS; run++) {
+		const Clock::time_point start = Clock::now();
+		count = list();
+		const chrono::duration<double, milli> elapsed = Clock::now() - start;
+		if (run == 0 || elapsed.count() < best) {
+			best = elapsed.count();
+		}
+	}
+	return best;
+}
+
+int main(int argc, char *argv[])
+{
+	string parent = argc > 1 ? argv[1] : "/tmp";
+	string pattern = parent + "/listerbench.XXXXXX";
+	if (!mkdtemp(&pattern[0])) {
+		fprintf(stderr, "Unable to create a directory in '%s'\n",
+				parent.c_str());
+		return EXIT_FAILURE;
+	}
+	const string root = pattern + "/";
+
+	printf("%8s %10s %10s %8s %8s %8s\n",
+			"entries", "old ms", "new ms", "speedup", "old", "new");
+	bool ok = true;
+	for (unsigned int entries : sizes) {
+		char name[16];
+		snprintf(name, sizeof(name), "%u/", entries);
+		const string path = root + name;
+		if (!populate(path, entries)) {
+			fprintf(stderr, "Unable to create %u entries in '%s'\n",
+					entries, path.c_str());
+			ok = false;
+			break;
+		}
+
+		size_t referenceCount, count;
+		const double referenceMs = timeList([&] {
+			return referenceBrowse(path, "zip");
+		}, referenceCount);
+		const double ms = timeList([&] {
+			FileLister fl;
+			fl.setFilter("zip");
+			fl.browse(path);
+			return size_t(fl.size());
+		}, count);
+
+		printf("%8u %10.1f %10.1f %7.2fx %8zu %8zu\n", entries,
+				referenceMs, ms, referenceMs / ms, referenceCount, count);
+		if (count != referenceCount) {
+			ok = false;
+		}
+	}
+
+	removeTree(root);
+	return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
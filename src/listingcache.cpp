@@ -0,0 +1,273 @@
+// Various authors.
+// License: GPL version 2 or later.
+
+#include "listingcache.h"
+
+#include "binaryio.h"
+#include "debug.h"
+#include "utilities.h"
+#ifdef ENABLE_INOTIFY
+#include "monitor.h"
+#endif
+
+#include <sys/stat.h>
+
+using namespace std;
+
+/* Identifies the file format; change it whenever the format changes. */
+static const uint32_t CACHE_MAGIC = 0x4432474d; // "MG2D", version 1
+
+/* Modification times that are this recent (in seconds) are not trusted:
+ * the directory may change again without its time stamp changing. */
+static const time_t MTIME_GRANULARITY = 2;
+
+/* Maximum number of listings that are kept; the least recently used ones
+ * are dropped first. */
+static const size_t MAX_LISTINGS = 8;
+
+#ifdef ENABLE_INOTIFY
+/**
+ * Marks a listing as outdated as soon as an entry is added to, removed
+ * from or renamed in its directory.
+ */
+class ListingMonitor : public Monitor {
+public:
+	ListingMonitor(string const& dir, atomic<bool>& changed)
+		: Monitor(dir, IN_MOVE | IN_DELETE | IN_CREATE
+				| IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR)
+		, changed(changed) {}
+	virtual ~ListingMonitor() { stop(); }
+
+private:
+	virtual bool event_accepted(
+			struct inotify_event &event __attribute__((unused))) {
+		return true;
+	}
+	virtual void inject_event(
+			bool is_add __attribute__((unused)),
+			const char *path __attribute__((unused))) {
+		changed = true;
+	}
+
+	atomic<bool>& changed;
+};
+#endif
+
+ListingCache::Watch::Watch(string const& dir)
+	: changed(false)
+{
+#ifdef ENABLE_INOTIFY
+	monitor.reset(new ListingMonitor(dir, changed));
+	if (!monitor->start()) {
+		monitor.reset();
+	}
+#else
+	(void)dir;
+#endif
+}
+
+ListingCache::Watch::~Watch()
+{
+}
+
+bool ListingCache::Watch::isActive() const
+{
+#ifdef ENABLE_INOTIFY
+	return monitor != nullptr;
+#else
+	return false;
+#endif
+}
+
+struct ListingCache::Listing {
+	string dir;
+	uint64_t mtimeSec, mtimeNsec;
+	/** Whether the time stamp can be relied on to detect changes. */
+	bool trusted;
+	uint64_t lastUse;
+	vector<string> directories, files;
+
+	/** Only kept for listings that are not trusted. */
+	unique_ptr<Watch> watch;
+
+	bool hasChanged() const {
+		return watch && watch->hasChanged();
+	}
+};
+
+/** Identifies a listing: its directory and what it includes. */
+static string listingId(string const& dir, string const& key)
+{
+	return dir + '\0' + key;
+}
+
+static void writeNames(BinaryWriter& out, vector<string> const& names)
+{
+	out.writeU32(names.size());
+	for (string const& name : names) {
+		out.writeString(name);
+	}
+}
+
+static bool readNames(BinaryReader& in, vector<string>& names)
+{
+	uint32_t count;
+	if (!in.readU32(count)) {
+		return false;
+	}
+	names.resize(count);
+	for (string& name : names) {
+		if (!in.readString(name)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+ListingCache::ListingCache(string const& file)
+	: file(file)
+	, useCount(0)
+	, modified(false)
+{
+	if (!fileExists(file)) {
+		return;
+	}
+
+	string data = readFileAsString(file);
+	BinaryReader in(data);
+	uint32_t magic, count;
+	if (!in.readU32(magic) || magic != CACHE_MAGIC || !in.readU32(count)) {
+		WARNING("Ignoring listing cache '%s' of unknown format\n", file.c_str());
+		return;
+	}
+
+	for (uint32_t i = 0; i < count; i++) {
+		string id;
+		unique_ptr<Listing> listing(new Listing());
+		if (!in.readString(id) || !in.readString(listing->dir)
+				|| !in.readU64(listing->mtimeSec)
+				|| !in.readU64(listing->mtimeNsec)
+				|| !readNames(in, listing->directories)
+				|| !readNames(in, listing->files)) {
+			WARNING("Listing cache '%s' is truncated\n", file.c_str());
+			listings.clear();
+			return;
+		}
+		// Only listings with a trusted time stamp are saved.
+		listing->trusted = true;
+		listing->lastUse = ++useCount;
+		listings[id] = move(listing);
+	}
+}
+
+ListingCache::~ListingCache()
+{
+}
+
+bool ListingCache::lookup(string const& dir, string const& key,
+		vector<string>& directories, vector<string>& files)
+{
+	auto it = listings.find(listingId(dir, key));
+	if (it == listings.end()) {
+		return false;
+	}
+
+	Listing& listing = *it->second;
+	struct stat st;
+	if (listing.hasChanged() || stat(dir.c_str(), &st) < 0
+			|| uint64_t(st.st_mtim.tv_sec) != listing.mtimeSec
+			|| uint64_t(st.st_mtim.tv_nsec) != listing.mtimeNsec) {
+		DEBUG("Listing of '%s' is outdated\n", dir.c_str());
+		listings.erase(it);
+		modified = true;
+		return false;
+	}
+
+	listing.lastUse = ++useCount;
+	directories = listing.directories;
+	files = listing.files;
+	return true;
+}
+
+void ListingCache::store(string const& dir, string const& key,
+		struct timespec const& mtime, time_t scanned, unique_ptr<Watch> watch,
+		vector<string> const& directories, vector<string> const& files)
+{
+	const string id = listingId(dir, key);
+	const bool trusted = scanned - mtime.tv_sec >= MTIME_GRANULARITY;
+	if (!trusted && !(watch && watch->isActive() && !watch->hasChanged())) {
+		// Changes within the same time stamp would go unnoticed.
+		DEBUG("Not caching the listing of '%s', which just changed\n",
+				dir.c_str());
+		if (listings.erase(id)) {
+			modified = true;
+		}
+		return;
+	}
+
+	unique_ptr<Listing> listing(new Listing());
+	listing->dir = dir;
+	listing->mtimeSec = mtime.tv_sec;
+	listing->mtimeNsec = mtime.tv_nsec;
+	listing->trusted = trusted;
+	listing->lastUse = ++useCount;
+	listing->directories = directories;
+	listing->files = files;
+	// Later changes show up in the time stamp of a trusted listing, so only
+	// untrusted ones need their watch.
+	if (!trusted) {
+		listing->watch = move(watch);
+	}
+	listings[id] = move(listing);
+
+	evict();
+	modified = true;
+}
+
+void ListingCache::evict()
+{
+	while (listings.size() > MAX_LISTINGS) {
+		auto oldest = listings.begin();
+		for (auto it = listings.begin(); it != listings.end(); ++it) {
+			if (it->second->lastUse < oldest->second->lastUse) {
+				oldest = it;
+			}
+		}
+		listings.erase(oldest);
+	}
+}
+
+bool ListingCache::save()
+{
+	if (!modified) {
+		return true;
+	}
+
+	vector<pair<string const *, Listing const *>> saved;
+	for (auto& it : listings) {
+		Listing const& listing = *it.second;
+		if (listing.trusted) {
+			saved.emplace_back(&it.first, &listing);
+		}
+	}
+
+	BinaryWriter out;
+	out.writeU32(CACHE_MAGIC);
+	out.writeU32(saved.size());
+	for (auto& it : saved) {
+		Listing const& listing = *it.second;
+		out.writeString(*it.first);
+		out.writeString(listing.dir);
+		out.writeU64(listing.mtimeSec);
+		out.writeU64(listing.mtimeNsec);
+		writeNames(out, listing.directories);
+		writeNames(out, listing.files);
+	}
+
+	if (!writeStringToFile(file, out.data())) {
+		ERROR("Unable to write listing cache '%s'\n", file.c_str());
+		return false;
+	}
+	modified = false;
+	return true;
+}
@@ -0,0 +1,100 @@
+// Various authors.
+// License: GPL version 2 or later.
+
+#ifndef LISTINGCACHE_H
+#define LISTINGCACHE_H
+
+#include <atomic>
+#include <cstdint>
+#include <ctime>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#ifdef ENABLE_INOTIFY
+class Monitor;
+#endif
+
+/**
+ * Persistent cache of sorted directory listings, so reopening a directory
+ * with many files, such as the last used ROM folder after returning from a
+ * game, does not read it again.
+ * A listing is only used while the modification time of its directory is
+ * the same as when it was made. Listings that were made too soon after
+ * the directory changed to trust its time stamp are only used while an
+ * inotify watch, started before the directory was read, confirms that the
+ * directory did not change since.
+ */
+class ListingCache {
+public:
+	/**
+	 * Notices changes to a directory, from before it is read until its
+	 * listing is dropped from the cache.
+	 */
+	class Watch {
+	public:
+		Watch(std::string const& dir);
+		~Watch();
+
+		Watch(Watch const&) = delete;
+		Watch& operator=(Watch const&) = delete;
+
+		/** Returns false if the directory could not be watched. */
+		bool isActive() const;
+		bool hasChanged() const { return changed; }
+
+	private:
+		std::atomic<bool> changed;
+#ifdef ENABLE_INOTIFY
+		/** Declared last, so it is stopped before the flag it sets goes away. */
+		std::unique_ptr<Monitor> monitor;
+#endif
+	};
+
+	/**
+	 * Loads the cache from the given file, if it exists.
+	 */
+	ListingCache(std::string const& file);
+	~ListingCache();
+
+	/**
+	 * Looks up the listing of the given directory that was stored under
+	 * the given key, which describes what the listing includes.
+	 * Returns false if there is no listing or if it is outdated.
+	 */
+	bool lookup(std::string const& dir, std::string const& key,
+			std::vector<std::string>& directories,
+			std::vector<std::string>& files);
+
+	/**
+	 * Stores the listing of the given directory.
+	 * @param mtime Modification time of the directory before it was read.
+	 * @param scanned Time at which reading the directory started.
+	 * @param watch Watch on the directory that was started before its
+	 *   modification time was read, if any. Listings with a time stamp
+	 *   that is too recent to trust are only kept along with their watch.
+	 */
+	void store(std::string const& dir, std::string const& key,
+			struct timespec const& mtime, time_t scanned,
+			std::unique_ptr<Watch> watch,
+			std::vector<std::string> const& directories,
+			std::vector<std::string> const& files);
+
+	/**
+	 * Writes the cache back to its file if it was changed.
+	 */
+	bool save();
+
+private:
+	struct Listing;
+
+	void evict();
+
+	std::string file;
+	std::unordered_map<std::string, std::unique_ptr<Listing>> listings;
+	uint64_t useCount;
+	bool modified;
+};
+
+#endif // LISTINGCACHE_H
@@ -7,7 +7,7 @@
 class MediaMonitor: public Monitor {
 	public:
 		MediaMonitor(std::string dir);
-		virtual ~MediaMonitor() { };
+		virtual ~MediaMonitor() { stop(); };
 
 	private:
 		virtual bool event_accepted(struct inotify_event &event);
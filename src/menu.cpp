@@ -29,14 +29,14 @@
 #include <cerrno>
 #include <cstring>
 
-#ifdef HAVE_LIBOPK
-#include <opk.h>
-#endif
-
 #include "gmenu2x.h"
 #include "linkapp.h"
+#include "linkindex.h"
 #include "menu.h"
 #include "monitor.h"
+#include "opkcache.h"
+#include "packagescanner.h"
+#include "surface.h"
 #include "filelister.h"
 #include "utilities.h"
 #include "debug.h"
@@ -46,23 +46,33 @@ using namespace std;
 
 Menu::Animation::Animation()
 	: curr(0)
+	, lastTick(0)
 {
 }
 
 void Menu::Animation::adjust(int delta)
 {
+	if (curr == 0) {
+		lastTick = SDL_GetTicks();
+	}
 	curr += delta;
 }
 
 void Menu::Animation::step()
 {
+	// The speed is proportional to the remaining distance plus one section;
+	// at 60 frames per second, a frame covers 1/32 of that.
+	const Uint32 now = SDL_GetTicks();
+	const long long elapsed = std::min<Uint32>(now - lastTick, 1000);
+	lastTick = now;
+
 	if (curr == 0) {
 		ERROR("Computing step past animation end\n");
 	} else if (curr < 0) {
-		const int v = ((1 << 16) - curr) / 32;
+		const int v = ((1 << 16) - curr) * elapsed / 512;
 		curr = std::min(0, curr + v);
 	} else {
-		const int v = ((1 << 16) + curr) / 32;
+		const int v = ((1 << 16) + curr) * elapsed / 512;
 		curr = std::max(0, curr - v);
 	}
 }
@@ -72,13 +82,19 @@ Menu::Menu(GMenu2X& gmenu2x)
 	, btnContextMenu(gmenu2x, "skin:imgs/menu.png", "",
 			std::bind(&GMenu2X::showContextMenu, &gmenu2x))
 {
-	readSections(GMENU2X_SYSTEM_DIR "/sections");
-	readSections(GMenu2X::getHome() + "/sections");
+	iSection = 0;
+	headerCenter = 0;
+	LinkIndex index(GMenu2X::getCacheDir() + "/links.idx");
+	readSections(index, GMENU2X_SYSTEM_DIR "/sections");
+	readSections(index, GMenu2X::getHome() + "/sections");
 
 	setSectionIndex(0);
-	readLinks();
+	readLinks(index);
+	index.save();
 
 #ifdef HAVE_LIBOPK
+	opkCache.reset(new OpkCache(GMenu2X::getCacheDir() + "/opk.idx",
+			GMenu2X::getCacheDir() + "/opk-icons", gmenu2x.tr["Lng"]));
 	{
 		DIR *dirp = opendir(CARD_ROOT);
 		if (dirp) {
@@ -105,20 +121,12 @@ Menu::~Menu()
 {
 }
 
-void Menu::readSections(std::string const& parentDir)
+void Menu::readSections(LinkIndex& index, std::string const& parentDir)
 {
-	DIR *dirp = opendir(parentDir.c_str());
-	if (!dirp) return;
-
-	struct dirent *dptr;
-	while ((dptr = readdir(dirp))) {
-		if (dptr->d_name[0] != '.' && dptr->d_type == DT_DIR) {
-			// Create section if it doesn't exist yet.
-			sectionNamed(dptr->d_name);
-		}
+	for (auto& subdir : index.getSubdirs(parentDir)) {
+		// Create section if it doesn't exist yet.
+		sectionNamed(subdir.name);
 	}
-
-	closedir(dirp);
 }
 
 string Menu::createSectionDir(string const& sectionName)
@@ -139,28 +147,41 @@ string Menu::createSectionDir(string const& sectionName)
 }
 
 void Menu::skinUpdated() {
-	ConfIntHash &skinConfInt = gmenu2x.skinConfInt;
+	SkinLayout const& layout = gmenu2x.getSkinLayout();
 
 	//recalculate some coordinates based on the new element sizes
-	linkColumns = (gmenu2x.resX - 10) / skinConfInt["linkWidth"];
-	linkRows = (gmenu2x.resY - 35 - skinConfInt["topBarHeight"]) / skinConfInt["linkHeight"];
+	linkColumns = layout.linkColumns;
+	linkRows = layout.linkRows;
+
+	headerStrip.reset();
+	invalidate();
 
 	//reload section icons
+	sectionIcons.clear();
 	decltype(links)::size_type i = 0;
 	for (auto& sectionName : sections) {
-		gmenu2x.sc["skin:sections/" + sectionName + ".png"];
+		getSectionIcon(sectionName);
 
 		for (auto& link : links[i]) {
 			link->loadIcon();
+			link->invalidateTile();
 		}
 
 		i++;
 	}
 }
 
+shared_ptr<OffscreenSurface> Menu::getSectionIcon(string const& section) {
+	auto it = sectionIcons.find(section);
+	if (it == sectionIcons.end()) {
+		it = sectionIcons.emplace(section,
+				gmenu2x.sc["skin:sections/" + section + ".png"]).first;
+	}
+	return it->second;
+}
+
 void Menu::calcSectionRange(int &leftSection, int &rightSection) {
-	ConfIntHash &skinConfInt = gmenu2x.skinConfInt;
-	const int linkWidth = skinConfInt["linkWidth"];
+	const int linkWidth = gmenu2x.getSkinLayout().linkWidth;
 	const int screenWidth = gmenu2x.resX;
 	const int numSections = sections.size();
 	rightSection = min(
@@ -174,20 +195,59 @@ void Menu::calcSectionRange(int &leftSection, int &rightSection) {
 bool Menu::runAnimations() {
 	if (sectionAnimation.isRunning()) {
 		sectionAnimation.step();
+		// Only the section headers move.
+		invalidate(SDL_Rect {
+			0, 0,
+			static_cast<Uint16>(gmenu2x.resX),
+			static_cast<Uint16>(gmenu2x.getSkinLayout().topBarHeight)
+		});
 	}
 	return sectionAnimation.isRunning();
 }
 
+void Menu::renderHeaderStrip(int center, int leftSection, int rightSection) {
+	Font &font = *gmenu2x.font;
+	SurfaceCollection &sc = gmenu2x.sc;
+	SkinLayout const& layout = gmenu2x.getSkinLayout();
+	const int linkWidth = layout.linkWidth;
+	const int topBarHeight = layout.topBarHeight;
+	const int numSections = sections.size();
+
+	headerStrip = OffscreenSurface::transparentSurface(
+			(rightSection - leftSection + 3) * linkWidth, topBarHeight);
+	headerCenter = center;
+	if (!headerStrip) {
+		return;
+	}
+
+	const int sectionLinkPadding = (topBarHeight - 32 - font.getLineSpacing()) / 3;
+	for (int i = leftSection - 1; i <= rightSection + 1; i++) {
+		const int j = ((center + i) % numSections + numSections) % numSections;
+		auto icon = getSectionIcon(sections[j]);
+		if (!icon) {
+			icon = sc.skinRes("icons/section.png");
+		}
+		const int x = (i - leftSection + 1) * linkWidth + linkWidth / 2;
+		if (icon) {
+			icon->compose(*headerStrip, x - 16, sectionLinkPadding, 32, 32);
+		}
+		font.compose(*headerStrip, sections[j], x,
+				topBarHeight - sectionLinkPadding,
+				Font::HAlignCenter, Font::VAlignBottom);
+	}
+	headerStrip->convertToDisplayFormatAlpha();
+}
+
 void Menu::paint(Surface &s) {
-	const uint width = s.width(), height = s.height();
+	const int width = s.width(), height = s.height();
 	Font &font = *gmenu2x.font;
 	SurfaceCollection &sc = gmenu2x.sc;
 
-	ConfIntHash &skinConfInt = gmenu2x.skinConfInt;
-	const int topBarHeight = skinConfInt["topBarHeight"];
-	const int bottomBarHeight = skinConfInt["bottomBarHeight"];
-	const int linkWidth = skinConfInt["linkWidth"];
-	const int linkHeight = skinConfInt["linkHeight"];
+	SkinLayout const& layout = gmenu2x.getSkinLayout();
+	const int topBarHeight = layout.topBarHeight;
+	const int bottomBarHeight = layout.bottomBarHeight;
+	const int linkWidth = layout.linkWidth;
+	const int linkHeight = layout.linkHeight;
 	RGBAColor &selectionBgColor = gmenu2x.skinConfColors[COLOR_SELECTION_BG];
 
 	// Apply section header animation.
@@ -197,40 +257,34 @@ void Menu::paint(Surface &s) {
 	int sectionDelta = (sectionFP * linkWidth + (1 << 15)) >> 16;
 	int centerSection = iSection - sectionDelta / linkWidth;
 	sectionDelta %= linkWidth;
-	if (sectionDelta < 0) {
-		rightSection++;
-	} else if (sectionDelta > 0) {
-		leftSection--;
-	}
 
 	// Paint section headers.
 	s.box(width / 2  - linkWidth / 2, 0, linkWidth, topBarHeight, selectionBgColor);
-	const uint sectionLinkPadding = (topBarHeight - 32 - font.getLineSpacing()) / 3;
-	const uint numSections = sections.size();
-	for (int i = leftSection; i <= rightSection; i++) {
-		uint j = (centerSection + numSections + i) % numSections;
-		string sectionIcon = "skin:sections/" + sections[j] + ".png";
-		Surface *icon = sc.exists(sectionIcon)
-				? sc[sectionIcon]
-				: sc.skinRes("icons/section.png");
-		int x = width / 2 + i * linkWidth + sectionDelta;
-		if (i == leftSection) {
-			int t = sectionDelta > 0 ? linkWidth - sectionDelta : -sectionDelta;
-			x -= (((t * t) / linkWidth) * t) / linkWidth;
-		} else if (i == rightSection) {
-			int t = sectionDelta < 0 ? sectionDelta + linkWidth : sectionDelta;
-			x += (((t * t) / linkWidth) * t) / linkWidth;
-		}
-		icon->blit(s, x - 16, sectionLinkPadding, 32, 32);
-		font.write(s, sections[j], x, topBarHeight - sectionLinkPadding,
-				Font::HAlignCenter, Font::VAlignBottom);
+	if (!headerStrip || headerCenter != centerSection) {
+		renderHeaderStrip(centerSection, leftSection, rightSection);
+	}
+	if (headerStrip) {
+		// The strip slides through the area that the visible headers
+		// occupy when the animation is at rest.
+		const int stripX = width / 2 + sectionDelta
+				+ (leftSection - 1) * linkWidth - linkWidth / 2;
+		const int windowLeft = max(0,
+				width / 2 + leftSection * linkWidth - linkWidth / 2);
+		const int windowRight = min(width,
+				width / 2 + rightSection * linkWidth + linkWidth / 2);
+		SDL_Rect area = {
+			static_cast<Sint16>(windowLeft - stripX), 0,
+			static_cast<Uint16>(windowRight - windowLeft),
+			static_cast<Uint16>(topBarHeight)
+		};
+		headerStrip->blitArea(s, area, windowLeft, 0);
 	}
 	sc.skinRes("imgs/section-l.png")->blit(s, 0, 0);
 	sc.skinRes("imgs/section-r.png")->blit(s, width - 10, 0);
 
 	auto& sectionLinks = links[iSection];
 	auto numLinks = sectionLinks.size();
-	gmenu2x.drawScrollBar(
+	gmenu2x.drawScrollBar(s,
 			linkRows, (numLinks + linkColumns - 1) / linkColumns, iFirstDispRow);
 
 	//Links
@@ -247,10 +301,10 @@ void Menu::paint(Surface &s) {
 		sectionLinks.at(i)->setPosition(x, y);
 
 		if (i == (uint)iLink) {
-			sectionLinks.at(i)->paintHover();
+			sectionLinks.at(i)->paintHover(s);
 		}
 
-		sectionLinks.at(i)->paint();
+		sectionLinks.at(i)->paint(s);
 	}
 
 	if (selLink()) {
@@ -277,6 +331,8 @@ bool Menu::handleButtonPress(InputManager::Button button) {
 	switch (button) {
 		case InputManager::ACCEPT:
 			if (selLink() != NULL) selLink()->run();
+			// The link might have shown a dialog or changed the menu.
+			invalidate();
 			return true;
 		case InputManager::UP:
 			linkUp();
@@ -344,10 +400,18 @@ void Menu::setSectionIndex(int i) {
 		i=sections.size()-1;
 	else if (i>=(int)sections.size())
 		i=0;
+
+	// Only the links of the current section keep their tiles.
+	if (i != iSection && iSection >= 0 && iSection < (int)links.size()) {
+		for (auto& link : links[iSection]) {
+			link->invalidateTile();
+		}
+	}
 	iSection = i;
 
 	iLink = 0;
 	iFirstDispRow = 0;
+	invalidate();
 }
 
 /*====================================
@@ -359,7 +423,7 @@ void Menu::addActionLink(uint section, string const& title, Action action,
 	assert(section < sections.size());
 
 	Link *link = new Link(gmenu2x, action);
-	link->setSize(gmenu2x.skinConfInt["linkWidth"], gmenu2x.skinConfInt["linkHeight"]);
+	link->setSize(gmenu2x.getSkinLayout().linkWidth, gmenu2x.getSkinLayout().linkHeight);
 	link->setTitle(title);
 	link->setDescription(description);
 	if (gmenu2x.sc.exists(icon)
@@ -370,6 +434,7 @@ void Menu::addActionLink(uint section, string const& title, Action action,
 	}
 
 	links[section].emplace_back(link);
+	invalidate();
 }
 
 bool Menu::addLink(string const& path, string const& file)
@@ -427,8 +492,8 @@ bool Menu::addLink(string const& path, string const& file)
 	if (fileExists(exename+".png")) icon = exename+".png";
 
 	//Reduce title lenght to fit the link width
-	if (gmenu2x.font->getTextWidth(shorttitle)>gmenu2x.skinConfInt["linkWidth"]) {
-		while (gmenu2x.font->getTextWidth(shorttitle+"..")>gmenu2x.skinConfInt["linkWidth"])
+	if (gmenu2x.font->getTextWidth(shorttitle)>gmenu2x.getSkinLayout().linkWidth) {
+		while (gmenu2x.font->getTextWidth(shorttitle+"..")>gmenu2x.getSkinLayout().linkWidth)
 			shorttitle = shorttitle.substr(0,shorttitle.length()-1);
 		shorttitle += "..";
 	}
@@ -445,8 +510,9 @@ bool Menu::addLink(string const& path, string const& file)
 
 		auto idx = sectionNamed(sectionName);
 		auto link = new LinkApp(gmenu2x, linkpath, true);
-		link->setSize(gmenu2x.skinConfInt["linkWidth"], gmenu2x.skinConfInt["linkHeight"]);
+		link->setSize(gmenu2x.getSkinLayout().linkWidth, gmenu2x.getSkinLayout().linkHeight);
 		links[idx].emplace_back(link);
+		invalidate();
 	} else {
 
 		ERROR("Error while opening the file '%s' for write.\n", linkpath.c_str());
@@ -468,6 +534,8 @@ int Menu::sectionNamed(const char *sectionName)
 		if (idx <= iSection) {
 			iSection++;
 		}
+		headerStrip.reset();
+		invalidate();
 	}
 	return idx;
 }
@@ -482,6 +550,7 @@ void Menu::deleteSelectedLink()
 		unlink(selLinkApp()->getFile().c_str());
 	sectionLinks()->erase( sectionLinks()->begin() + selLinkIndex() );
 	setLinkIndex(selLinkIndex());
+	invalidate();
 
 	bool icon_used = false;
 	for (auto& section : links) {
@@ -502,9 +571,11 @@ void Menu::deleteSelectedSection()
 	INFO("Deleting section '%s'\n", sectionName.c_str());
 
 	gmenu2x.sc.del("sections/" + sectionName + ".png");
+	sectionIcons.erase(sectionName);
 	auto idx = selSectionIndex();
 	links.erase(links.begin() + idx);
 	sections.erase(sections.begin() + idx);
+	headerStrip.reset();
 	setSectionIndex(0); //reload sections
 
 	string path = GMenu2X::getHome() + "/sections/" + sectionName;
@@ -631,14 +702,58 @@ void Menu::setLinkIndex(int i) {
 		i = numLinks - 1;
 	else if (i >= numLinks)
 		i = 0;
+	const int oldLink = iLink;
 	iLink = i;
 
+	const uint oldFirstDispRow = iFirstDispRow;
 	int row = i / linkColumns;
 	if (row >= (int)(iFirstDispRow + linkRows - 1))
 		iFirstDispRow = min(row + 1, (int)DIV_ROUND_UP(numLinks, linkColumns) - 1)
 						- linkRows + 1;
 	else if (row <= (int)iFirstDispRow)
 		iFirstDispRow = max(row - 1, 0);
+
+	if (iFirstDispRow != oldFirstDispRow) {
+		// All visible links moved.
+		invalidate();
+	} else if (iLink != oldLink) {
+		// Both links are on the page that was painted last, so their
+		// positions are known.
+		if (oldLink >= 0 && oldLink < numLinks) {
+			invalidateLink(*links->at(oldLink));
+		}
+		if (iLink >= 0) {
+			invalidateLink(*links->at(iLink));
+		}
+		invalidateSelectionInfo();
+	}
+}
+
+void Menu::invalidateLink(Link& link) {
+	SDL_Rect rect = link.getRect();
+	if (auto selection = gmenu2x.selectionPng) {
+		// The selection image is centered on the link and can be larger.
+		if (selection->width() > rect.w) {
+			rect.x -= (selection->width() - rect.w + 1) / 2;
+			rect.w = selection->width() + 1;
+		}
+		if (selection->height() > rect.h) {
+			rect.y -= (selection->height() - rect.h + 1) / 2;
+			rect.h = selection->height() + 1;
+		}
+	}
+	invalidate(rect);
+}
+
+void Menu::invalidateSelectionInfo() {
+	// The description is painted just above the bottom bar, the clock
+	// speed and manual indicator are painted inside it.
+	const int top = gmenu2x.resY - gmenu2x.getSkinLayout().bottomBarHeight
+			- gmenu2x.font->getLineSpacing();
+	invalidate(SDL_Rect {
+		0, static_cast<Sint16>(top),
+		static_cast<Uint16>(gmenu2x.resX), static_cast<Uint16>(gmenu2x.resY - top)
+	});
 }
 
 #ifdef HAVE_LIBOPK
@@ -648,8 +763,10 @@ void Menu::openPackagesFromDir(std::string const& path)
 	if (readPackages(path)) {
 #ifdef ENABLE_INOTIFY
 		monitors.emplace_back(new Monitor(path.c_str()));
+		monitors.back()->start();
 #endif
 	}
+	opkCache->save();
 }
 
 void Menu::openPackage(std::string const& path, bool order)
@@ -658,57 +775,80 @@ void Menu::openPackage(std::string const& path, bool order)
 	 * (needed for instance when an OPK is modified) */
 	removePackageLink(path);
 
-	struct OPK *opk = opk_open(path.c_str());
-	if (!opk) {
-		ERROR("Unable to open OPK %s\n", path.c_str());
-		return;
+	OpkPackage const *package = opkCache->lookup(path);
+	if (!package) {
+		DEBUG("Reading meta-data of package %s\n", path.c_str());
+		OpkPackage fresh;
+		if (!opkCache->readPackage(path, fresh)) {
+			return;
+		}
+		package = &opkCache->store(path, move(fresh));
 	}
+	addPackageLinks(path, *package);
 
-	for (;;) {
-		bool has_metadata = false;
-		const char *name;
-
-		for (;;) {
-			string::size_type pos;
-			int ret = opk_open_metadata(opk, &name);
-			if (ret < 0) {
-				ERROR("Error while loading meta-data\n");
-				break;
-			} else if (!ret)
-			  break;
-
-			/* Strip .desktop */
-			string metadata(name);
-			pos = metadata.rfind('.');
-			metadata = metadata.substr(0, pos);
-
-			/* Keep only the platform name */
-			pos = metadata.rfind('.');
-			metadata = metadata.substr(pos + 1);
+	if (order) {
+		orderLinks();
+		opkCache->save();
+	}
+}
 
-			if (metadata == PLATFORM || metadata == "all") {
-				has_metadata = true;
-				break;
-			}
+void Menu::addPackageLinks(std::string const& path, OpkPackage const& package,
+		vector<unique_ptr<OffscreenSurface>> *icons)
+{
+	for (size_t i = 0; i < package.apps.size(); i++) {
+		OpkApp const& app = package.apps[i];
+		if (icons && (*icons)[i] && !gmenu2x.sc.exists(app.iconFile)) {
+			gmenu2x.sc.insert(app.iconFile, move((*icons)[i]));
 		}
 
-		if (!has_metadata)
-		  break;
-
-		// Note: OPK links can only be deleted by removing the OPK itself,
-		//       but that is not something we want to do in the menu,
-		//       so consider this link undeletable.
-		auto link = new LinkApp(gmenu2x, path, false, opk, name);
-		link->setSize(gmenu2x.skinConfInt["linkWidth"], gmenu2x.skinConfInt["linkHeight"]);
+		auto link = new LinkApp(gmenu2x, path, app);
+		link->setSize(gmenu2x.getSkinLayout().linkWidth, gmenu2x.getSkinLayout().linkHeight);
 
 		auto idx = sectionNamed(link->getCategory());
 		links[idx].emplace_back(link);
 	}
+	invalidate();
+}
 
-	opk_close(opk);
+void Menu::finishPackageScans()
+{
+	Link *selected = selLink();
 
-	if (order)
-		orderLinks();
+	for (auto it = scanners.begin(); it != scanners.end(); ) {
+		if (!(*it)->isFinished()) {
+			++it;
+			continue;
+		}
+		for (auto& result : (*it)->getResults()) {
+			if (!result.ok) {
+				continue;
+			}
+			// The package might have been opened meanwhile because of
+			// an inotify event.
+			removePackageLink(result.path);
+			// Or it might have been removed, together with its links, while
+			// it was being scanned.
+			if (!fileExists(result.path)) {
+				continue;
+			}
+			OpkPackage const& package =
+					opkCache->store(result.path, move(result.package));
+			addPackageLinks(result.path, package, &result.icons);
+		}
+		it = scanners.erase(it);
+	}
+
+	orderLinks();
+	opkCache->save();
+
+	// Sorting may have moved the selected link.
+	auto& sectionLinks = links[iSection];
+	for (size_t i = 0; i < sectionLinks.size(); i++) {
+		if (sectionLinks[i].get() == selected) {
+			setLinkIndex(i);
+			break;
+		}
+	}
 }
 
 bool Menu::readPackages(std::string const& parentDir)
@@ -718,6 +858,7 @@ bool Menu::readPackages(std::string const& parentDir)
 		return false;
 	}
 
+	vector<string> paths;
 	while (struct dirent *dptr = readdir(dirp)) {
 		if (dptr->d_type != DT_REG)
 			continue;
@@ -735,12 +876,29 @@ bool Menu::readPackages(std::string const& parentDir)
 			continue;
 		}
 
-		openPackage(parentDir + '/' + dptr->d_name, false);
+		paths.push_back(parentDir + '/' + dptr->d_name);
 	}
 
 	closedir(dirp);
+
+	// Packages that were not cached are read in the background.
+	sort(paths.begin(), paths.end());
+	vector<string> unknown;
+	for (auto& path : paths) {
+		removePackageLink(path);
+		OpkPackage const *package = opkCache->lookup(path);
+		if (package) {
+			addPackageLinks(path, *package);
+		} else {
+			unknown.push_back(path);
+		}
+	}
 	orderLinks();
 
+	if (!unknown.empty()) {
+		scanners.emplace_back(new PackageScanner(*opkCache, unknown));
+	}
+
 	return true;
 }
 
@@ -765,6 +923,7 @@ void Menu::removePackageLink(std::string const& path)
 					setLinkIndex(iLink - 1);
 				}
 				--link;
+				invalidate();
 			}
 		}
 	}
@@ -800,9 +959,10 @@ void Menu::orderLinks()
 	for (auto& section : links) {
 		sort(section.begin(), section.end(), compare_links);
 	}
+	invalidate();
 }
 
-void Menu::readLinks()
+void Menu::readLinks(LinkIndex& index)
 {
 	iLink = 0;
 	iFirstDispRow = 0;
@@ -813,35 +973,29 @@ void Menu::readLinks()
 		int correct = (i>sections.size() ? iSection : i);
 		string const& section = sections[correct];
 
-		readLinksOfSection(
+		readLinksOfSection(index,
 				links[i], GMENU2X_SYSTEM_DIR "/sections/" + section, false);
-		readLinksOfSection(
+		readLinksOfSection(index,
 				links[i], GMenu2X::getHome() + "/sections/" + section, true);
 	}
 
 	orderLinks();
 }
 
-void Menu::readLinksOfSection(
+void Menu::readLinksOfSection(LinkIndex& index,
 		vector<unique_ptr<Link>>& links, string const& path, bool deletable)
 {
-	DIR *dirp = opendir(path.c_str());
-	if (!dirp) return;
-
-	while (struct dirent *dptr = readdir(dirp)) {
-		if (dptr->d_type != DT_REG) continue;
-		string linkfile = path + '/' + dptr->d_name;
+	for (auto& entry : index.getLinkFiles(path)) {
+		string linkfile = path + '/' + entry.name;
 
-		LinkApp *link = new LinkApp(gmenu2x, linkfile, deletable);
+		LinkApp *link = new LinkApp(gmenu2x, linkfile, deletable, entry.fields);
 		if (link->targetExists()) {
 			link->setSize(
-					gmenu2x.skinConfInt["linkWidth"],
-					gmenu2x.skinConfInt["linkHeight"]);
+					gmenu2x.getSkinLayout().linkWidth,
+					gmenu2x.getSkinLayout().linkHeight);
 			links.emplace_back(link);
 		} else {
 			delete link;
 		}
 	}
-
-	closedir(dirp);
 }
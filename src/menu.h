@@ -28,12 +28,17 @@
 #include <functional>
 #include <memory>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 class GMenu2X;
 class IconButton;
 class LinkApp;
+class LinkIndex;
 class Monitor;
+class OpkCache;
+struct OpkPackage;
+class PackageScanner;
 
 
 /**
@@ -49,9 +54,11 @@ private:
 		bool isRunning() { return curr != 0; }
 		int currentValue() { return curr; }
 		void adjust(int delta);
+		/** Advances the animation by the time passed since the last step. */
 		void step();
 	private:
 		int curr;
+		Uint32 lastTick;
 	};
 
 	GMenu2X& gmenu2x;
@@ -59,34 +66,62 @@ private:
 	int iSection, iLink;
 	uint iFirstDispRow;
 	std::vector<std::string> sections;
+	/**
+	 * The icons of the sections, held here so the image collection cannot
+	 * drop them; nullptr for sections the skin has no icon for.
+	 */
+	std::unordered_map<std::string, std::shared_ptr<OffscreenSurface>>
+			sectionIcons;
 	std::vector<std::vector<std::unique_ptr<Link>>> links;
 
 	uint linkColumns, linkRows;
 
 	Animation sectionAnimation;
 
+	/**
+	 * The section headers around section headerCenter, rendered once so the
+	 * carousel animation only has to move them.
+	 */
+	std::unique_ptr<OffscreenSurface> headerStrip;
+	int headerCenter;
+	/**
+	 * Renders the headers of the sections leftSection - 1 up to and
+	 * including rightSection + 1, relative to the given center section.
+	 */
+	void renderHeaderStrip(int center, int leftSection, int rightSection);
+
 	/**
 	 * Determine which section headers are visible.
 	 * The output values are relative to the middle section at 0.
 	 */
 	void calcSectionRange(int &leftSection, int &rightSection);
 
-	void readLinks();
+	/** Returns the icon of the given section, loading it if needed. */
+	std::shared_ptr<OffscreenSurface> getSectionIcon(
+			std::string const& section);
+
+	void readLinks(LinkIndex& index);
 	void freeLinks();
 
 	// Load all the sections of the given "sections" directory.
-	void readSections(std::string const& parentDir);
+	void readSections(LinkIndex& index, std::string const& parentDir);
 
 #ifdef HAVE_LIBOPK
 	// Load all the .opk packages of the given directory
 	bool readPackages(std::string const& parentDir);
+	// Add the links of the applications in a package.
+	void addPackageLinks(std::string const& path, OpkPackage const& package,
+			std::vector<std::unique_ptr<OffscreenSurface>> *icons = nullptr);
+	std::unique_ptr<OpkCache> opkCache;
+	std::vector<std::unique_ptr<PackageScanner>> scanners;
 #ifdef ENABLE_INOTIFY
 	std::vector<std::unique_ptr<Monitor>> monitors;
 #endif
 #endif
 
 	// Load all the links on the given section directory.
-	void readLinksOfSection(std::vector<std::unique_ptr<Link>>& links,
+	void readLinksOfSection(LinkIndex& index,
+							std::vector<std::unique_ptr<Link>>& links,
 							std::string const& path, bool deletable);
 
 	/**
@@ -96,6 +131,17 @@ private:
 	 */
 	std::string createSectionDir(std::string const& sectionName);
 
+	/**
+	 * Marks the area of a link, including its selection, as in need of
+	 * a repaint.
+	 */
+	void invalidateLink(Link& link);
+	/**
+	 * Marks the information about the selected link as in need of
+	 * a repaint.
+	 */
+	void invalidateSelectionInfo();
+
 	void decSectionIndex();
 	void incSectionIndex();
 	void linkLeft();
@@ -112,6 +158,11 @@ public:
 #ifdef HAVE_LIBOPK
 	void openPackage(std::string const& path, bool order = true);
 	void openPackagesFromDir(std::string const& path);
+	/**
+	 * Adds the links of packages that were read in the background.
+	 * Called when a PACKAGES_SCANNED event is received.
+	 */
+	void finishPackageScans();
 #ifdef ENABLE_INOTIFY
 	void removePackageLink(std::string const& path);
 #endif
@@ -151,6 +202,7 @@ public:
 	virtual bool runAnimations();
 	virtual void paint(Surface &s);
 	virtual bool handleButtonPress(InputManager::Button button);
+	virtual Profiler::Phase getPaintPhase() { return Profiler::PAINT_MENU; }
 
 	int selLinkIndex();
 	Link *selLink();
@@ -28,66 +28,90 @@ bool Monitor::event_accepted(struct inotify_event &event)
 	return len >= 5 && !strncmp(event.name + len - 4, ".opk", 4);
 }
 
-int Monitor::run()
+bool Monitor::start()
 {
-	DEBUG("Starting inotify thread for path %s...\n", path.c_str());
-
-	int fd = inotify_init1(IN_CLOEXEC);
+	fd = inotify_init1(IN_CLOEXEC);
 	if (fd < 0) {
 		ERROR("Unable to start inotify\n");
-		return fd;
+		return false;
 	}
 
-	int wd = inotify_add_watch(fd, path.c_str(), mask);
-	if (wd < 0) {
+	if (inotify_add_watch(fd, path.c_str(), mask) < 0) {
 		ERROR("Unable to add inotify watch on '%s': %s\n",
 				path.c_str(), strerror(errno));
 		close(fd);
-		return wd;
+		fd = -1;
+		return false;
 	}
 
-	DEBUG("Starting watching directory %s\n", path.c_str());
+	DEBUG("Starting inotify thread for path %s...\n", path.c_str());
+	started = pthread_create(&thd, NULL, threadMain, this) == 0;
+	return started;
+}
 
-	for (;;) {
-		size_t len = sizeof(struct inotify_event) + NAME_MAX + 1;
-		struct inotify_event event;
-		char buf[256];
+void Monitor::stop()
+{
+	if (started) {
+		pthread_cancel(thd);
+		pthread_join(thd, NULL);
+		started = false;
+		DEBUG("Monitor thread stopped (was watching %s)\n", path.c_str());
+	}
+	if (fd >= 0) {
+		close(fd);
+		fd = -1;
+	}
+}
 
-		read(fd, &event, len);
+void *Monitor::threadMain(void *monitor)
+{
+	static_cast<Monitor *>(monitor)->run();
+	return NULL;
+}
 
-		if (event.mask & (IN_DELETE_SELF | IN_MOVE_SELF)) {
-			inject_event(false, path.c_str());
+void Monitor::run()
+{
+	// A single read can return several events.
+	char buf[sizeof(struct inotify_event) + NAME_MAX + 1]
+			__attribute__((aligned(__alignof__(struct inotify_event))));
+	for (;;) {
+		ssize_t len = read(fd, buf, sizeof(buf));
+		if (len <= 0) {
+			if (len < 0 && errno == EINTR)
+				continue;
+			ERROR("Unable to read inotify events: %s\n", strerror(errno));
 			break;
 		}
 
-		sprintf(buf, "%s/%s", path.c_str(), event.name);
+		for (char *ptr = buf; ptr < buf + len; ) {
+			struct inotify_event &event =
+					*reinterpret_cast<struct inotify_event *>(ptr);
+			ptr += sizeof(struct inotify_event) + event.len;
 
-		if (!event_accepted(event))
-			continue;
+			if (event.mask & (IN_DELETE_SELF | IN_MOVE_SELF)) {
+				inject_event(false, path.c_str());
+				return;
+			}
 
-		inject_event(event.mask & (IN_MOVED_TO | IN_CLOSE_WRITE | IN_CREATE), buf);
-	}
+			// Events without a file name are about the watch itself.
+			if (!event.len || !event_accepted(event))
+				continue;
 
-	return 0;
-}
-
-static void * inotify_thd(void *p)
-{
-	Monitor *monitor = (Monitor *) p;
-	monitor->run();
-	return NULL;
+			const std::string file = path + "/" + event.name;
+			inject_event(event.mask & (IN_MOVED_TO | IN_CLOSE_WRITE | IN_CREATE),
+					file.c_str());
+		}
+	}
 }
 
-Monitor::Monitor(std::string path, unsigned int flags) : path(path)
+Monitor::Monitor(std::string path, unsigned int flags)
+	: path(path), fd(-1), started(false)
 {
 	mask = flags;
-	pthread_create(&thd, NULL, inotify_thd, (void *) this);
 }
 
 Monitor::~Monitor()
 {
-	pthread_cancel(thd);
-	pthread_join(thd, NULL);
-	DEBUG("Monitor thread stopped (was watching %s)\n", path.c_str());
+	stop();
 }
 #endif
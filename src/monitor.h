@@ -13,12 +13,28 @@ public:
 				IN_DELETE_SELF | IN_MOVE_SELF);
 	virtual ~Monitor();
 
-	int run();
+	/**
+	 * Adds the watch and starts the thread that reports its events.
+	 * Since events are handled by virtual methods, this must only be
+	 * called once the object is fully constructed.
+	 * Returns false if the watch could not be added.
+	 */
+	bool start();
+	/**
+	 * Stops the thread. Subclasses call this from their destructor, so no
+	 * event reaches their methods once those are gone.
+	 */
+	void stop();
 	const std::string getPath() { return path; }
 
 private:
+	static void *threadMain(void *monitor);
+	void run();
+
 	std::string path;
 	pthread_t thd;
+	int fd;
+	bool started;
 
 protected:
 	unsigned int mask;
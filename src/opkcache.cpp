@@ -0,0 +1,383 @@
+// Various authors.
+// License: GPL version 2 or later.
+
+#ifdef HAVE_LIBOPK
+#include "opkcache.h"
+
+#include "binaryio.h"
+#include "debug.h"
+#include "utilities.h"
+
+#include <opk.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <array>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <mutex>
+
+#ifdef HAVE_LIBXDGMIME
+#include <xdgmime.h>
+#endif
+
+using namespace std;
+
+/* Identifies the file format; change it whenever the format changes. */
+static const uint32_t CACHE_MAGIC = 0x4f32474d; // "MG2O", version 1
+
+static array<const char *, 4> tokens = { "%f", "%F", "%u", "%U", };
+
+#ifdef HAVE_LIBXDGMIME
+/* The xdgmime library keeps global state and is not thread safe. */
+static mutex xdgMimeMutex;
+#endif
+
+OpkCache::OpkCache(string const& file, string const& iconDir,
+		string const& lang)
+	: file(file)
+	, iconDir(iconDir)
+	, lang(lang)
+	, modified(false)
+{
+	if (mkdir(iconDir.c_str(), 0770) < 0 && errno != EEXIST) {
+		WARNING("Unable to create OPK icon directory '%s'\n", iconDir.c_str());
+	}
+	load();
+}
+
+static void writeApp(BinaryWriter& out, OpkApp const& app)
+{
+	out.writeString(app.metadata);
+	out.writeString(app.category);
+	out.writeString(app.title);
+	out.writeString(app.description);
+	out.writeString(app.manual);
+	out.writeString(app.icon);
+	out.writeString(app.iconFile);
+	out.writeString(app.selectorFilter);
+	out.writeU8(app.consoleApp);
+	out.writeU8(app.takesFileArg);
+}
+
+static bool readApp(BinaryReader& in, OpkApp& app)
+{
+	uint8_t consoleApp, takesFileArg;
+	bool ok = in.readString(app.metadata)
+			&& in.readString(app.category)
+			&& in.readString(app.title)
+			&& in.readString(app.description)
+			&& in.readString(app.manual)
+			&& in.readString(app.icon)
+			&& in.readString(app.iconFile)
+			&& in.readString(app.selectorFilter)
+			&& in.readU8(consoleApp)
+			&& in.readU8(takesFileArg);
+	app.consoleApp = consoleApp;
+	app.takesFileArg = takesFileArg;
+	return ok;
+}
+
+void OpkCache::load()
+{
+	if (!fileExists(file)) {
+		return;
+	}
+
+	string data = readFileAsString(file);
+	BinaryReader in(data);
+	uint32_t magic, numPackages;
+	string cachedLang;
+	if (!in.readU32(magic) || magic != CACHE_MAGIC
+			|| !in.readString(cachedLang) || !in.readU32(numPackages)) {
+		WARNING("Ignoring OPK cache '%s' of unknown format\n", file.c_str());
+		return;
+	}
+	if (cachedLang != lang) {
+		DEBUG("OPK cache was written for another language\n");
+		modified = true;
+		return;
+	}
+
+	bool ok = true;
+	for (uint32_t i = 0; ok && i < numPackages; i++) {
+		string path;
+		OpkPackage package;
+		uint32_t numApps;
+		ok = in.readString(path) && in.readU64(package.size)
+				&& in.readU64(package.mtimeSec)
+				&& in.readU64(package.mtimeNsec)
+				&& in.readU32(numApps);
+		for (uint32_t j = 0; ok && j < numApps; j++) {
+			OpkApp app;
+			ok = readApp(in, app);
+			package.apps.push_back(move(app));
+		}
+		if (ok) {
+			packages[path] = move(package);
+		}
+	}
+
+	if (!ok || !in.atEnd()) {
+		WARNING("OPK cache '%s' is corrupt; rebuilding it\n", file.c_str());
+		packages.clear();
+		modified = true;
+	}
+}
+
+bool OpkCache::save()
+{
+	for (auto it = packages.begin(); it != packages.end(); ) {
+		if (fileExists(it->first)) {
+			++it;
+			continue;
+		}
+		DEBUG("Dropping package %s from the OPK cache\n", it->first.c_str());
+		for (auto& app : it->second.apps) {
+			if (!app.iconFile.empty()) {
+				unlink(app.iconFile.c_str());
+			}
+		}
+		it = packages.erase(it);
+		modified = true;
+	}
+	if (!modified) {
+		return true;
+	}
+
+	BinaryWriter out;
+	out.writeU32(CACHE_MAGIC);
+	out.writeString(lang);
+	out.writeU32(packages.size());
+	for (auto& it : packages) {
+		OpkPackage const& package = it.second;
+		out.writeString(it.first);
+		out.writeU64(package.size);
+		out.writeU64(package.mtimeSec);
+		out.writeU64(package.mtimeNsec);
+		out.writeU32(package.apps.size());
+		for (auto& app : package.apps) {
+			writeApp(out, app);
+		}
+	}
+
+	if (!writeStringToFile(file, out.data())) {
+		WARNING("Unable to write OPK cache '%s'\n", file.c_str());
+		return false;
+	}
+	modified = false;
+	return true;
+}
+
+OpkPackage const *OpkCache::lookup(string const& path)
+{
+	auto it = packages.find(path);
+	if (it == packages.end()) {
+		return nullptr;
+	}
+
+	OpkPackage const& package = it->second;
+	struct stat st;
+	if (stat(path.c_str(), &st) != 0
+			|| package.size != (uint64_t) st.st_size
+			|| package.mtimeSec != (uint64_t) st.st_mtim.tv_sec
+			|| package.mtimeNsec != (uint64_t) st.st_mtim.tv_nsec) {
+		return nullptr;
+	}
+	for (auto& app : package.apps) {
+		if (!app.iconFile.empty() && !fileExists(app.iconFile)) {
+			return nullptr;
+		}
+	}
+	return &package;
+}
+
+OpkPackage const& OpkCache::store(string const& path, OpkPackage&& package)
+{
+	modified = true;
+	OpkPackage& stored = packages[path];
+	stored = move(package);
+	return stored;
+}
+
+string OpkCache::iconFileFor(string const& path, string const& icon) const
+{
+	char name[2 * sizeof(size_t) + 5];
+	snprintf(name, sizeof(name), "%0*zx.png", (int) (2 * sizeof(size_t)),
+			hash<string>()(path + '#' + icon));
+	return iconDir + '/' + name;
+}
+
+/**
+ * Reads the key/value pairs of the currently opened meta-data file.
+ */
+static void readPairs(struct OPK *opk, string const& lang, OpkApp& app)
+{
+	const string localName = "Name[" + lang + "]";
+	const string localComment = "Comment[" + lang + "]";
+	string::size_type pos;
+	const char *key, *val;
+	size_t lkey, lval;
+	int ret;
+
+	while ((ret = opk_read_pair(opk, &key, &lkey, &val, &lval))) {
+		if (ret < 0) {
+			ERROR("Unable to read meta-data\n");
+			break;
+		}
+
+		string buf(val, lval);
+
+		if (!strncmp(key, "Categories", lkey)) {
+			app.category = buf;
+
+			pos = app.category.find(';');
+			if (pos != app.category.npos)
+				app.category = app.category.substr(0, pos);
+
+		} else if ((!strncmp(key, "Name", lkey) && app.title.empty())
+					|| !strncmp(key, localName.c_str(), lkey)) {
+			app.title = buf;
+
+		} else if ((!strncmp(key, "Comment", lkey) && app.description.empty())
+					|| !strncmp(key, localComment.c_str(), lkey)) {
+			app.description = buf;
+
+		} else if (!strncmp(key, "Terminal", lkey)) {
+			app.consoleApp = !strncmp(val, "true", lval);
+
+		} else if (!strncmp(key, "X-OD-Manual", lkey)) {
+			app.manual = buf;
+
+		} else if (!strncmp(key, "Icon", lkey)) {
+			app.icon = buf;
+
+		} else if (!strncmp(key, "Exec", lkey)) {
+			for (auto token : tokens) {
+				if (buf.find(token) != buf.npos) {
+					app.takesFileArg = true;
+					break;
+				}
+			}
+
+#ifdef HAVE_LIBXDGMIME
+		} else if (!strncmp(key, "MimeType", lkey)) {
+			string mimetypes = buf;
+			app.selectorFilter = "";
+
+			while ((pos = mimetypes.find(';')) != mimetypes.npos) {
+				int nb = 16;
+				char *extensions[nb];
+				string mimetype = mimetypes.substr(0, pos);
+				mimetypes = mimetypes.substr(pos + 1);
+
+				{
+					lock_guard<mutex> lock(xdgMimeMutex);
+					nb = xdg_mime_get_extensions_from_mime_type(
+								mimetype.c_str(), extensions, nb);
+				}
+
+				while (nb--) {
+					app.selectorFilter += (string) extensions[nb] + ',';
+					free(extensions[nb]);
+				}
+			}
+
+			/* Remove last comma */
+			if (!app.selectorFilter.empty()) {
+				app.selectorFilter.pop_back();
+				DEBUG("Compatible extensions: %s\n",
+						app.selectorFilter.c_str());
+			}
+#endif /* HAVE_LIBXDGMIME */
+		}
+	}
+}
+
+bool OpkCache::readPackage(string const& path, OpkPackage& package) const
+{
+	struct stat st;
+	if (stat(path.c_str(), &st) != 0) {
+		ERROR("Unable to stat OPK %s\n", path.c_str());
+		return false;
+	}
+	package.size = st.st_size;
+	package.mtimeSec = st.st_mtim.tv_sec;
+	package.mtimeNsec = st.st_mtim.tv_nsec;
+	package.apps.clear();
+
+	struct OPK *opk = opk_open(path.c_str());
+	if (!opk) {
+		ERROR("Unable to open OPK %s\n", path.c_str());
+		return false;
+	}
+
+	for (;;) {
+		bool has_metadata = false;
+		const char *name;
+
+		for (;;) {
+			string::size_type pos;
+			int ret = opk_open_metadata(opk, &name);
+			if (ret < 0) {
+				ERROR("Error while loading meta-data\n");
+				break;
+			} else if (!ret)
+			  break;
+
+			/* Strip .desktop */
+			string metadata(name);
+			pos = metadata.rfind('.');
+			metadata = metadata.substr(0, pos);
+
+			/* Keep only the platform name */
+			pos = metadata.rfind('.');
+			metadata = metadata.substr(pos + 1);
+
+			if (metadata == PLATFORM || metadata == "all") {
+				has_metadata = true;
+				break;
+			}
+		}
+
+		if (!has_metadata)
+		  break;
+
+		OpkApp app;
+		app.metadata = name;
+		app.category = "applications";
+		app.selectorFilter = "*";
+		app.consoleApp = false;
+		app.takesFileArg = false;
+		readPairs(opk, lang, app);
+		package.apps.push_back(move(app));
+	}
+
+	/* Extract the icons only after all meta-data has been read, so as not
+	 * to disturb the iteration over the meta-data files. */
+	for (auto& app : package.apps) {
+		if (app.icon.empty()) {
+			continue;
+		}
+
+		void *buf;
+		size_t len;
+		if (opk_extract_file(opk, (app.icon + ".png").c_str(), &buf, &len) < 0) {
+			WARNING("Unable to extract icon from OPK %s\n", path.c_str());
+			continue;
+		}
+		string iconFile = iconFileFor(path, app.icon);
+		if (writeStringToFile(iconFile, string((char *) buf, len))) {
+			app.iconFile = iconFile;
+		}
+		free(buf);
+	}
+
+	opk_close(opk);
+	return true;
+}
+
+#endif /* HAVE_LIBOPK */
@@ -0,0 +1,90 @@
+// Various authors.
+// License: GPL version 2 or later.
+
+#ifndef OPKCACHE_H
+#define OPKCACHE_H
+#ifdef HAVE_LIBOPK
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * The meta-data the menu needs of one application inside an OPK package.
+ */
+struct OpkApp {
+	/** Name of the .desktop file describing the application. */
+	std::string metadata;
+	std::string category, title, description, manual;
+	/** Value of the Icon key: an icon name without extension. */
+	std::string icon;
+	/** Copy of the icon extracted from the package, or empty if none. */
+	std::string iconFile;
+	/** Comma separated extensions accepted by the application. */
+	std::string selectorFilter;
+	bool consoleApp, takesFileArg;
+};
+
+/**
+ * The meta-data of all applications in an OPK package for this platform,
+ * along with the size and modification time of the package they were
+ * read from.
+ */
+struct OpkPackage {
+	uint64_t size, mtimeSec, mtimeNsec;
+	std::vector<OpkApp> apps;
+};
+
+/**
+ * Persistent cache of OPK meta-data, so packages that did not change since
+ * the previous run do not have to be opened at all.
+ * Packages are identified by their path, size and modification time.
+ */
+class OpkCache {
+public:
+	/**
+	 * Loads the cache from the given file, if it exists.
+	 * Extracted icons are stored in 'iconDir'.
+	 * Names and comments are picked for the language 'lang'; if the cache
+	 * was written for another language, it is discarded.
+	 */
+	OpkCache(std::string const& file, std::string const& iconDir,
+			std::string const& lang);
+
+	/**
+	 * Returns the cached meta-data of the given package, or nullptr if
+	 * the package is not in the cache or changed since it was cached.
+	 */
+	OpkPackage const *lookup(std::string const& path);
+
+	/**
+	 * Stores meta-data that was read with readPackage().
+	 */
+	OpkPackage const& store(std::string const& path, OpkPackage&& package);
+
+	/**
+	 * Reads the meta-data of a package from the package itself.
+	 * This is slow; it does not touch the cache, so it can be run on any
+	 * thread, including several threads at once.
+	 */
+	bool readPackage(std::string const& path, OpkPackage& package) const;
+
+	/**
+	 * Writes the cache back to its file if it was changed.
+	 * Packages that no longer exist are dropped along with their icons.
+	 */
+	bool save();
+
+private:
+	void load();
+	std::string iconFileFor(std::string const& path,
+			std::string const& icon) const;
+
+	std::string file, iconDir, lang;
+	std::unordered_map<std::string, OpkPackage> packages;
+	bool modified;
+};
+
+#endif /* HAVE_LIBOPK */
+#endif // OPKCACHE_H
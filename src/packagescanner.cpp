@@ -0,0 +1,69 @@
+// Various authors.
+// License: GPL version 2 or later.
+
+#ifdef HAVE_LIBOPK
+#include "packagescanner.h"
+
+#include "debug.h"
+#include "inputmanager.h"
+#include "surface.h"
+#include "utilities.h"
+
+#include <algorithm>
+
+using namespace std;
+
+PackageScanner::PackageScanner(
+		OpkCache const& cache, vector<string> const& paths)
+	: cache(cache)
+	, results(paths.size())
+	, next(0)
+	, remaining(paths.size())
+	, cancelled(false)
+{
+	for (size_t i = 0; i < paths.size(); i++) {
+		results[i].path = paths[i];
+		results[i].ok = false;
+	}
+
+	const size_t numThreads = min<size_t>(
+			max(thread::hardware_concurrency(), 1u), paths.size());
+	DEBUG("Scanning %zu packages on %zu threads\n", paths.size(), numThreads);
+	for (size_t i = 0; i < numThreads; i++) {
+		threads.emplace_back(&PackageScanner::run, this);
+	}
+}
+
+PackageScanner::~PackageScanner()
+{
+	cancelled = true;
+	for (auto& thread : threads) {
+		thread.join();
+	}
+}
+
+void PackageScanner::run()
+{
+	for (;;) {
+		const size_t i = next++;
+		if (cancelled || i >= results.size()) {
+			break;
+		}
+
+		Result& result = results[i];
+		result.ok = cache.readPackage(result.path, result.package);
+		if (result.ok) {
+			for (auto& app : result.package.apps) {
+				result.icons.push_back(app.iconFile.empty()
+						? nullptr
+						: OffscreenSurface::loadImage(app.iconFile));
+			}
+		}
+
+		if (--remaining == 0) {
+			inject_user_event(PACKAGES_SCANNED);
+		}
+	}
+}
+
+#endif /* HAVE_LIBOPK */
@@ -0,0 +1,61 @@
+// Various authors.
+// License: GPL version 2 or later.
+
+#ifndef PACKAGESCANNER_H
+#define PACKAGESCANNER_H
+#ifdef HAVE_LIBOPK
+
+#include "opkcache.h"
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+class OffscreenSurface;
+
+/**
+ * Reads the meta-data of OPK packages and decodes their icons on a pool of
+ * worker threads, one per CPU core.
+ * When all packages have been read, a PACKAGES_SCANNED event is sent so the
+ * main thread can pick up the results.
+ */
+class PackageScanner {
+public:
+	struct Result {
+		std::string path;
+		bool ok;
+		OpkPackage package;
+		/** Decoded icon of each application; nullptr if there is none. */
+		std::vector<std::unique_ptr<OffscreenSurface>> icons;
+	};
+
+	PackageScanner(OpkCache const& cache, std::vector<std::string> const& paths);
+
+	/**
+	 * Stops the workers once they are done with the package they are
+	 * reading, discarding all results.
+	 */
+	~PackageScanner();
+
+	bool isFinished() { return remaining == 0; }
+
+	/**
+	 * Returns the results in the same order as the paths that were passed
+	 * to the constructor. Only valid once the scan is finished.
+	 */
+	std::vector<Result>& getResults() { return results; }
+
+private:
+	void run();
+
+	OpkCache const& cache;
+	std::vector<Result> results;
+	std::atomic<size_t> next, remaining;
+	std::atomic<bool> cancelled;
+	std::vector<std::thread> threads;
+};
+
+#endif /* HAVE_LIBOPK */
+#endif // PACKAGESCANNER_H
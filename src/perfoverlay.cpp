@@ -0,0 +1,119 @@
+// Various authors.
+// License: GPL version 2 or later.
+
+#include "perfoverlay.h"
+
+#include "gmenu2x.h"
+
+#include <algorithm>
+#include <cstdio>
+
+using namespace std;
+
+/* Time between updates of the numbers, in microseconds. */
+#define UPDATE_INTERVAL 500000
+
+
+PerfOverlay::PerfOverlay(GMenu2X& gmenu2x)
+	: gmenu2x(gmenu2x)
+	, lastUpdate(Profiler::now())
+	, lastPixelsPushed(gmenu2x.s->getTotalPixelsPushed())
+	, box({ 0, 0, 0, 0 })
+{
+	for (int i = 0; i < Profiler::NUM_PHASES; i++) {
+		previous[i] = Profiler::getStats(static_cast<Profiler::Phase>(i));
+	}
+}
+
+bool PerfOverlay::runAnimations() {
+	// Keep the main loop running while the overlay is shown, so the numbers
+	// are updated even when nothing else happens.
+	const uint64_t now = Profiler::now();
+	if (now - lastUpdate < UPDATE_INTERVAL) {
+		return true;
+	}
+	const uint64_t elapsed = now - lastUpdate;
+	lastUpdate = now;
+
+	lines.clear();
+	for (int i = 0; i < Profiler::NUM_PHASES; i++) {
+		const Profiler::Phase phase = static_cast<Profiler::Phase>(i);
+		const Profiler::Stats current = Profiler::getStats(phase);
+
+		// Only look at what happened since the previous update.
+		Profiler::Stats recent = current;
+		Profiler::Stats const& old = previous[i];
+		recent.count -= old.count;
+		recent.totalUs -= old.totalUs;
+		for (unsigned int b = 0; b < Profiler::NUM_BUCKETS; b++) {
+			recent.buckets[b] -= old.buckets[b];
+		}
+		previous[i] = current;
+
+		char line[64];
+		if (recent.count) {
+			snprintf(line, sizeof(line), "%s: %u/s %.1f ms, 95%% < %.1f ms",
+					Profiler::getName(phase),
+					(unsigned int) (recent.count * 1000000ull / elapsed),
+					recent.totalUs / recent.count / 1000.0,
+					recent.percentile(95) / 1000.0);
+		} else {
+			snprintf(line, sizeof(line), "%s: -", Profiler::getName(phase));
+		}
+		lines.push_back(line);
+	}
+	{
+		FrameScheduler const& frames = gmenu2x.getFrameScheduler();
+		char line[64];
+		snprintf(line, sizeof(line), "frames: %u late, %u dropped",
+				frames.getLateFrames(), frames.getDroppedFrames());
+		lines.push_back(line);
+	}
+	{
+		const uint64_t pushed = gmenu2x.s->getTotalPixelsPushed();
+		char line[64];
+		snprintf(line, sizeof(line), "pushed: %llu kpx/s",
+				(unsigned long long) ((pushed - lastPixelsPushed)
+						* 1000000ull / elapsed / 1000));
+		lastPixelsPushed = pushed;
+		lines.push_back(line);
+	}
+	{
+		SurfaceCollection::Stats const& images = gmenu2x.sc.getStats();
+		char line[64];
+		snprintf(line, sizeof(line), "images: %zu KiB, %u/%u hits, %u evicted",
+				images.bytes / 1024, images.hits, images.hits + images.misses,
+				images.evictions);
+		lines.push_back(line);
+	}
+
+	Font& font = *gmenu2x.font;
+	int width = 0;
+	for (auto& line : lines) {
+		width = max(width, font.getTextWidth(line));
+	}
+	invalidate(box);
+	box = SDL_Rect {
+		0, 0,
+		static_cast<Uint16>(width + 8),
+		static_cast<Uint16>(lines.size() * font.getLineSpacing() + 4)
+	};
+	invalidate(box);
+
+	return true;
+}
+
+void PerfOverlay::paint(Surface& s) {
+	Font& font = *gmenu2x.font;
+
+	s.box(box, gmenu2x.skinConfColors[COLOR_MESSAGE_BOX_BG]);
+	int y = box.y + 2;
+	for (auto& line : lines) {
+		font.write(s, line, box.x + 4, y);
+		y += font.getLineSpacing();
+	}
+}
+
+bool PerfOverlay::handleButtonPress(InputManager::Button) {
+	return false;
+}
@@ -0,0 +1,45 @@
+// Various authors.
+// License: GPL version 2 or later.
+
+#ifndef PERFOVERLAY_H
+#define PERFOVERLAY_H
+
+#include "layer.h"
+#include "profiler.h"
+
+#include <SDL.h>
+#include <string>
+#include <vector>
+
+class GMenu2X;
+
+
+/**
+ * Shows the recent timings of the main loop phases on top of the menu.
+ * Each line covers the time since the previous update.
+ */
+class PerfOverlay : public Layer {
+public:
+	PerfOverlay(GMenu2X& gmenu2x);
+
+	/**
+	 * Removes the overlay from the layer stack.
+	 */
+	void close() { dismiss(); }
+
+	// Layer implementation:
+	virtual bool runAnimations();
+	virtual void paint(Surface& s);
+	virtual bool handleButtonPress(InputManager::Button button);
+	virtual Profiler::Phase getPaintPhase() { return Profiler::PAINT_OVERLAY; }
+
+private:
+	GMenu2X& gmenu2x;
+	Profiler::Stats previous[Profiler::NUM_PHASES];
+	uint64_t lastUpdate;
+	uint64_t lastPixelsPushed;
+	std::vector<std::string> lines;
+	SDL_Rect box;
+};
+
+#endif // PERFOVERLAY_H
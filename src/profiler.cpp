@@ -0,0 +1,88 @@
+// Various authors.
+// License: GPL version 2 or later.
+
+#include "profiler.h"
+
+#include "debug.h"
+
+#include <algorithm>
+#include <ctime>
+#include <mutex>
+
+using namespace std;
+
+static const char *phaseNames[Profiler::NUM_PHASES] = {
+	"animations",
+	"paint",
+	"paint bg",
+	"paint menu",
+	"paint popup",
+	"paint overlay",
+	"flip",
+	"input wait",
+	"image load",
+	"text render",
+};
+
+static mutex statsMutex;
+static Profiler::Stats stats[Profiler::NUM_PHASES];
+
+uint64_t Profiler::now()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+void Profiler::record(Phase phase, uint64_t us)
+{
+	unsigned int bucket = 0;
+	while (bucket + 1 < NUM_BUCKETS && (us >> (bucket + 1)) != 0) {
+		bucket++;
+	}
+
+	lock_guard<mutex> lock(statsMutex);
+	Stats& s = stats[phase];
+	s.count++;
+	s.totalUs += us;
+	s.maxUs = max<uint64_t>(s.maxUs, min<uint64_t>(us, UINT32_MAX));
+	s.buckets[bucket]++;
+}
+
+Profiler::Stats Profiler::getStats(Phase phase)
+{
+	lock_guard<mutex> lock(statsMutex);
+	return stats[phase];
+}
+
+const char *Profiler::getName(Phase phase)
+{
+	return phaseNames[phase];
+}
+
+uint32_t Profiler::Stats::percentile(unsigned int pct) const
+{
+	const unsigned int wanted = (count * pct + 99) / 100;
+	unsigned int seen = 0;
+	for (unsigned int i = 0; i < NUM_BUCKETS; i++) {
+		seen += buckets[i];
+		if (seen >= wanted) {
+			return 2u << i;
+		}
+	}
+	return maxUs;
+}
+
+void Profiler::dump()
+{
+	INFO("Timings in microseconds (count / average / 95%% below / max):\n");
+	for (int i = 0; i < NUM_PHASES; i++) {
+		Stats s = getStats(static_cast<Phase>(i));
+		if (!s.count) {
+			continue;
+		}
+		INFO("  %-12s %8u %8llu %8u %8u\n", phaseNames[i], s.count,
+				(unsigned long long) (s.totalUs / s.count),
+				s.percentile(95), s.maxUs);
+	}
+}
@@ -0,0 +1,73 @@
+// Various authors.
+// License: GPL version 2 or later.
+
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <cstdint>
+
+/**
+ * Collects how long the phases of the main loop and a few expensive
+ * operations take, so performance can be checked on the device itself.
+ * Durations are kept in histograms with power-of-two buckets.
+ * Timings can be recorded from any thread.
+ */
+class Profiler {
+public:
+	enum Phase {
+		ANIMATIONS,
+		/** Painting of layers that have no phase of their own. */
+		PAINT,
+		PAINT_BACKGROUND,
+		PAINT_MENU,
+		PAINT_POPUP,
+		PAINT_OVERLAY,
+		FLIP,
+		INPUT_WAIT,
+		IMAGE_LOAD,
+		TEXT_RENDER,
+
+		NUM_PHASES
+	};
+
+	/** Bucket i counts durations of less than 2^(i+1) microseconds. */
+	static const unsigned int NUM_BUCKETS = 20;
+
+	struct Stats {
+		unsigned int count;
+		uint64_t totalUs;
+		uint32_t maxUs;
+		unsigned int buckets[NUM_BUCKETS];
+
+		/**
+		 * Returns an upper bound for the given percentile of the
+		 * durations, in microseconds.
+		 */
+		uint32_t percentile(unsigned int pct) const;
+	};
+
+	/**
+	 * Records the time between its construction and its destruction.
+	 */
+	class Timer {
+	public:
+		Timer(Phase phase) : phase(phase), start(now()) {}
+		~Timer() { record(phase, now() - start); }
+
+	private:
+		Phase phase;
+		uint64_t start;
+	};
+
+	/** Returns a monotonic timestamp in microseconds. */
+	static uint64_t now();
+
+	static void record(Phase phase, uint64_t us);
+	static Stats getStats(Phase phase);
+	static const char *getName(Phase phase);
+
+	/** Writes the statistics of all phases to the log. */
+	static void dump();
+};
+
+#endif // PROFILER_H
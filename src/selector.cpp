@@ -23,6 +23,7 @@
 #include "debug.h"
 #include "filelister.h"
 #include "gmenu2x.h"
+#include "imageloader.h"
 #include "linkapp.h"
 #include "menu.h"
 #include "surface.h"
@@ -39,6 +40,12 @@
 
 using namespace std;
 
+/**
+ * Number of entries before and after the selected one for which the
+ * screenshot is loaded in advance.
+ */
+static const int PREVIEW_PREFETCH = 3;
+
 Selector::Selector(GMenu2X& gmenu2x, LinkApp& link, const string &selectorDir)
 	: Dialog(gmenu2x)
 	, link(link)
@@ -47,12 +54,13 @@ Selector::Selector(GMenu2X& gmenu2x, LinkApp& link, const string &selectorDir)
 	if (dir[dir.length()-1]!='/') dir += "/";
 }
 
-int Selector::exec(int startSelection) {
+bool Selector::exec(const string &startFile) {
 	const bool showDirectories = link.getSelectorBrowser();
 
 	FileLister fl;
 	fl.setShowDirectories(showDirectories);
 	fl.setFilter(link.getSelectorFilter());
+	fl.setCache(&gmenu2x.listings);
 	while (!prepare(fl) && showDirectories && dir != "/") {
 		// The given directory could not be opened; try parent.
 		dir = parentDir(dir);
@@ -64,7 +72,7 @@ int Selector::exec(int startSelection) {
 	writeSubTitle(bg, link.getDescription());
 
 	int x = 5;
-	if (fl.size() != 0) {
+	if (fl.size() != 0 || fl.isScanning()) {
 		x = gmenu2x.drawButton(bg, "accept", gmenu2x.tr["Select"], x);
 	}
 	if (showDirectories) {
@@ -93,19 +101,48 @@ int Selector::exec(int startSelection) {
 
 	bg.convertToDisplayFormat();
 
+	// The directory is listed in the background, so the entry to select
+	// may not be there yet: 'follow' is selected once it shows up, unless
+	// the user moves first. Entries are remembered by name, since indices
+	// change while the listing grows.
 	unsigned int firstElement = 0;
-	unsigned int selected = constrain(startSelection, 0, fl.size() - 1);
+	unsigned int selected = 0;
+	string follow = startFile;
+	bool followFile = true;
+
+	// Screenshots larger than the screen are shrunk once and then kept in
+	// the thumbnail cache.
+	ImageLoader previews(2 * PREVIEW_PREFETCH + 2, [&](string const& path) {
+		return gmenu2x.thumbnails.load(path, gmenu2x.resX, gmenu2x.resY);
+	});
+	auto previewPath = [&](unsigned int i) {
+		return screendir + trimExtension(fl[i]) + ".png";
+	};
 
 	bool close = false, result = true;
 	while (!close) {
 		OutputSurface& s = *gmenu2x.s;
 
+		fl.update(selected);
+		if (!follow.empty()) {
+			int index = followFile
+					? fl.findFile(follow) : fl.findDirectory(follow);
+			if (index >= 0) {
+				selected = index;
+				follow.clear();
+			} else if (!fl.isScanning()) {
+				follow.clear();
+			}
+		}
+
 		bg.blit(s, 0, 0);
 
 		if (fl.size() == 0) {
-			gmenu2x.font->write(s, "(" + gmenu2x.tr["no items"] + ")",
-					4, top + lineHeight / 2,
-					Font::HAlignLeft, Font::VAlignMiddle);
+			if (!fl.isScanning()) {
+				gmenu2x.font->write(s, "(" + gmenu2x.tr["no items"] + ")",
+						4, top + lineHeight / 2,
+						Font::HAlignLeft, Font::VAlignMiddle);
+			}
 		} else {
 			if (selected >= firstElement + nb_elements)
 				firstElement = selected - nb_elements + 1;
@@ -113,9 +150,20 @@ int Selector::exec(int startSelection) {
 				firstElement = selected;
 
 			//Screenshot
+			vector<string> wanted;
+			for (int offset = 0; offset <= PREVIEW_PREFETCH; offset++) {
+				unsigned int next = (selected + offset) % fl.size();
+				unsigned int prev = (selected + fl.size() - offset) % fl.size();
+				if (fl.isFile(next)) {
+					wanted.push_back(previewPath(next));
+				}
+				if (offset && prev != next && fl.isFile(prev)) {
+					wanted.push_back(previewPath(prev));
+				}
+			}
+			previews.request(wanted);
 			if (fl.isFile(selected)) {
-				string path = screendir + trimExtension(fl[selected]) + ".png";
-				auto screenshot = OffscreenSurface::loadImage(path, false);
+				auto screenshot = previews.get(previewPath(selected));
 				if (screenshot) {
 					screenshot->blitRight(s, 320, 0, 320, 240, 128u);
 				}
@@ -150,10 +198,22 @@ int Selector::exec(int startSelection) {
 			s.clearClipRect();
 		}
 
-		gmenu2x.drawScrollBar(nb_elements, fl.size(), firstElement);
+		gmenu2x.drawScrollBar(s, nb_elements, fl.size(), firstElement);
 		s.flip();
 
-		switch (gmenu2x.input.waitForPressedButton()) {
+		InputManager::Button button = gmenu2x.input.waitForPressedButton();
+		if (button != InputManager::REPAINT) {
+			follow.clear();
+		}
+		// Nothing to move to while the directory is still being listed.
+		if (fl.size() == 0 && (button == InputManager::UP
+				|| button == InputManager::DOWN
+				|| button == InputManager::ALTLEFT
+				|| button == InputManager::ALTRIGHT)) {
+			continue;
+		}
+
+		switch (button) {
 			case InputManager::SETTINGS:
 				close = true;
 				result = false;
@@ -192,7 +252,9 @@ int Selector::exec(int startSelection) {
 				// ...fall through...
 			case InputManager::LEFT:
 				if (showDirectories) {
-					selected = goToParentDir(fl);
+					follow = goToParentDir(fl);
+					followFile = false;
+					selected = 0;
 					firstElement = 0;
 				}
 				break;
@@ -205,12 +267,13 @@ int Selector::exec(int startSelection) {
 					} else {
 						string subdir = fl[selected];
 						if (subdir == "..") {
-							selected = goToParentDir(fl);
+							follow = goToParentDir(fl);
+							followFile = false;
 						} else {
 							dir += subdir + '/';
 							prepare(fl);
-							selected = 0;
 						}
+						selected = 0;
 						firstElement = 0;
 					}
 				}
@@ -221,11 +284,11 @@ int Selector::exec(int startSelection) {
 		}
 	}
 
-	return result ? (int)selected : -1;
+	return result;
 }
 
 bool Selector::prepare(FileLister& fl) {
-	bool opened = fl.browse(dir);
+	bool opened = fl.browseAsync(dir);
 
 	screendir = dir;
 	if (!screendir.empty() && screendir[screendir.length() - 1] != '/') {
@@ -236,12 +299,9 @@ bool Selector::prepare(FileLister& fl) {
 	return opened;
 }
 
-int Selector::goToParentDir(FileLister& fl) {
+string Selector::goToParentDir(FileLister& fl) {
 	string oldDir = dir;
 	dir = parentDir(dir);
 	prepare(fl);
-	string oldName = oldDir.substr(dir.size(), oldDir.size() - dir.size() - 1);
-	auto& subdirs = fl.getDirectories();
-	auto it = find(subdirs.begin(), subdirs.end(), oldName);
-	return it == subdirs.end() ? 0 : it - subdirs.begin();
+	return oldDir.substr(dir.size(), oldDir.size() - dir.size() - 1);
 }
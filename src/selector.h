@@ -39,15 +39,19 @@ private:
 
 	/**
 	 * Changes 'dir' to its parent directory.
-	 * Returns the index of the old dir in the parent, or 0 if unknown.
+	 * Returns the name of the old dir in the parent.
 	 */
-	int goToParentDir(FileLister& fl);
+	std::string goToParentDir(FileLister& fl);
 
 public:
 	Selector(GMenu2X& gmenu2x, LinkApp& link,
 			const std::string &selectorDir = "");
 
-	int exec(int startSelection = 0);
+	/**
+	 * Lets the user pick a file, starting at the entry with the given name.
+	 * Returns false if the user cancelled.
+	 */
+	bool exec(const std::string &startFile = "");
 
 	const std::string &getFile() { return file; }
 	const std::string &getDir() { return dir; }
@@ -34,7 +34,7 @@ SettingsDialog::SettingsDialog(
 	, inputMgr(inputMgr_)
 	, text(text_)
 {
-	if (!icon.empty() && gmenu2x.sc[icon] != NULL) {
+	if (!icon.empty() && gmenu2x.sc[icon]) {
 		this->icon = icon;
 	} else {
 		this->icon = "icons/generic.png";
@@ -48,7 +48,7 @@ bool SettingsDialog::exec() {
 	bool close = false;
 	uint i, sel = 0, firstElement = 0;
 
-	const int topBarHeight = gmenu2x.skinConfInt["topBarHeight"];
+	const int topBarHeight = gmenu2x.getSkinLayout().topBarHeight;
 	uint rowHeight = gmenu2x.font->getLineSpacing() + 1; // gp2x=15+1 / pandora=19+1
 	uint numRows = (gmenu2x.resY - topBarHeight - 20) / rowHeight;
 
@@ -83,7 +83,7 @@ bool SettingsDialog::exec() {
 			settings[i]->draw(maxNameWidth + 15, iY * rowHeight + topBarHeight + 2, rowHeight);
 		}
 
-		gmenu2x.drawScrollBar(numRows, settings.size(), firstElement);
+		gmenu2x.drawScrollBar(s, numRows, settings.size(), firstElement);
 
 		//description
 		writeSubTitle(s, settings[sel]->getDescription());
@@ -0,0 +1,96 @@
+// Various authors.
+// License: GPL version 2 or later.
+
+#ifdef ENABLE_INOTIFY
+#include "skinmonitor.h"
+
+#include "debug.h"
+
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <climits>
+#include <cstring>
+
+using namespace std;
+
+/* Time to wait for more changes before reporting them, in milliseconds. */
+#define SETTLE_TIME 500
+
+SkinMonitor::SkinMonitor(function<void()> changed)
+	: changed(move(changed))
+	, started(false)
+{
+	fd = inotify_init1(IN_CLOEXEC);
+	if (fd < 0) {
+		ERROR("Unable to start inotify\n");
+		return;
+	}
+
+	// Watches can be added while the thread waits for events.
+	started = pthread_create(&thd, NULL, threadMain, this) == 0;
+	if (!started) {
+		ERROR("Unable to start the skin monitor thread\n");
+	}
+}
+
+SkinMonitor::~SkinMonitor()
+{
+	if (started) {
+		pthread_cancel(thd);
+		pthread_join(thd, NULL);
+	}
+	if (fd >= 0) {
+		close(fd);
+	}
+}
+
+bool SkinMonitor::watch(string const& dir)
+{
+	if (!started) {
+		return false;
+	}
+	if (inotify_add_watch(fd, dir.c_str(), IN_MOVE | IN_CLOSE_WRITE
+				| IN_DELETE | IN_CREATE | IN_ONLYDIR) < 0) {
+		WARNING("Unable to add inotify watch on '%s': %s\n",
+				dir.c_str(), strerror(errno));
+		return false;
+	}
+	return true;
+}
+
+void *SkinMonitor::threadMain(void *monitor)
+{
+	static_cast<SkinMonitor *>(monitor)->run();
+	return NULL;
+}
+
+void SkinMonitor::run()
+{
+	char buf[sizeof(struct inotify_event) + NAME_MAX + 1]
+			__attribute__((aligned(__alignof__(struct inotify_event))));
+	for (;;) {
+		if (read(fd, buf, sizeof(buf)) <= 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			ERROR("Unable to read inotify events: %s\n", strerror(errno));
+			break;
+		}
+
+		// Swallow the rest of the burst.
+		struct pollfd pfd = { fd, POLLIN, 0 };
+		while (poll(&pfd, 1, SETTLE_TIME) > 0) {
+			if (read(fd, buf, sizeof(buf)) <= 0 && errno != EINTR) {
+				break;
+			}
+		}
+
+		DEBUG("Skin directories changed\n");
+		changed();
+	}
+}
+
+#endif /* ENABLE_INOTIFY */
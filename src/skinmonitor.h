@@ -0,0 +1,43 @@
+// Various authors.
+// License: GPL version 2 or later.
+
+#ifndef SKINMONITOR_H
+#define SKINMONITOR_H
+#ifdef ENABLE_INOTIFY
+
+#include <functional>
+#include <pthread.h>
+#include <string>
+
+/**
+ * Watches the directories of a skin and calls a function, on the monitor
+ * thread, whenever something in them is added, removed or rewritten.
+ * Bursts of changes, such as a skin being unpacked, are reported once.
+ */
+class SkinMonitor {
+public:
+	SkinMonitor(std::function<void()> changed);
+	~SkinMonitor();
+
+	/**
+	 * Watches the given directory. Call this before reading the directory,
+	 * so that no change made in between goes unnoticed.
+	 * Returns false if the directory could not be watched.
+	 */
+	bool watch(std::string const& dir);
+
+	SkinMonitor(SkinMonitor const&) = delete;
+	SkinMonitor& operator=(SkinMonitor const&) = delete;
+
+private:
+	static void *threadMain(void *monitor);
+	void run();
+
+	std::function<void()> changed;
+	int fd;
+	pthread_t thd;
+	bool started;
+};
+
+#endif /* ENABLE_INOTIFY */
+#endif /* SKINMONITOR_H */
@@ -20,8 +20,10 @@
 
 #include "surface.h"
 
+#include "blend.h"
 #include "debug.h"
 #include "imageio.h"
+#include "profiler.h"
 #include "utilities.h"
 
 #include <algorithm>
@@ -106,6 +108,85 @@ void Surface::blitRight(Surface& destination, int x, int y, int w, int h, int a)
 	blitRight(destination.raw, x, y, w, h, a);
 }
 
+void Surface::blitArea(Surface& destination, SDL_Rect area, int x, int y) const {
+	SDL_Rect dest = { static_cast<Sint16>(x), static_cast<Sint16>(y), 0, 0 };
+	SDL_BlitSurface(raw, &area, destination.raw, &dest);
+}
+
+void Surface::compose(Surface& destination, int x, int y, int w, int h) const {
+	SDL_Rect area = {
+		0, 0,
+		static_cast<Uint16>(w ? min(w, raw->w) : raw->w),
+		static_cast<Uint16>(h ? min(h, raw->h) : raw->h),
+	};
+	compose(raw, area, destination.raw, x, y);
+}
+
+static inline Uint32 readPixel(SDL_Surface *s, int x, int y)
+{
+	Uint8 const *p = static_cast<Uint8 const *>(s->pixels)
+			+ y * s->pitch + x * s->format->BytesPerPixel;
+	switch (s->format->BytesPerPixel) {
+		case 1:
+			return *p;
+		case 2:
+			return *reinterpret_cast<Uint16 const *>(p);
+		case 3:
+			return SDL_BYTEORDER == SDL_BIG_ENDIAN
+					? p[0] << 16 | p[1] << 8 | p[2]
+					: p[0] | p[1] << 8 | p[2] << 16;
+		default:
+			return *reinterpret_cast<Uint32 const *>(p);
+	}
+}
+
+void Surface::compose(SDL_Surface *source, SDL_Rect area,
+		SDL_Surface *destination, int x, int y)
+{
+	assert(destination->format->BytesPerPixel == 4);
+	assert(destination->format->Amask == 0xFF000000);
+
+	// Clip against both surfaces.
+	if (x < 0) { area.x -= x; area.w = max(0, area.w + x); x = 0; }
+	if (y < 0) { area.y -= y; area.h = max(0, area.h + y); y = 0; }
+	const int w = min<int>(area.w, min(source->w - area.x, destination->w - x));
+	const int h = min<int>(area.h, min(source->h - area.y, destination->h - y));
+	if (w <= 0 || h <= 0) return;
+
+	SDL_PixelFormat *format = source->format;
+	const bool colorKey = source->flags & SDL_SRCCOLORKEY;
+	// Surfaces without an alpha channel can have a per-surface alpha.
+	const unsigned int surfaceAlpha =
+			!format->Amask && (source->flags & SDL_SRCALPHA)
+			? format->alpha : SDL_ALPHA_OPAQUE;
+
+	SDL_LockSurface(source);
+	SDL_LockSurface(destination);
+	for (int dy = 0; dy < h; dy++) {
+		Uint32 *dst = reinterpret_cast<Uint32 *>(
+				static_cast<Uint8 *>(destination->pixels)
+				+ (y + dy) * destination->pitch) + x;
+		for (int dx = 0; dx < w; dx++) {
+			const Uint32 pixel = readPixel(source, area.x + dx, area.y + dy);
+			if (colorKey && pixel == format->colorkey) continue;
+			Uint8 r, g, b, a;
+			SDL_GetRGBA(pixel, format, &r, &g, &b, &a);
+			const unsigned int sa = a * surfaceAlpha / 255;
+			if (!sa) continue;
+
+			const Uint32 d = dst[dx];
+			const unsigned int da = (d >> 24) * (255 - sa) / 255;
+			const unsigned int oa = sa + da;
+			const unsigned int or_ = (r * sa + ((d >> 16) & 0xFF) * da) / oa;
+			const unsigned int og  = (g * sa + ((d >>  8) & 0xFF) * da) / oa;
+			const unsigned int ob  = (b * sa + ( d        & 0xFF) * da) / oa;
+			dst[dx] = oa << 24 | or_ << 16 | og << 8 | ob;
+		}
+	}
+	SDL_UnlockSurface(destination);
+	SDL_UnlockSurface(source);
+}
+
 void Surface::box(SDL_Rect re, RGBAColor c) {
 	if (c.a == 255) {
 		SDL_FillRect(raw, &re, c.pixelValue(raw->format));
@@ -203,11 +284,6 @@ void Surface::blit(Surface& destination, SDL_Rect container, Font::HAlign halign
 	blit(destination, container.x, container.y);
 }
 
-static inline uint32_t mult8x4(uint32_t c, uint8_t a) {
-	return ((((c >> 8) & 0x00FF00FF) * a) & 0xFF00FF00)
-	     | ((((c & 0x00FF00FF) * a) & 0xFF00FF00) >> 8);
-}
-
 void Surface::fillRectAlpha(SDL_Rect rect, RGBAColor c) {
 	applyClipRect(rect);
 	if (rect.w == 0 || rect.h == 0) {
@@ -245,15 +321,23 @@ void Surface::fillRectAlpha(SDL_Rect rect, RGBAColor c) {
 		           | format->Amask;
 		alpha = 255 - alpha;
 
-		for (auto y = 0; y < rect.h; y++) {
-			for (auto x = 0; x < rect.w; x++) {
-				uint16_t& pixel = reinterpret_cast<uint16_t*>(edge)[x];
-				uint32_t R = ((pixel & Rmask) * alpha >> 8) & Rmask;
-				uint32_t G = ((pixel & Gmask) * alpha >> 8) & Gmask;
-				uint32_t B = ((pixel & Bmask) * alpha >> 8) & Bmask;
-				pixel = uint16_t(R | G | B) + f;
+		if (Rmask == 0xF800 && Gmask == 0x07E0 && Bmask == 0x001F) {
+			BlendFill16 blend = blendFill565();
+			for (auto y = 0; y < rect.h; y++) {
+				blend(reinterpret_cast<uint16_t*>(edge), rect.w, f, alpha);
+				edge += raw->pitch;
+			}
+		} else {
+			for (auto y = 0; y < rect.h; y++) {
+				for (auto x = 0; x < rect.w; x++) {
+					uint16_t& pixel = reinterpret_cast<uint16_t*>(edge)[x];
+					uint32_t R = ((pixel & Rmask) * alpha >> 8) & Rmask;
+					uint32_t G = ((pixel & Gmask) * alpha >> 8) & Gmask;
+					uint32_t B = ((pixel & Bmask) * alpha >> 8) & Bmask;
+					pixel = uint16_t(R | G | B) + f;
+				}
+				edge += raw->pitch;
 			}
-			edge += raw->pitch;
 		}
 	} else if (format->BytesPerPixel == 4) {
 		// Assume the pixel format uses 8 bits per component; we don't care
@@ -261,11 +345,9 @@ void Surface::fillRectAlpha(SDL_Rect rect, RGBAColor c) {
 		uint32_t f = mult8x4(color, alpha); // pre-multiply the fill color
 		alpha = 255 - alpha;
 
+		BlendFill32 blend = blendFill8888();
 		for (auto y = 0; y < rect.h; y++) {
-			for (auto x = 0; x < rect.w; x++) {
-				uint32_t& pixel = reinterpret_cast<uint32_t*>(edge)[x];
-				pixel = mult8x4(pixel, alpha) + f;
-			}
+			blend(reinterpret_cast<uint32_t*>(edge), rect.w, f, alpha);
 			edge += raw->pitch;
 		}
 	} else {
@@ -290,9 +372,20 @@ unique_ptr<OffscreenSurface> OffscreenSurface::emptySurface(
 	return unique_ptr<OffscreenSurface>(new OffscreenSurface(raw));
 }
 
+unique_ptr<OffscreenSurface> OffscreenSurface::transparentSurface(
+		int width, int height)
+{
+	SDL_Surface *raw = SDL_CreateRGBSurface(SDL_SWSURFACE, width, height, 32,
+			0x00FF0000, 0x0000FF00, 0x000000FF, 0xFF000000);
+	if (!raw) return unique_ptr<OffscreenSurface>();
+	SDL_FillRect(raw, nullptr, 0);
+	return unique_ptr<OffscreenSurface>(new OffscreenSurface(raw));
+}
+
 unique_ptr<OffscreenSurface> OffscreenSurface::loadImage(
 		string const& img, bool loadAlpha)
 {
+	Profiler::Timer timer(Profiler::IMAGE_LOAD);
 	SDL_Surface *raw = loadPNG(img, loadAlpha);
 	if (!raw) {
 		DEBUG("Couldn't load surface '%s'\n", img.c_str());
@@ -302,6 +395,39 @@ unique_ptr<OffscreenSurface> OffscreenSurface::loadImage(
 	return unique_ptr<OffscreenSurface>(new OffscreenSurface(raw));
 }
 
+unique_ptr<OffscreenSurface> OffscreenSurface::loadImageForDisplay(
+		string const& img, unsigned int maxWidth, unsigned int maxHeight)
+{
+	SDL_Surface *screen = SDL_GetVideoSurface();
+	if (!screen) {
+		return loadImage(img, false);
+	}
+
+	Profiler::Timer timer(Profiler::IMAGE_LOAD);
+	SDL_Surface *raw = loadPNGConverted(
+			img, screen->format, maxWidth, maxHeight);
+	if (!raw) {
+		DEBUG("Couldn't load surface '%s'\n", img.c_str());
+		return unique_ptr<OffscreenSurface>();
+	}
+
+	return unique_ptr<OffscreenSurface>(new OffscreenSurface(raw));
+}
+
+unique_ptr<OffscreenSurface> OffscreenSurface::loadImageColumns(
+		string const& img, unsigned int x, unsigned int width)
+{
+	Profiler::Timer timer(Profiler::IMAGE_LOAD);
+	SDL_Surface *raw = loadPNGColumns(img, argbPixelFormat(), x, width);
+	if (!raw) {
+		DEBUG("Couldn't load columns %u-%u of surface '%s'\n",
+				x, x + width, img.c_str());
+		return unique_ptr<OffscreenSurface>();
+	}
+
+	return unique_ptr<OffscreenSurface>(new OffscreenSurface(raw));
+}
+
 OffscreenSurface::OffscreenSurface(OffscreenSurface&& other)
 	: Surface(other.raw)
 {
@@ -325,6 +451,17 @@ void OffscreenSurface::swap(OffscreenSurface& other)
 }
 
 void OffscreenSurface::convertToDisplayFormat() {
+	SDL_Surface *screen = SDL_GetVideoSurface();
+	if (screen) {
+		SDL_PixelFormat const *have = raw->format, *want = screen->format;
+		if (have->BitsPerPixel == want->BitsPerPixel
+				&& have->Rmask == want->Rmask && have->Gmask == want->Gmask
+				&& have->Bmask == want->Bmask && !have->Amask
+				&& !(raw->flags & SDL_SRCALPHA)) {
+			return;
+		}
+	}
+
 	SDL_Surface *newSurface = SDL_DisplayFormat(raw);
 	if (newSurface) {
 		SDL_FreeSurface(raw);
@@ -332,6 +469,17 @@ void OffscreenSurface::convertToDisplayFormat() {
 	}
 }
 
+void OffscreenSurface::convertToDisplayFormatAlpha() {
+	if (SDL_GetVideoSurface()) {
+		SDL_Surface *newSurface = SDL_DisplayFormatAlpha(raw);
+		if (newSurface) {
+			SDL_FreeSurface(raw);
+			raw = newSurface;
+		}
+	}
+	SDL_SetAlpha(raw, SDL_SRCALPHA | SDL_RLEACCEL, SDL_ALPHA_OPAQUE);
+}
+
 
 // OutputSurface:
 
@@ -344,6 +492,42 @@ unique_ptr<OutputSurface> OutputSurface::open(
 	return unique_ptr<OutputSurface>(raw ? new OutputSurface(raw) : nullptr);
 }
 
+OutputSurface::OutputSurface(SDL_Surface *raw)
+	: Surface(raw)
+	, pixelsPushed(0)
+	, totalPixelsPushed(0)
+{
+	// Nothing is known about the contents of the back buffer yet.
+	if (raw->flags & SDL_DOUBLEBUF) {
+		outdated.addAll();
+	}
+}
+
 void OutputSurface::flip() {
 	SDL_Flip(raw);
+	pixelsPushed = raw->w * raw->h;
+	totalPixelsPushed += pixelsPushed;
+	if (raw->flags & SDL_DOUBLEBUF) {
+		outdated.addAll();
+	}
+}
+
+void OutputSurface::flip(vector<SDL_Rect>& rects) {
+	pixelsPushed = 0;
+	for (auto& rect : rects) {
+		pixelsPushed += rect.w * rect.h;
+	}
+	totalPixelsPushed += pixelsPushed;
+
+	if (raw->flags & SDL_DOUBLEBUF) {
+		// The buffer we get back is the one that was on screen, which lacks
+		// the areas drawn for this frame.
+		SDL_Flip(raw);
+		outdated.clear();
+		for (auto& rect : rects) {
+			outdated.add(rect);
+		}
+	} else if (!rects.empty()) {
+		SDL_UpdateRects(raw, rects.size(), &rects[0]);
+	}
 }
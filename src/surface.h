@@ -22,6 +22,7 @@
 #ifndef SURFACE_H
 #define SURFACE_H
 
+#include "dirtyregion.h"
 #include "font.h"
 
 #include <SDL.h>
@@ -30,6 +31,7 @@
 #include <memory>
 #include <ostream>
 #include <string>
+#include <vector>
 
 struct RGBAColor {
 	uint8_t r, g, b, a;
@@ -52,6 +54,12 @@ public:
 
 	int width() const { return raw->w; }
 	int height() const { return raw->h; }
+	/** Returns the number of bytes taken by the pixels of this surface. */
+	size_t byteSize() const {
+		return size_t(raw->w) * raw->h * raw->format->BytesPerPixel;
+	}
+	/** Returns true iff the pixels of this surface have an alpha channel. */
+	bool hasAlpha() const { return raw->format->Amask != 0; }
 
 	void clearClipRect();
 	void setClipRect(int x, int y, int w, int h);
@@ -61,6 +69,16 @@ public:
 	void blit(Surface& destination, SDL_Rect container, Font::HAlign halign = Font::HAlignLeft, Font::VAlign valign = Font::VAlignTop) const;
 	void blitCenter(Surface& destination, int x, int y, int w=0, int h=0, int a=-1) const;
 	void blitRight(Surface& destination, int x, int y, int w=0, int h=0, int a=-1) const;
+	/** Blits the given area of this surface to position (x, y). */
+	void blitArea(Surface& destination, SDL_Rect area, int x, int y) const;
+
+	/**
+	 * Draws this surface on the destination like blit() does, but also
+	 * accumulates the coverage in the alpha channel of the destination, so
+	 * the result can be blitted with transparency later on.
+	 * The destination must be a surface created by transparentSurface().
+	 */
+	void compose(Surface& destination, int x, int y, int w=0, int h=0) const;
 
 	void box(SDL_Rect re, RGBAColor c);
 	void box(Sint16 x, Sint16 y, Uint16 w, Uint16 h, RGBAColor c) {
@@ -85,12 +103,20 @@ protected:
 
 	// For direct access to "raw".
 	friend class Font;
+	friend class SurfaceAtlas;
 
 private:
 	void blit(SDL_Surface *destination, int x, int y, int w=0, int h=0, int a=-1) const;
 	void blitCenter(SDL_Surface *destination, int x, int y, int w=0, int h=0, int a=-1) const;
 	void blitRight(SDL_Surface *destination, int x, int y, int w=0, int h=0, int a=-1) const;
 
+	/**
+	 * Draws the given area of a surface of any format over a 32bpp ARGB
+	 * surface, using the "over" operator on the colors and the alpha.
+	 */
+	static void compose(SDL_Surface *source, SDL_Rect area,
+			SDL_Surface *destination, int x, int y);
+
 	/** Draws the given rectangle on this surface in the given color, blended
 	  * according to the alpha value of the color argument.
 	  */
@@ -109,8 +135,29 @@ class OffscreenSurface: public Surface {
 public:
 	static std::unique_ptr<OffscreenSurface> emptySurface(
 			int width, int height);
+	/**
+	 * Creates a fully transparent surface with an alpha channel, to draw
+	 * on with Surface::compose() and Font::compose().
+	 */
+	static std::unique_ptr<OffscreenSurface> transparentSurface(
+			int width, int height);
 	static std::unique_ptr<OffscreenSurface> loadImage(
 			std::string const& img, bool loadAlpha = true);
+	/**
+	 * Loads an opaque image straight into the pixel format of the frame
+	 * buffer, optionally shrinking it to fit the given size.
+	 * This can be called from any thread once the video mode has been set.
+	 */
+	static std::unique_ptr<OffscreenSurface> loadImageForDisplay(
+			std::string const& img,
+			unsigned int maxWidth = 0, unsigned int maxHeight = 0);
+	/**
+	 * Loads the columns [x, x + width) of an image, keeping its alpha
+	 * channel. Convert the result with convertToDisplayFormatAlpha().
+	 * This can be called from any thread.
+	 */
+	static std::unique_ptr<OffscreenSurface> loadImageColumns(
+			std::string const& img, unsigned int x, unsigned int width);
 
 	OffscreenSurface(Surface const& other) : Surface(other) {}
 	OffscreenSurface(OffscreenSurface const& other) : Surface(other) {}
@@ -122,12 +169,23 @@ public:
 	/**
 	 * Converts the underlying surface to the same pixel format as the frame
 	 * buffer, for faster blitting. This removes the alpha channel if the
-	 * image has one.
+	 * image has one. Surfaces that are in that format already are left
+	 * alone.
 	 */
 	void convertToDisplayFormat();
+	/**
+	 * Converts the underlying surface to the format that is fastest to
+	 * blit to the frame buffer while keeping its alpha channel.
+	 */
+	void convertToDisplayFormatAlpha();
 
 private:
 	OffscreenSurface(SDL_Surface *raw) : Surface(raw) {}
+
+	// For wrapping views into its pages.
+	friend class SurfaceAtlas;
+	// For wrapping the thumbnails it loads.
+	friend class ThumbnailCache;
 };
 
 /**
@@ -144,8 +202,37 @@ public:
 	 */
 	void flip();
 
+	/**
+	 * Like flip(), but only the given areas of the current buffer have been
+	 * redrawn since the previous frame.
+	 * Without page flipping, only those areas are copied to the screen.
+	 */
+	void flip(std::vector<SDL_Rect>& rects);
+
+	/**
+	 * Adds the areas of the current buffer that are older than what is on
+	 * the screen to the given region. With page flipping, those are the
+	 * areas that were redrawn for the previous frame in the other buffer.
+	 */
+	void addOutdated(DirtyRegion& region) const {
+		region.add(outdated);
+	}
+
+	/**
+	 * Returns the number of pixels that were redrawn and presented by the
+	 * last flip.
+	 */
+	unsigned long getPixelsPushed() const { return pixelsPushed; }
+
+	/** Returns the number of pixels presented by all flips so far. */
+	uint64_t getTotalPixelsPushed() const { return totalPixelsPushed; }
+
 private:
-	OutputSurface(SDL_Surface *raw) : Surface(raw) {}
+	OutputSurface(SDL_Surface *raw);
+
+	DirtyRegion outdated;
+	unsigned long pixelsPushed;
+	uint64_t totalPixelsPushed;
 };
 
 #endif
@@ -0,0 +1,153 @@
+// Various authors.
+// License: GPL version 2 or later.
+
+#include "surfaceatlas.h"
+
+#include "debug.h"
+#include "surface.h"
+
+#include <cstring>
+
+using namespace std;
+
+/* Size of a page, in pixels. */
+#define PAGE_SIZE 256
+
+/* Images larger than this in either dimension get a surface of their own. */
+#define MAX_PACKED_SIZE 64
+
+
+SurfaceAtlas::SurfaceAtlas()
+{
+}
+
+SurfaceAtlas::~SurfaceAtlas()
+{
+	for (auto& page : pages) {
+		SDL_FreeSurface(page.surface);
+	}
+}
+
+int SurfaceAtlas::allocate(int w, int h, SDL_PixelFormat const *format,
+		int& x, int& y)
+{
+	// Only the last page has room left; it is a simple shelf packer.
+	if (!pages.empty()) {
+		Page& page = pages.back();
+		if (page.shelfX + w <= PAGE_SIZE && h <= page.shelfHeight) {
+			x = page.shelfX;
+			y = page.shelfY;
+			page.shelfX += w;
+			return pages.size() - 1;
+		}
+		const int nextY = page.shelfY + page.shelfHeight;
+		if (nextY + h <= PAGE_SIZE) {
+			page.shelfY = nextY;
+			page.shelfHeight = h;
+			page.shelfX = w;
+			x = 0;
+			y = nextY;
+			return pages.size() - 1;
+		}
+	}
+
+	SDL_Surface *surface = SDL_CreateRGBSurface(SDL_SWSURFACE,
+			PAGE_SIZE, PAGE_SIZE, 32, format->Rmask, format->Gmask,
+			format->Bmask, format->Amask);
+	if (!surface) {
+		return -1;
+	}
+	DEBUG("Adding atlas page %zu\n", pages.size());
+	pages.push_back(Page { surface, 0, h, w, 0 });
+	x = y = 0;
+	return pages.size() - 1;
+}
+
+unique_ptr<OffscreenSurface> SurfaceAtlas::pack(
+		unique_ptr<OffscreenSurface> image)
+{
+	if (!image || !SDL_GetVideoSurface()) {
+		return image;
+	}
+	SDL_Surface *raw = image->raw;
+	if (raw->w > MAX_PACKED_SIZE || raw->h > MAX_PACKED_SIZE
+			|| !raw->format->Amask) {
+		return image;
+	}
+
+	SDL_Surface *converted = SDL_DisplayFormatAlpha(raw);
+	if (!converted) {
+		return image;
+	}
+	SDL_PixelFormat const *format = converted->format;
+	if (format->BitsPerPixel != 32) {
+		SDL_FreeSurface(converted);
+		return image;
+	}
+	if (!pages.empty()) {
+		SDL_PixelFormat const *pageFormat = pages.back().surface->format;
+		if (format->Rmask != pageFormat->Rmask
+				|| format->Gmask != pageFormat->Gmask
+				|| format->Bmask != pageFormat->Bmask
+				|| format->Amask != pageFormat->Amask) {
+			SDL_FreeSurface(converted);
+			return image;
+		}
+	}
+
+	int x, y;
+	const int index = allocate(raw->w, raw->h, format, x, y);
+	if (index < 0) {
+		SDL_FreeSurface(converted);
+		return image;
+	}
+	Page& page = pages[index];
+
+	// Both surfaces have the same format, so the rows can be copied as is.
+	Uint8 *pixels = (Uint8 *) page.surface->pixels
+			+ y * page.surface->pitch + x * 4;
+	SDL_LockSurface(converted);
+	for (int row = 0; row < converted->h; row++) {
+		memcpy(pixels + row * page.surface->pitch,
+				(Uint8 *) converted->pixels + row * converted->pitch,
+				converted->w * 4);
+	}
+	SDL_UnlockSurface(converted);
+	SDL_FreeSurface(converted);
+
+	format = page.surface->format;
+	SDL_Surface *view = SDL_CreateRGBSurfaceFrom(pixels,
+			raw->w, raw->h, 32, page.surface->pitch,
+			format->Rmask, format->Gmask, format->Bmask, format->Amask);
+	if (!view) {
+		return image;
+	}
+	SDL_SetAlpha(view, SDL_SRCALPHA, SDL_ALPHA_OPAQUE);
+	page.views++;
+	return unique_ptr<OffscreenSurface>(new OffscreenSurface(view));
+}
+
+size_t SurfaceAtlas::byteSize() const
+{
+	size_t bytes = 0;
+	for (auto const& page : pages) {
+		bytes += page.surface->h * page.surface->pitch;
+	}
+	return bytes;
+}
+
+void SurfaceAtlas::release(OffscreenSurface const& surface)
+{
+	Uint8 const *pixels = (Uint8 const *) surface.raw->pixels;
+	for (auto it = pages.begin(); it != pages.end(); ++it) {
+		Uint8 const *start = (Uint8 const *) it->surface->pixels;
+		Uint8 const *end = start + it->surface->h * it->surface->pitch;
+		if (pixels >= start && pixels < end) {
+			if (--it->views == 0) {
+				SDL_FreeSurface(it->surface);
+				pages.erase(it);
+			}
+			return;
+		}
+	}
+}
@@ -0,0 +1,62 @@
+// Various authors.
+// License: GPL version 2 or later.
+
+#ifndef SURFACEATLAS_H
+#define SURFACEATLAS_H
+
+#include <SDL.h>
+
+#include <memory>
+#include <vector>
+
+class OffscreenSurface;
+
+/**
+ * Packs small images, such as icons, into a few large pages that are stored
+ * in the pixel format SDL blits fastest to the screen.
+ * Each packed image is handed out as a surface that shares the pixels of its
+ * page, so no conversion is needed when blitting it and there is only one
+ * pixel buffer allocation per page instead of one per image.
+ */
+class SurfaceAtlas {
+public:
+	SurfaceAtlas();
+	~SurfaceAtlas();
+
+	/**
+	 * Copies the given image into a page.
+	 * @return A surface that shares the pixels of the page, or the given
+	 *         image itself if it is not suitable for packing: because it is
+	 *         too large or because the video mode has not been set yet.
+	 */
+	std::unique_ptr<OffscreenSurface> pack(
+			std::unique_ptr<OffscreenSurface> image);
+
+	/**
+	 * Must be called before deleting a surface returned by pack().
+	 * Frees the page the surface was in when it is no longer used.
+	 */
+	void release(OffscreenSurface const& surface);
+
+	/** Returns the number of bytes of pixel data of all pages. */
+	size_t byteSize() const;
+
+private:
+	struct Page {
+		SDL_Surface *surface;
+		/** Top, height and fill level of the shelf images are placed on. */
+		int shelfY, shelfHeight, shelfX;
+		/** Number of packed surfaces that use this page. */
+		unsigned int views;
+	};
+
+	/**
+	 * Finds room for an image of the given size, adding a page if needed.
+	 * @return The index of the page, or -1 if no page could be created.
+	 */
+	int allocate(int w, int h, SDL_PixelFormat const *format, int& x, int& y);
+
+	std::vector<Page> pages;
+};
+
+#endif // SURFACEATLAS_H
@@ -19,18 +19,39 @@
  ***************************************************************************/
 
 #include "surfacecollection.h"
+#include "skinmonitor.h"
 #include "surface.h"
 #include "utilities.h"
 #include "debug.h"
 #include "gmenu2x.h"
 
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/vfs.h>
 #include <iostream>
 
 using std::endl;
+using std::pair;
+using std::set;
+using std::shared_ptr;
 using std::string;
+using std::unique_ptr;
+using std::vector;
+
+/* File systems that look names up case insensitively. */
+#define VFAT_MAGIC 0x4d44
+#define EXFAT_MAGIC 0x2011BAB0
 
 SurfaceCollection::SurfaceCollection()
-	: skin("default")
+	: atlas(std::make_shared<SurfaceAtlas>())
+	, budget(0)
+	, stats()
+	, skin("default")
+	, skinIndexed(false)
+	, skinChanged(false)
+#ifdef ENABLE_INOTIFY
+	, watchSkin(false)
+#endif
 {
 }
 
@@ -38,6 +59,10 @@ SurfaceCollection::~SurfaceCollection() {}
 
 void SurfaceCollection::setSkin(const string &skin) {
 	this->skin = skin;
+	skinIndexed = false;
+#ifdef ENABLE_INOTIFY
+	watchSkin = true;
+#endif
 }
 
 /* Returns the location of a skin directory,
@@ -55,7 +80,174 @@ string SurfaceCollection::getSkinPath(const string &skin)
 	return "";
 }
 
+/* Returns true if the path can be looked up in the skin index as it is:
+ * relative, without "." or ".." components and without double slashes. */
+static bool isIndexablePath(const string &path)
+{
+	if (path.empty() || path[0] == '/' || path[path.size() - 1] == '/') {
+		return false;
+	}
+	size_t start = 0;
+	while (true) {
+		size_t end = path.find('/', start);
+		const size_t len = (end == string::npos ? path.size() : end) - start;
+		if (len == 0 || (len == 1 && path[start] == '.')
+				|| (len == 2 && path.compare(start, 2, "..") == 0)) {
+			return false;
+		}
+		if (end == string::npos) {
+			return true;
+		}
+		start = end + 1;
+	}
+}
+
+static string foldCase(string s)
+{
+	for (char& c : s) {
+		if (c >= 'A' && c <= 'Z') {
+			c += 'a' - 'A';
+		}
+	}
+	return s;
+}
+
+void SurfaceCollection::SkinIndex::clear()
+{
+	files.clear();
+	foldedFiles.clear();
+	roots = 0;
+}
+
+void SurfaceCollection::SkinIndex::addTree(const string &root,
+		SkinMonitor *monitor)
+{
+	struct statfs fs;
+	const bool fold = statfs(root.c_str(), &fs) == 0
+			&& (fs.f_type == VFAT_MAGIC || fs.f_type == EXFAT_MAGIC);
+	set<pair<dev_t, ino_t>> visited;
+	addDir(root, "", roots++, fold, visited, monitor);
+}
+
+void SurfaceCollection::SkinIndex::addDir(const string &root,
+		const string &prefix, int rank, bool fold,
+		set<pair<dev_t, ino_t>>& visited, SkinMonitor *monitor)
+{
+	const string dirPath = root + "/" + prefix;
+	DIR *dirp = opendir(dirPath.c_str());
+	if (!dirp) {
+		return;
+	}
+	// Symbolic links can lead back up the tree.
+	struct stat st;
+	if (fstat(dirfd(dirp), &st) < 0
+			|| !visited.emplace(st.st_dev, st.st_ino).second) {
+		closedir(dirp);
+		return;
+	}
+#ifdef ENABLE_INOTIFY
+	// Entries are only read by readdir(), so changes made from here on
+	// are noticed.
+	if (monitor) {
+		monitor->watch(dirPath);
+	}
+#else
+	(void)monitor;
+#endif
+
+	while (struct dirent *dptr = readdir(dirp)) {
+		const char *name = dptr->d_name;
+		if (name[0] == '.' && (!name[1] || (name[1] == '.' && !name[2]))) {
+			continue;
+		}
+
+		// Files that were indexed before are in a higher priority directory.
+		const string file = prefix + name;
+		const string path = root + "/" + file;
+		files.emplace(file, File { path, rank });
+		if (fold) {
+			foldedFiles.emplace(foldCase(file), File { path, rank });
+		}
+
+		bool isDir;
+#ifdef _DIRENT_HAVE_D_TYPE
+		if (dptr->d_type != DT_UNKNOWN && dptr->d_type != DT_LNK) {
+			isDir = dptr->d_type == DT_DIR;
+		} else
+#endif
+		{
+			isDir = stat(path.c_str(), &st) == 0 && S_ISDIR(st.st_mode);
+		}
+		if (isDir) {
+			addDir(root, file + "/", rank, fold, visited, monitor);
+		}
+	}
+
+	closedir(dirp);
+}
+
+string SurfaceCollection::SkinIndex::find(const string &file) const
+{
+	auto exact = files.find(file);
+	if (!foldedFiles.empty()) {
+		// On a case insensitive file system, a file that only differs in
+		// case is found as well, unless an earlier directory has the file.
+		auto folded = foldedFiles.find(foldCase(file));
+		if (folded != foldedFiles.end() && (exact == files.end()
+				|| folded->second.rank < exact->second.rank)) {
+			return folded->second.path;
+		}
+	}
+	return exact != files.end() ? exact->second.path : "";
+}
+
+void SurfaceCollection::indexSkin()
+{
+	skinFiles.clear();
+	defaultFiles.clear();
+	skinChanged = false;
+
+	SkinMonitor *watcher = nullptr;
+#ifdef ENABLE_INOTIFY
+	// Directories may have been added, so the watches are set up anew.
+	// Changes made while indexing mark the new index as outdated.
+	monitor.reset();
+	if (watchSkin) {
+		monitor.reset(new SkinMonitor([this] {
+			skinChanged = true;
+		}));
+		watcher = monitor.get();
+	}
+#endif
+
+	const string home = GMenu2X::getHome() + "/skins/";
+	skinFiles.addTree(home + skin, watcher);
+	skinFiles.addTree(GMENU2X_SYSTEM_DIR "/skins/" + skin, watcher);
+	defaultFiles.addTree(home + "Default", watcher);
+	defaultFiles.addTree(GMENU2X_SYSTEM_DIR "/skins/Default", watcher);
+	skinIndexed = true;
+
+	DEBUG("Indexed %zu files of skin '%s' and %zu default files\n",
+			skinFiles.size(), skin.c_str(), defaultFiles.size());
+}
+
 string SurfaceCollection::getSkinFilePath(const string &file, bool useDefault)
+{
+	if (!isIndexablePath(file)) {
+		return findSkinFile(file, useDefault);
+	}
+	if (!skinIndexed || skinChanged) {
+		indexSkin();
+	}
+
+	string path = skinFiles.find(file);
+	if (path.empty() && useDefault) {
+		path = defaultFiles.find(file);
+	}
+	return path;
+}
+
+string SurfaceCollection::findInSkin(const string &skin, const string &file)
 {
 	/* We first search the skin file on the user-specific directory. */
 	string path = GMenu2X::getHome() + "/skins/" + skin + "/" + file;
@@ -67,76 +259,147 @@ string SurfaceCollection::getSkinFilePath(const string &file, bool useDefault)
 	if (fileExists(path))
 	  return path;
 
+	return "";
+}
+
+string SurfaceCollection::findSkinFile(const string &file, bool useDefault)
+{
+	string path = findInSkin(skin, file);
+
 	/* If it is nowhere to be found, as a last resort we check the
 	 * "Default" skin for a corresponding (but probably not similar) file. */
-	if (useDefault) {
-		path = GMenu2X::getHome() + "/skins/Default/" + file;
-		if (fileExists(path))
-		  return path;
-
-		path = GMENU2X_SYSTEM_DIR "/skins/Default/" + file;
-		if (fileExists(path))
-		  return path;
+	if (path.empty() && useDefault) {
+		path = findInSkin("Default", file);
 	}
 
-	return "";
+	return path;
+}
+
+void SurfaceCollection::setBudget(size_t bytes) {
+	budget = bytes;
+	evict();
 }
 
 void SurfaceCollection::debug() {
-	SurfaceHash::iterator end = surfaces.end();
-	for(SurfaceHash::iterator curr = surfaces.begin(); curr != end; curr++){
-		DEBUG("key: %s\n", curr->first.c_str());
+	for (auto it = surfaces.begin(); it != surfaces.end(); ++it) {
+		DEBUG("key: %s (%zu bytes, %ld users)\n", it->first.c_str(),
+				it->second.bytes, it->second.surface.use_count() - 1);
 	}
+	DEBUG("%zu bytes resident, %u hits, %u misses, %u evictions\n",
+			getStats().bytes, stats.hits, stats.misses, stats.evictions);
+}
+
+SurfaceCollection::Stats SurfaceCollection::getStats() const {
+	Stats total = stats;
+	total.bytes += atlas->byteSize();
+	return total;
 }
 
 bool SurfaceCollection::exists(const string &path) {
 	return surfaces.find(path) != surfaces.end();
 }
 
-OffscreenSurface *SurfaceCollection::add(const string &path) {
-	if (path.empty()) return NULL;
+shared_ptr<OffscreenSurface> SurfaceCollection::find(const string &key) {
+	auto it = surfaces.find(key);
+	if (it == surfaces.end()) {
+		return nullptr;
+	}
+	stats.hits++;
+	order.splice(order.begin(), order, it->second.lru);
+	return it->second.surface;
+}
+
+shared_ptr<OffscreenSurface> SurfaceCollection::store(const string &key,
+		unique_ptr<OffscreenSurface> surface) {
+	if (exists(key)) del(key);
+
+	OffscreenSurface const *image = surface.get();
+	OffscreenSurface *packed = atlas->pack(std::move(surface)).release();
+	if (!packed) {
+		return nullptr;
+	}
+	const bool inAtlas = packed != image;
+	// The atlas has to stay around until the last surface is gone.
+	shared_ptr<SurfaceAtlas> atlas = this->atlas;
+	shared_ptr<OffscreenSurface> handle(packed, [atlas](OffscreenSurface *s) {
+		atlas->release(*s);
+		delete s;
+	});
+
+	order.push_front(key);
+	const size_t bytes = inAtlas ? 0 : handle->byteSize();
+	surfaces[key] = Entry { handle, bytes, order.begin(), inAtlas };
+	stats.bytes += bytes;
+	evict();
+	return handle;
+}
+
+void SurfaceCollection::evict() {
+	if (!budget) {
+		return;
+	}
+
+	const size_t atlasBytes = atlas->byteSize();
+	auto it = order.end();
+	while (stats.bytes + atlasBytes > budget && it != order.begin()) {
+		--it;
+		auto entry = surfaces.find(*it);
+		if (entry->second.packed || entry->second.surface.use_count() > 1) {
+			// In the atlas or still in use; dropping it would not free
+			// anything.
+			continue;
+		}
+		stats.bytes -= entry->second.bytes;
+		stats.evictions++;
+		surfaces.erase(entry);
+		it = order.erase(it);
+	}
+}
+
+shared_ptr<OffscreenSurface> SurfaceCollection::add(const string &path) {
+	if (path.empty()) return nullptr;
 	if (exists(path)) del(path);
 	string filePath = path;
 
 	if (filePath.substr(0,5)=="skin:") {
 		filePath = getSkinFilePath(filePath.substr(5,filePath.length()));
 		if (filePath.empty())
-			return NULL;
+			return nullptr;
 	} else if ((filePath.find('#') == filePath.npos) && (!fileExists(filePath))) {
 		WARNING("Unable to add image %s\n", path.c_str());
-		return NULL;
+		return nullptr;
 	}
 
 	DEBUG("Adding surface: '%s'\n", path.c_str());
-	// TODO: Be safe.
-	auto s = OffscreenSurface::loadImage(filePath).release();
-	if (s) {
-		surfaces[path] = s;
-	}
-	return s;
+	stats.misses++;
+	return store(path, OffscreenSurface::loadImage(filePath));
 }
 
-OffscreenSurface *SurfaceCollection::addSkinRes(const string &path, bool useDefault) {
-	if (path.empty()) return NULL;
+shared_ptr<OffscreenSurface> SurfaceCollection::addSkinRes(const string &path, bool useDefault) {
+	if (path.empty()) return nullptr;
 	if (exists(path)) del(path);
 
 	string skinpath = getSkinFilePath(path, useDefault);
 	if (skinpath.empty())
-		return NULL;
+		return nullptr;
 
 	DEBUG("Adding skin surface: '%s'\n", path.c_str());
-	// TODO: Be safe.
-	auto s = OffscreenSurface::loadImage(skinpath).release();
-	if (s) {
-		surfaces[path] = s;
-	}
-	return s;
+	stats.misses++;
+	return store(path, OffscreenSurface::loadImage(skinpath));
+}
+
+shared_ptr<OffscreenSurface> SurfaceCollection::insert(const string &key,
+		unique_ptr<OffscreenSurface> surface) {
+	return store(key, std::move(surface));
 }
 
 void SurfaceCollection::del(const string &path) {
-	SurfaceHash::iterator i = surfaces.find(path);
+	auto i = surfaces.find(path);
 	if (i != surfaces.end()) {
-		delete i->second;
+		// Users of the surface keep their reference; it is freed when the
+		// last one lets go.
+		stats.bytes -= i->second.bytes;
+		order.erase(i->second.lru);
 		surfaces.erase(i);
 	}
 
@@ -145,28 +408,29 @@ void SurfaceCollection::del(const string &path) {
 
 void SurfaceCollection::clear() {
 	surfaces.clear();
+	order.clear();
+	stats.bytes = 0;
 }
 
 void SurfaceCollection::move(const string &from, const string &to) {
+	auto i = surfaces.find(from);
+	if (i == surfaces.end() || from == to) return;
 	del(to);
-	surfaces[to] = surfaces[from];
-	surfaces.erase(from);
+
+	Entry entry = i->second;
+	surfaces.erase(i);
+	*entry.lru = to;
+	surfaces[to] = entry;
 }
 
-OffscreenSurface *SurfaceCollection::operator[](const string &key) {
-	SurfaceHash::iterator i = surfaces.find(key);
-	if (i == surfaces.end())
-		return add(key);
-	else
-		return i->second;
+shared_ptr<OffscreenSurface> SurfaceCollection::operator[](const string &key) {
+	auto surface = find(key);
+	return surface ? surface : add(key);
 }
 
-OffscreenSurface *SurfaceCollection::skinRes(const string &key, bool useDefault) {
-	if (key.empty()) return NULL;
+shared_ptr<OffscreenSurface> SurfaceCollection::skinRes(const string &key, bool useDefault) {
+	if (key.empty()) return nullptr;
 
-	SurfaceHash::iterator i = surfaces.find(key);
-	if (i == surfaces.end())
-		return addSkinRes(key, useDefault);
-	else
-		return i->second;
+	auto surface = find(key);
+	return surface ? surface : addSkinRes(key, useDefault);
 }
@@ -20,44 +20,176 @@
 #ifndef SURFACECOLLECTION_H
 #define SURFACECOLLECTION_H
 
+#include "surfaceatlas.h"
+
+#include <sys/types.h>
+
+#include <atomic>
+#include <cstddef>
+#include <list>
+#include <memory>
+#include <set>
 #include <string>
 #include <unordered_map>
+#include <utility>
+#include <vector>
 
 class OffscreenSurface;
+class SkinMonitor;
 class Surface;
 
-typedef std::unordered_map<std::string, OffscreenSurface *> SurfaceHash;
-
 /**
 Hash Map of surfaces that loads surfaces not already loaded and reuses already loaded ones.
 
+Surfaces are handed out as shared pointers, so they stay valid for as long as
+they are used, even after they have been removed from the collection. Once the
+pixel data in the collection exceeds its budget, the least recently used
+surfaces that are not in use anymore are dropped.
+
 	@author Massimiliano Torromeo <massimiliano.torromeo@gmail.com>
 */
 class SurfaceCollection {
 public:
+	struct Stats {
+		/**
+		 * Bytes of pixel data held by the surfaces in the collection,
+		 * counting the atlas pages as a whole.
+		 */
+		size_t bytes;
+		unsigned int hits, misses, evictions;
+	};
+
 	SurfaceCollection();
 	~SurfaceCollection();
 
+	/**
+	 * Selects the skin the "skin:" paths refer to. The files of the skin
+	 * are indexed the next time a path is looked up, and the index is
+	 * refreshed when the skin directories change.
+	 */
 	void setSkin(const std::string &skin);
+	/**
+	 * Returns the path of a file of the current skin, looking in the user's
+	 * skin directory before the system one and, if useDefault is true,
+	 * in the Default skin after that. Returns an empty string if the file
+	 * is nowhere to be found.
+	 */
 	std::string getSkinFilePath(const std::string &file, bool useDefault = true);
 	static std::string getSkinPath(const std::string &skin);
 
+	/**
+	 * Sets the number of bytes of pixel data the collection may hold before
+	 * it starts dropping unused surfaces, or 0 for no limit.
+	 * The atlas pages count towards the budget, but the images packed into
+	 * them are never dropped: that would rarely free a page, since the
+	 * space of a dropped image is not reused.
+	 */
+	void setBudget(size_t bytes);
+	Stats getStats() const;
+
 	void debug();
 
-	OffscreenSurface *addSkinRes(const std::string &path, bool useDefault = true);
+	std::shared_ptr<OffscreenSurface> addSkinRes(const std::string &path, bool useDefault = true);
+	/**
+	 * Adds a surface that was already loaded, for instance on another
+	 * thread, under the given key. Replaces any surface with that key.
+	 */
+	std::shared_ptr<OffscreenSurface> insert(const std::string &key,
+			std::unique_ptr<OffscreenSurface> surface);
 	void     del(const std::string &path);
 	void     clear();
 	void     move(const std::string &from, const std::string &to);
 	bool     exists(const std::string &path);
 
-	OffscreenSurface *operator[](const std::string &);
-	OffscreenSurface *skinRes(const std::string &key, bool useDefault = true);
+	std::shared_ptr<OffscreenSurface> operator[](const std::string &);
+	std::shared_ptr<OffscreenSurface> skinRes(const std::string &key, bool useDefault = true);
 
 private:
-	OffscreenSurface *add(const std::string &path);
+	struct Entry {
+		std::shared_ptr<OffscreenSurface> surface;
+		/** Bytes of pixel data; 0 for images packed into the atlas. */
+		size_t bytes;
+		std::list<std::string>::iterator lru;
+		bool packed;
+	};
+
+	std::shared_ptr<OffscreenSurface> add(const std::string &path);
+	/** Packs the surface into the atlas and adds it under the given key. */
+	std::shared_ptr<OffscreenSurface> store(const std::string &key,
+			std::unique_ptr<OffscreenSurface> surface);
+	/** Returns the surface with the given key, marking it as used. */
+	std::shared_ptr<OffscreenSurface> find(const std::string &key);
+	/** Drops unused surfaces until the collection fits its budget. */
+	void evict();
 
-	SurfaceHash surfaces;
+	/** Maps paths relative to skin directories to full paths. */
+	class SkinIndex {
+	public:
+		void clear();
+		/**
+		 * Adds the files below the given directory, which has a lower
+		 * priority than the directories that were added before.
+		 * Each directory is watched by the monitor, if any, before it is read.
+		 */
+		void addTree(const std::string &root, SkinMonitor *monitor);
+		/**
+		 * Returns the full path of the file with the given relative path,
+		 * like looking it up on disk in each directory in turn would,
+		 * or an empty string if there is no such file.
+		 */
+		std::string find(const std::string &file) const;
+		size_t size() const { return files.size(); }
+
+	private:
+		struct File {
+			std::string path;
+			/** Index of the directory the file is in; lower is preferred. */
+			int rank;
+		};
+
+		void addDir(const std::string &root, const std::string &prefix,
+				int rank, bool fold,
+				std::set<std::pair<dev_t, ino_t>>& visited,
+				SkinMonitor *monitor);
+
+		std::unordered_map<std::string, File> files;
+		/**
+		 * The files of directories on case insensitive file systems,
+		 * such as vfat, by their case folded path.
+		 */
+		std::unordered_map<std::string, File> foldedFiles;
+		int roots = 0;
+	};
+
+	void indexSkin();
+	/** Looks for the file on disk, without using the index. */
+	std::string findSkinFile(const std::string &file, bool useDefault);
+	/** Looks for the file on disk in the user's, then the system's skin. */
+	static std::string findInSkin(const std::string &skin,
+			const std::string &file);
+
+	std::unordered_map<std::string, Entry> surfaces;
+	/** Keys of the surfaces, most recently used first. */
+	std::list<std::string> order;
+	/**
+	 * Holds the pixels of the small images, such as icons.
+	 * Each surface keeps a reference, since it may outlive the collection.
+	 */
+	std::shared_ptr<SurfaceAtlas> atlas;
+	size_t budget;
+	/** Its byte count leaves out the atlas pages, which getStats() adds. */
+	Stats stats;
 	std::string skin;
+
+	/** The files of the current skin and of the Default skin. */
+	SkinIndex skinFiles, defaultFiles;
+	bool skinIndexed;
+	/** Set by the monitor thread when the skin directories change. */
+	std::atomic<bool> skinChanged;
+#ifdef ENABLE_INOTIFY
+	std::unique_ptr<SkinMonitor> monitor;
+	bool watchSkin;
+#endif
 };
 
 #endif
@@ -0,0 +1,125 @@
+// Various authors.
+// License: GPL version 2 or later.
+
+#include "textbuffer.h"
+
+#include "debug.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cassert>
+#include <cerrno>
+#include <cstring>
+
+using namespace std;
+
+unique_ptr<TextBuffer> TextBuffer::fromFile(string const& path)
+{
+	int fd = open(path.c_str(), O_RDONLY);
+	if (fd < 0) {
+		return unique_ptr<TextBuffer>(
+				new TextBuffer("<error opening " + path + ">"));
+	}
+
+	struct stat st;
+	if (fstat(fd, &st) < 0) {
+		close(fd);
+		return unique_ptr<TextBuffer>(
+				new TextBuffer("<error reading " + path + ">"));
+	}
+
+	unique_ptr<TextBuffer> buffer(new TextBuffer());
+	if (st.st_size > 0) {
+		void *mapping = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (mapping == MAP_FAILED) {
+			WARNING("Unable to map '%s': %s\n", path.c_str(), strerror(errno));
+			close(fd);
+			return unique_ptr<TextBuffer>(
+					new TextBuffer("<error reading " + path + ">"));
+		}
+		// The text is wrapped from front to back.
+		posix_madvise(mapping, st.st_size, POSIX_MADV_SEQUENTIAL);
+
+		buffer->mapping = mapping;
+		buffer->data = static_cast<const char *>(mapping);
+		buffer->size = st.st_size;
+	}
+	close(fd);
+
+	return buffer;
+}
+
+TextBuffer::TextBuffer()
+	: mapping(nullptr)
+	, data(nullptr)
+	, size(0)
+	, font(nullptr)
+	, width(0)
+	, wrapped(0)
+{
+}
+
+TextBuffer::TextBuffer(string text)
+	: TextBuffer()
+{
+	this->text = move(text);
+	data = this->text.data();
+	size = this->text.size();
+}
+
+TextBuffer::~TextBuffer()
+{
+	if (mapping) {
+		munmap(mapping, size);
+	}
+}
+
+void TextBuffer::setWrapping(Font *font, int width)
+{
+	this->font = font;
+	this->width = width;
+	rows.clear();
+	wrapped = 0;
+}
+
+size_t TextBuffer::wrapRows(size_t count)
+{
+	assert(font);
+
+	const char *end = data + size;
+	while (rows.size() < count && wrapped != size) {
+		const char *para = data + wrapped;
+		const char *newline = static_cast<const char *>(
+				memchr(para, '\n', end - para));
+		font->wordWrapParagraph(data, para, newline ? newline : end,
+				width, rows);
+
+		// A newline at the very end doesn't start another paragraph.
+		if (newline && newline + 1 != end) {
+			wrapped = newline + 1 - data;
+		} else {
+			wrapped = size;
+		}
+	}
+	return rows.size();
+}
+
+size_t TextBuffer::estimateRows() const
+{
+	if (isWrapped() || !wrapped) {
+		return rows.size();
+	}
+	// Assume the rest of the text has the same number of rows per byte.
+	const double rowsPerByte = double(rows.size()) / wrapped;
+	return max(rows.size() + 1, size_t(rowsPerByte * size));
+}
+
+string TextBuffer::getRow(size_t row) const
+{
+	Font::LineSpan const& span = rows.at(row);
+	return string(data + span.start, span.end - span.start);
+}
@@ -0,0 +1,75 @@
+// Various authors.
+// License: GPL version 2 or later.
+
+#ifndef TEXTBUFFER_H
+#define TEXTBUFFER_H
+
+#include "font.h"
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <vector>
+
+/**
+ * The text shown by a text viewer, split into rows that fit the screen.
+ * Files are mapped into memory rather than read, and rows are wrapped only
+ * when they are asked for, so a large file doesn't have to be processed
+ * entirely before its first page can be shown.
+ */
+class TextBuffer {
+public:
+	/**
+	 * Maps the given file into memory. If that fails, the buffer contains
+	 * an error message instead, like readFileAsString() would return.
+	 */
+	static std::unique_ptr<TextBuffer> fromFile(std::string const& path);
+
+	explicit TextBuffer(std::string text);
+	~TextBuffer();
+
+	TextBuffer(TextBuffer const&) = delete;
+	TextBuffer& operator=(TextBuffer const&) = delete;
+
+	/**
+	 * Sets the font and width the rows are wrapped for.
+	 * Rows that were wrapped before are discarded.
+	 */
+	void setWrapping(Font *font, int width);
+
+	/**
+	 * Wraps rows until at least the given number of rows is known, or the
+	 * end of the text is reached.
+	 * @return The number of rows known.
+	 */
+	size_t wrapRows(size_t count);
+
+	/** Returns true if all of the text has been wrapped. */
+	bool isWrapped() const { return wrapped == size; }
+
+	/**
+	 * Returns the number of rows the text will have once it is fully
+	 * wrapped, extrapolated from the rows wrapped so far.
+	 */
+	size_t estimateRows() const;
+
+	/** Returns a row that was wrapped before. */
+	std::string getRow(size_t row) const;
+
+private:
+	TextBuffer();
+
+	std::string text;
+	/** The mapped file, or nullptr if the text is held in a string. */
+	void *mapping;
+	const char *data;
+	size_t size;
+
+	Font *font;
+	int width;
+	std::vector<Font::LineSpan> rows;
+	/** Offset of the first paragraph that hasn't been wrapped yet. */
+	size_t wrapped;
+};
+
+#endif /* TEXTBUFFER_H */
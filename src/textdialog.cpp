@@ -21,6 +21,7 @@
 #include "textdialog.h"
 
 #include "gmenu2x.h"
+#include "textbuffer.h"
 #include "utilities.h"
 
 #include <algorithm>
@@ -28,33 +29,60 @@
 using namespace std;
 
 TextDialog::TextDialog(GMenu2X& gmenu2x, const string &title, const string &description, const string &icon, const string &text)
+	: TextDialog(gmenu2x, title, description, icon,
+			unique_ptr<TextBuffer>(new TextBuffer(text)))
+{
+}
+
+TextDialog::TextDialog(GMenu2X& gmenu2x, const string &title, const string &description, const string &icon, unique_ptr<TextBuffer> text)
 	: Dialog(gmenu2x)
+	, text(move(text))
 {
-	split(this->text, gmenu2x.font->wordWrap(text, (int) gmenu2x.resX - 15), "\n");
+	this->text->setWrapping(gmenu2x.font.get(), (int) gmenu2x.resX - 15);
 	this->title = title;
 	this->description = description;
 	this->icon = icon;
 }
 
+TextDialog::~TextDialog()
+{
+}
+
+void TextDialog::drawLine(const string &line, int y)
+{
+	Surface& s = *gmenu2x.s;
+	if (line == "----") { // horizontal ruler
+		y += gmenu2x.font->getLineSpacing() / 2;
+		s.box(5, y, gmenu2x.resX - 16, 1, 255, 255, 255, 130);
+		s.box(5, y+1, gmenu2x.resX - 16, 1, 0, 0, 0, 130);
+	} else {
+		gmenu2x.font->write(s, line, 5, y);
+	}
+}
+
 void TextDialog::drawText(const vector<string> &text, unsigned int y,
 		unsigned int firstRow, unsigned int rowsPerPage)
 {
-	Surface& s = *gmenu2x.s;
 	const int fontHeight = gmenu2x.font->getLineSpacing();
 
 	for (unsigned i = firstRow; i < firstRow + rowsPerPage && i < text.size(); i++) {
-		const string &line = text.at(i);
-		int rowY = y + (i - firstRow) * fontHeight;
-		if (line == "----") { // horizontal ruler
-			rowY += fontHeight / 2;
-			s.box(5, rowY, gmenu2x.resX - 16, 1, 255, 255, 255, 130);
-			s.box(5, rowY+1, gmenu2x.resX - 16, 1, 0, 0, 0, 130);
-		} else {
-			gmenu2x.font->write(s, line, 5, rowY);
-		}
+		drawLine(text.at(i), y + (i - firstRow) * fontHeight);
 	}
 
-	gmenu2x.drawScrollBar(rowsPerPage, text.size(), firstRow);
+	gmenu2x.drawScrollBar(*gmenu2x.s, rowsPerPage, text.size(), firstRow);
+}
+
+void TextDialog::drawText(TextBuffer& text, unsigned int y,
+		unsigned int firstRow, unsigned int rowsPerPage)
+{
+	const int fontHeight = gmenu2x.font->getLineSpacing();
+	const unsigned rows = text.wrapRows(firstRow + rowsPerPage);
+
+	for (unsigned i = firstRow; i < firstRow + rowsPerPage && i < rows; i++) {
+		drawLine(text.getRow(i), y + (i - firstRow) * fontHeight);
+	}
+
+	gmenu2x.drawScrollBar(*gmenu2x.s, rowsPerPage, text.estimateRows(), firstRow);
 }
 
 void TextDialog::exec() {
@@ -83,8 +111,6 @@ void TextDialog::exec() {
 	unsigned int contentY, contentHeight;
 	tie(contentY, contentHeight) = gmenu2x.getContentArea();
 	const unsigned rowsPerPage = max(contentHeight / fontHeight, 1u);
-	const unsigned maxFirstRow =
-			text.size() < rowsPerPage ? 0 : text.size() - rowsPerPage;
 	contentY += (contentHeight % fontHeight) / 2;
 
 	unsigned firstRow = 0;
@@ -92,9 +118,13 @@ void TextDialog::exec() {
 		OutputSurface& s = *gmenu2x.s;
 
 		bg.blit(s, 0, 0);
-		drawText(text, contentY, firstRow, rowsPerPage);
+		drawText(*text, contentY, firstRow, rowsPerPage);
 		s.flip();
 
+		// Wrap one page ahead, so we know how far the next scroll can go.
+		const unsigned rows = text->wrapRows(firstRow + 2 * rowsPerPage);
+		const unsigned maxFirstRow = rows < rowsPerPage ? 0 : rows - rowsPerPage;
+
 		switch(gmenu2x.input.waitForPressedButton()) {
 			case InputManager::UP:
 				if (firstRow > 0) firstRow--;
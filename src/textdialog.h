@@ -23,21 +23,32 @@
 
 #include "dialog.h"
 
+#include <memory>
 #include <string>
 #include <vector>
 
+class TextBuffer;
+
 class TextDialog : protected Dialog {
 protected:
-	std::vector<std::string> text;
+	std::unique_ptr<TextBuffer> text;
 	std::string title, description, icon;
 
+	void drawLine(const std::string &line, int y);
 	void drawText(const std::vector<std::string> &text, unsigned int y,
 			unsigned int firstRow, unsigned int rowsPerPage);
+	/** Draws the visible rows of the text, wrapping them if needed. */
+	void drawText(TextBuffer& text, unsigned int y,
+			unsigned int firstRow, unsigned int rowsPerPage);
 
 public:
 	TextDialog(GMenu2X& gmenu2x, const std::string &title,
 			const std::string &description, const std::string &icon,
 			const std::string &text);
+	TextDialog(GMenu2X& gmenu2x, const std::string &title,
+			const std::string &description, const std::string &icon,
+			std::unique_ptr<TextBuffer> text);
+	~TextDialog();
 	void exec();
 };
 
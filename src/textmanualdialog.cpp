@@ -22,19 +22,23 @@
 
 #include "gmenu2x.h"
 #include "surface.h"
+#include "textbuffer.h"
 #include "utilities.h"
 
 #include <algorithm>
+#include <cstdint>
 #include <sstream>
 
 using namespace std;
 
-TextManualDialog::TextManualDialog(GMenu2X& gmenu2x, const string &title, const string &icon, const string &text)
-	: TextDialog(gmenu2x, title, "", icon, text)
+TextManualDialog::TextManualDialog(GMenu2X& gmenu2x, const string &title, const string &icon, unique_ptr<TextBuffer> text)
+	: TextDialog(gmenu2x, title, "", icon, move(text))
 {
 	//split the text in multiple pages
-	for (uint i=0; i<this->text.size(); i++) {
-		string line = trim(this->text.at(i));
+	const size_t rows = this->text->wrapRows(SIZE_MAX);
+	for (size_t i = 0; i < rows; i++) {
+		const string row = this->text->getRow(i);
+		string line = trim(row);
 		if (line[0]=='[' && line[line.length()-1]==']') {
 			ManualPage mp;
 			mp.title = line.substr(1,line.length()-2);
@@ -45,7 +49,7 @@ TextManualDialog::TextManualDialog(GMenu2X& gmenu2x, const string &title, const
 				mp.title = gmenu2x.tr["Untitled"];
 				pages.push_back(mp);
 			}
-			pages[pages.size()-1].text.push_back(this->text.at(i));
+			pages[pages.size()-1].text.push_back(row);
 		}
 	}
 	if (pages.size()==0) {
@@ -23,6 +23,7 @@
 
 #include "textdialog.h"
 
+#include <memory>
 #include <string>
 #include <vector>
 
@@ -37,7 +38,7 @@ private:
 
 public:
 	TextManualDialog(GMenu2X& gmenu2x, const std::string &title,
-			const std::string &icon, const std::string &text);
+			const std::string &icon, std::unique_ptr<TextBuffer> text);
 	void exec();
 };
 
@@ -0,0 +1,302 @@
+// Various authors.
+// License: GPL version 2 or later.
+
+#include "thumbnailcache.h"
+
+#include "binaryio.h"
+#include "debug.h"
+#include "imageio.h"
+#include "profiler.h"
+#include "surface.h"
+#include "utilities.h"
+
+#include <SDL.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <vector>
+
+using namespace std;
+
+/* Identifies the file format; change it whenever the format changes. */
+static const uint32_t THUMBNAIL_MAGIC = 0x5432474d; // "MG2T", version 1
+
+/* Most bytes the thumbnails may take up on disk. */
+static const off_t MAX_CACHE_SIZE = 8 * 1024 * 1024;
+
+/* Thumbnail files are named by a hash with this extension. */
+static const char THUMBNAIL_EXT[] = ".thumb";
+
+/**
+ * What a thumbnail was made from and for. A thumbnail is only used if all
+ * of this matches.
+ */
+struct ThumbnailKey {
+	string path;
+	uint64_t size, mtimeSec;
+	uint32_t mtimeNsec;
+	uint32_t maxWidth, maxHeight;
+	SDL_PixelFormat const *format;
+};
+
+static void writeKey(BinaryWriter& out, ThumbnailKey const& key)
+{
+	out.writeU32(THUMBNAIL_MAGIC);
+	out.writeString(key.path);
+	out.writeU64(key.size);
+	out.writeU64(key.mtimeSec);
+	out.writeU32(key.mtimeNsec);
+	out.writeU32(key.maxWidth);
+	out.writeU32(key.maxHeight);
+	out.writeU8(key.format->BitsPerPixel);
+	out.writeU32(key.format->Rmask);
+	out.writeU32(key.format->Gmask);
+	out.writeU32(key.format->Bmask);
+	out.writeU32(key.format->Amask);
+}
+
+static bool matchKey(BinaryReader& in, ThumbnailKey const& key)
+{
+	uint32_t magic, mtimeNsec, maxWidth, maxHeight, rmask, gmask, bmask, amask;
+	uint64_t size, mtimeSec;
+	uint8_t bpp;
+	string path;
+	return in.readU32(magic) && magic == THUMBNAIL_MAGIC
+		&& in.readString(path) && path == key.path
+		&& in.readU64(size) && size == key.size
+		&& in.readU64(mtimeSec) && mtimeSec == key.mtimeSec
+		&& in.readU32(mtimeNsec) && mtimeNsec == key.mtimeNsec
+		&& in.readU32(maxWidth) && maxWidth == key.maxWidth
+		&& in.readU32(maxHeight) && maxHeight == key.maxHeight
+		&& in.readU8(bpp) && bpp == key.format->BitsPerPixel
+		&& in.readU32(rmask) && rmask == key.format->Rmask
+		&& in.readU32(gmask) && gmask == key.format->Gmask
+		&& in.readU32(bmask) && bmask == key.format->Bmask
+		&& in.readU32(amask) && amask == key.format->Amask;
+}
+
+/**
+ * Reads a thumbnail that was made for the given key.
+ * Returns NULL if there is none or if it is outdated.
+ */
+static SDL_Surface *readThumbnail(string const& file, ThumbnailKey const& key)
+{
+	string data = readFileAsString(file);
+	if (data.empty()) {
+		return NULL;
+	}
+
+	BinaryReader in(data);
+	uint32_t width, height;
+	if (!matchKey(in, key) || !in.readU32(width) || !in.readU32(height)
+			|| !width || !height
+			|| (key.maxWidth && width > key.maxWidth)
+			|| (key.maxHeight && height > key.maxHeight)) {
+		return NULL;
+	}
+
+	SDL_PixelFormat const *format = key.format;
+	SDL_Surface *surface = SDL_CreateRGBSurface(SDL_SWSURFACE, width, height,
+			format->BitsPerPixel,
+			format->Rmask, format->Gmask, format->Bmask, format->Amask);
+	if (!surface) {
+		return NULL;
+	}
+	const size_t rowSize = width * format->BytesPerPixel;
+	for (uint32_t y = 0; y < height; y++) {
+		if (!in.readBytes(static_cast<Uint8 *>(surface->pixels)
+					+ y * surface->pitch, rowSize)) {
+			SDL_FreeSurface(surface);
+			return NULL;
+		}
+	}
+	if (!in.atEnd()) {
+		SDL_FreeSurface(surface);
+		return NULL;
+	}
+	return surface;
+}
+
+/**
+ * Returns true if the image the thumbnail was made from is still there and
+ * unchanged, reading no more of the thumbnail than its key.
+ */
+static bool isSourceCurrent(string const& file)
+{
+	FILE *f = fopen(file.c_str(), "rb");
+	if (!f) {
+		return false;
+	}
+	string data(PATH_MAX + 64, '\0');
+	data.resize(fread(&data[0], 1, data.size(), f));
+	fclose(f);
+
+	BinaryReader in(data);
+	uint32_t magic, mtimeNsec;
+	uint64_t size, mtimeSec;
+	string path;
+	struct stat st;
+	return in.readU32(magic) && magic == THUMBNAIL_MAGIC
+		&& in.readString(path) && in.readU64(size)
+		&& in.readU64(mtimeSec) && in.readU32(mtimeNsec)
+		&& stat(path.c_str(), &st) == 0
+		&& uint64_t(st.st_size) == size
+		&& uint64_t(st.st_mtim.tv_sec) == mtimeSec
+		&& uint32_t(st.st_mtim.tv_nsec) == mtimeNsec;
+}
+
+static void writeThumbnail(string const& file, ThumbnailKey const& key,
+		SDL_Surface *surface)
+{
+	BinaryWriter out;
+	writeKey(out, key);
+	out.writeU32(surface->w);
+	out.writeU32(surface->h);
+	const size_t rowSize = surface->w * surface->format->BytesPerPixel;
+	for (int y = 0; y < surface->h; y++) {
+		out.writeBytes(static_cast<Uint8 *>(surface->pixels)
+				+ y * surface->pitch, rowSize);
+	}
+
+	if (!writeStringToFile(file, out.data())) {
+		WARNING("Unable to write thumbnail '%s'\n", file.c_str());
+	}
+}
+
+ThumbnailCache::ThumbnailCache(string const& dir)
+	: dir(dir)
+{
+	if (mkdir(dir.c_str(), 0770) < 0 && errno != EEXIST) {
+		WARNING("Unable to create thumbnail directory '%s'\n", dir.c_str());
+		return;
+	}
+	pruner = thread(&ThumbnailCache::prune, this);
+}
+
+ThumbnailCache::~ThumbnailCache()
+{
+	if (pruner.joinable()) {
+		pruner.join();
+	}
+}
+
+void ThumbnailCache::prune()
+{
+	DIR *dirp = opendir(dir.c_str());
+	if (!dirp) {
+		return;
+	}
+
+	// The modification time of a thumbnail is updated whenever it is used.
+	struct Thumbnail {
+		string file;
+		time_t used;
+		off_t size;
+	};
+	vector<Thumbnail> kept;
+	off_t total = 0;
+	unsigned int removed = 0;
+	const size_t extLength = sizeof(THUMBNAIL_EXT) - 1;
+	while (struct dirent *dptr = readdir(dirp)) {
+		const size_t length = strlen(dptr->d_name);
+		if (length <= extLength || strcmp(dptr->d_name + length - extLength,
+					THUMBNAIL_EXT) != 0) {
+			continue;
+		}
+		const string file = dir + '/' + dptr->d_name;
+		struct stat st;
+		if (stat(file.c_str(), &st) < 0) {
+			continue;
+		}
+		if (!isSourceCurrent(file)) {
+			removed += unlink(file.c_str()) == 0;
+			continue;
+		}
+		kept.push_back({ file, st.st_mtime, st.st_size });
+		total += st.st_size;
+	}
+	closedir(dirp);
+
+	if (total > MAX_CACHE_SIZE) {
+		sort(kept.begin(), kept.end(),
+				[](Thumbnail const& a, Thumbnail const& b) {
+			return a.used < b.used;
+		});
+		for (auto it = kept.begin();
+				it != kept.end() && total > MAX_CACHE_SIZE; ++it) {
+			if (unlink(it->file.c_str()) == 0) {
+				total -= it->size;
+				removed++;
+			}
+		}
+	}
+
+	DEBUG("Removed %u thumbnails; %zu KiB left\n",
+			removed, size_t(total / 1024));
+}
+
+string ThumbnailCache::fileFor(string const& path,
+		unsigned int maxWidth, unsigned int maxHeight, bool alpha) const
+{
+	char size[32];
+	snprintf(size, sizeof(size), "#%ux%u%s",
+			maxWidth, maxHeight, alpha ? "a" : "");
+	char name[2 * sizeof(size_t) + 7];
+	snprintf(name, sizeof(name), "%0*zx.thumb", (int) (2 * sizeof(size_t)),
+			hash<string>()(path + size));
+	return dir + '/' + name;
+}
+
+unique_ptr<OffscreenSurface> ThumbnailCache::load(string const& path,
+		unsigned int maxWidth, unsigned int maxHeight, bool alpha)
+{
+	SDL_Surface *screen = SDL_GetVideoSurface();
+	if (!screen) {
+		return unique_ptr<OffscreenSurface>();
+	}
+
+	Profiler::Timer timer(Profiler::IMAGE_LOAD);
+	SDL_PixelFormat const *format = alpha ? argbPixelFormat() : screen->format;
+
+	struct stat st;
+	const bool cacheable = stat(path.c_str(), &st) == 0 && S_ISREG(st.st_mode);
+	ThumbnailKey key;
+	string file;
+	if (cacheable) {
+		key.path = path;
+		key.size = st.st_size;
+		key.mtimeSec = st.st_mtim.tv_sec;
+		key.mtimeNsec = st.st_mtim.tv_nsec;
+		key.maxWidth = maxWidth;
+		key.maxHeight = maxHeight;
+		key.format = format;
+		file = fileFor(path, maxWidth, maxHeight, alpha);
+
+		SDL_Surface *raw = readThumbnail(file, key);
+		if (raw) {
+			// Marks the thumbnail as recently used for prune().
+			utimensat(AT_FDCWD, file.c_str(), NULL, 0);
+			return unique_ptr<OffscreenSurface>(new OffscreenSurface(raw));
+		}
+	}
+
+	// Images inside packages can't be checked for changes, so those are
+	// decoded every time.
+	SDL_Surface *raw = loadPNGConverted(path, format, maxWidth, maxHeight);
+	if (!raw) {
+		DEBUG("Couldn't load surface '%s'\n", path.c_str());
+		return unique_ptr<OffscreenSurface>();
+	}
+	if (cacheable) {
+		writeThumbnail(file, key, raw);
+	}
+	return unique_ptr<OffscreenSurface>(new OffscreenSurface(raw));
+}
@@ -0,0 +1,48 @@
+// Various authors.
+// License: GPL version 2 or later.
+
+#ifndef THUMBNAILCACHE_H
+#define THUMBNAILCACHE_H
+
+#include <memory>
+#include <string>
+#include <thread>
+
+class OffscreenSurface;
+
+/**
+ * Keeps shrunk copies of images on disk, already converted to the pixel
+ * format they are shown in, so browsing through wallpapers, screenshots or
+ * icons decodes every image only once.
+ * A thumbnail is identified by the path of the image and the size it was
+ * made for; it is made again when the image file changes.
+ * When the cache is opened, thumbnails of images that were removed or
+ * changed are deleted, as well as the least recently used ones once the
+ * thumbnails take up more than MAX_CACHE_SIZE; that runs in the background.
+ * The methods can be called from any thread once the video mode has been set.
+ */
+class ThumbnailCache {
+public:
+	ThumbnailCache(std::string const& dir);
+	~ThumbnailCache();
+
+	/**
+	 * Returns the given image shrunk to fit within maxWidth x maxHeight.
+	 * If "alpha" is true, the image keeps its alpha channel and has to be
+	 * converted with convertToDisplayFormatAlpha(), otherwise it is in the
+	 * pixel format of the frame buffer.
+	 * Returns nullptr if the image cannot be loaded.
+	 */
+	std::unique_ptr<OffscreenSurface> load(std::string const& path,
+			unsigned int maxWidth, unsigned int maxHeight, bool alpha = false);
+
+private:
+	std::string fileFor(std::string const& path,
+			unsigned int maxWidth, unsigned int maxHeight, bool alpha) const;
+	void prune();
+
+	std::string dir;
+	std::thread pruner;
+};
+
+#endif // THUMBNAILCACHE_H
@@ -25,6 +25,7 @@
 #include "filelister.h"
 #include "gmenu2x.h"
 #include "iconbutton.h"
+#include "imageloader.h"
 #include "surface.h"
 #include "utilities.h"
 
@@ -71,6 +72,15 @@ bool WallpaperDialog::exec()
 	int fontheight = gmenu2x.font->getLineSpacing();
 	unsigned int nb_elements = height / fontheight;
 
+	// Wallpapers come from the thumbnail cache, in the frame buffer format;
+	// the neighbours of the selection are loaded ahead of time.
+	ImageLoader images(3, [&](string const& path) {
+		return gmenu2x.thumbnails.load(path, gmenu2x.resX, gmenu2x.resY);
+	});
+	auto wallpaperPath = [&](unsigned int i) {
+		return gmenu2x.sc.getSkinFilePath("wallpapers/" + wallpapers[i]);
+	};
+
 	while (!close) {
 		OutputSurface& s = *gmenu2x.s;
 
@@ -80,7 +90,19 @@ bool WallpaperDialog::exec()
 			firstElement = selected;
 
 		//Wallpaper
-		gmenu2x.sc[((string)"skin:wallpapers/" + wallpapers[selected]).c_str()]->blit(s, 0, 0);
+		s.box(0, 0, gmenu2x.resX, gmenu2x.resY, RGBAColor(0, 0, 0));
+		if (!wallpapers.empty()) {
+			const unsigned int n = wallpapers.size();
+			images.request({
+				wallpaperPath(selected),
+				wallpaperPath((selected + 1) % n),
+				wallpaperPath((selected + n - 1) % n),
+			});
+			auto wallpaper = images.get(wallpaperPath(selected));
+			if (wallpaper) {
+				wallpaper->blit(s, 0, 0);
+			}
+		}
 
 		gmenu2x.drawTopBar(s);
 		gmenu2x.drawBottomBar(s);
@@ -107,7 +129,7 @@ bool WallpaperDialog::exec()
 		}
 		s.clearClipRect();
 
-		gmenu2x.drawScrollBar(nb_elements, wallpapers.size(), firstElement);
+		gmenu2x.drawScrollBar(s, nb_elements, wallpapers.size(), firstElement);
 		s.flip();
 
         switch(gmenu2x.input.waitForPressedButton()) {
@@ -145,9 +167,5 @@ bool WallpaperDialog::exec()
         }
 	}
 
-	for (uint i=0; i<wallpapers.size(); i++) {
-	  gmenu2x.sc.del("skin:wallpapers/" + wallpapers[i]);
-	}
-
 	return result;
 }